@@ -0,0 +1,65 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/ack_filter.h"
+
+#include <algorithm>
+
+#include "nerfnet/net/ip_packet.h"
+
+namespace nerfnet {
+namespace {
+
+// The largest frame that is inspected. Pure acknowledgements are small, so
+// this avoids parsing data segments.
+constexpr size_t kMaxAckFrameSize = kIPv6HeaderSize + 60;
+
+// Returns true if a queued acknowledgement can be removed in favor of a new
+// acknowledgement for the same flow.
+bool IsRedundantAck(const TcpAckInfo& queued, const TcpAckInfo& ack) {
+  return queued.flow == ack.flow
+      && (queued.flags & ~(kTcpFlagAck | kTcpFlagPsh)) == 0
+      && !queued.has_sack
+      && !queued.ecn_ce
+      && static_cast<int32_t>(ack.ack_number - queued.ack_number) > 0;
+}
+
+}  // anonymous namespace
+
+size_t FilterTcpAcks(std::deque<std::vector<uint8_t>>& queue,
+                     size_t start_index, const std::vector<uint8_t>& frame) {
+  TcpAckInfo ack;
+  if (frame.size() > kMaxAckFrameSize || !ParseTcpAck(frame, ack)) {
+    return 0;
+  }
+
+  size_t removed = 0;
+  auto it = queue.begin() + std::min(start_index, queue.size());
+  while (it != queue.end()) {
+    TcpAckInfo queued;
+    if (it->size() <= kMaxAckFrameSize && ParseTcpAck(*it, queued)
+        && IsRedundantAck(queued, ack)) {
+      it = queue.erase(it);
+      removed++;
+    } else {
+      it++;
+    }
+  }
+
+  return removed;
+}
+
+}  // namespace nerfnet
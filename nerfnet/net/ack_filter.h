@@ -0,0 +1,44 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_ACK_FILTER_H_
+#define NERFNET_NET_ACK_FILTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace nerfnet {
+
+// Removes queued TCP acknowledgements that are made redundant by a newly
+// queued acknowledgement for the same flow, similar to the ack-filter of the
+// CAKE queue discipline. Frames before the supplied start index are never
+// touched, which protects a frame that is partially sent.
+//
+// To keep the semantics of TCP intact, a queued acknowledgement is only
+// removed if the new one acknowledges strictly more data, so duplicate
+// acknowledgements that trigger fast retransmit are kept. Queued segments
+// with SACK options, ECN flags or a congestion experienced mark are also
+// kept.
+//
+// Returns the number of frames removed.
+size_t FilterTcpAcks(std::deque<std::vector<uint8_t>>& queue,
+                     size_t start_index, const std::vector<uint8_t>& frame);
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_ACK_FILTER_H_
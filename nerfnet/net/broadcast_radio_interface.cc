@@ -0,0 +1,353 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/broadcast_radio_interface.h"
+
+#include <algorithm>
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+
+BroadcastRadioInterface::BroadcastRadioInterface(
+    Radio& radio, Tunnel& tunnel, uint32_t addr, uint8_t channel,
+    bool is_sender, uint64_t idle_interval_us, size_t fec_group_size)
+    : RadioInterface(radio, tunnel, addr, addr, channel, is_sender),
+      fec_group_size_(fec_group_size),
+      tx_sequence_(0),
+      tx_group_count_(0),
+      tx_parity_(kMaxPacketSize, 0x00),
+      rx_group_delivered_(0),
+      rx_synced_(false),
+      last_rx_us_(0),
+      packets_received_(0),
+      packets_lost_(0),
+      packets_recovered_(0),
+      frames_dropped_(0),
+      report_start_us_(0) {
+  CHECK(fec_group_size_ <= kMaxFecGroupSize,
+      "FEC group size must be at most %zu", kMaxFecGroupSize);
+  poll_interval_us_ = idle_interval_us;
+  max_payload_size_ = kMaxPacketSize - kBroadcastHeaderSize;
+
+  // Receivers reassemble frames in the order that they start, so frames are
+  // sent one at a time.
+  interleave_max_size_ = 0;
+
+  uint8_t addr_bytes[5];
+  GetAddressBytes(addr, addr_bytes);
+  if (is_sender) {
+    radio_.OpenWritingPipe(addr_bytes);
+    radio_.StopListening();
+  } else {
+    radio_.OpenReadingPipe(kPipeId, addr_bytes);
+    radio_.StartListening();
+  }
+}
+
+void BroadcastRadioInterface::Run() {
+  if (is_primary_) {
+    RunSender();
+  } else {
+    RunReceiver();
+  }
+}
+
+void BroadcastRadioInterface::RunSender() {
+  while (running_) {
+    ApplyPendingSettings();
+    bool active;
+    {
+      std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+      active = SendChunk();
+      if (!active && tx_group_count_ > 0) {
+        // Close the group while idle so that receivers are not left waiting
+        // for the parity of the last frame.
+        SendParity();
+        active = true;
+      }
+    }
+
+    if (!active) {
+      SleepUs(poll_interval_us_);
+    }
+  }
+}
+
+bool BroadcastRadioInterface::SendChunk() {
+  TunnelTxRxPacket tunnel;
+  PopulateTxPayload(tunnel);
+  if (tunnel.payload.empty()) {
+    return false;
+  }
+
+  bool frame_start = tx_streams_[tunnel.stream].offset == 0;
+
+  std::vector<uint8_t> packet(kBroadcastHeaderSize, 0x00);
+  packet[kSequenceOffset] = tx_sequence_ & 0xff;
+  packet[kSequenceOffset + 1] = tx_sequence_ >> 8;
+  packet[kBytesLeftOffset] = tunnel.bytes_left;
+  packet[kFlagsOffset] = tx_group_count_
+      | (frame_start ? kFlagFrameStart : 0x00);
+  packet.insert(packet.end(), tunnel.payload.begin(), tunnel.payload.end());
+  Transmit(packet);
+  AdvanceTxPayload();
+
+  if (fec_group_size_ != 0) {
+    // The parity covers the size and payload of each packet. The sequence
+    // and flags of a lost packet are implied by its position in the group.
+    tx_parity_[kBytesLeftOffset] ^= packet[kBytesLeftOffset];
+    for (size_t i = kBroadcastHeaderSize; i < packet.size(); i++) {
+      tx_parity_[i] ^= packet[i];
+    }
+
+    tx_group_count_++;
+    if (tx_group_count_ == fec_group_size_) {
+      SendParity();
+    }
+  }
+
+  return true;
+}
+
+void BroadcastRadioInterface::SendParity() {
+  tx_parity_[kSequenceOffset] = tx_sequence_ & 0xff;
+  tx_parity_[kSequenceOffset + 1] = tx_sequence_ >> 8;
+  tx_parity_[kFlagsOffset] = kFlagParity | tx_group_count_;
+  Transmit(tx_parity_);
+  std::fill(tx_parity_.begin(), tx_parity_.end(), 0x00);
+  tx_group_count_ = 0;
+}
+
+void BroadcastRadioInterface::Transmit(const std::vector<uint8_t>& packet) {
+  // There is no acknowledgement, so the result only reflects whether the
+  // radio accepted the packet.
+  bool success = radio_.WriteNoAck(packet.data(), packet.size());
+  if (capture_tap_ != nullptr) {
+    capture_tap_->RecordPacketSent(packet, success);
+  }
+
+  if (!success) {
+    LOGE("Failed to transmit broadcast packet");
+  }
+
+  tx_sequence_++;
+}
+
+void BroadcastRadioInterface::RunReceiver() {
+  std::vector<uint8_t> packet(kMaxPacketSize);
+  report_start_us_ = TimeNowUs();
+  while (running_) {
+    ApplyPendingSettings();
+    bool active = false;
+    {
+      std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+      while (radio_.Available()) {
+        packet.resize(kMaxPacketSize);
+        packet.resize(radio_.Read(packet.data(), packet.size()));
+        if (capture_tap_ != nullptr) {
+          capture_tap_->RecordPacketReceived(packet);
+        }
+
+        HandlePacket(packet);
+        active = true;
+      }
+
+      uint64_t now_us = TimeNowUs();
+      if (rx_group_start_.has_value()
+          && now_us - last_rx_us_ > kGroupTimeoutUs) {
+        CloseGroup(rx_group_.size());
+      }
+
+      if (now_us - report_start_us_ >= kReportIntervalUs) {
+        ReportStats();
+        report_start_us_ = now_us;
+      }
+
+      // Receivers cannot send, so frames read from the tunnel are dropped.
+      read_buffer_.clear();
+      best_effort_buffer_.clear();
+    }
+
+    NotifyTunnelWriter();
+    if (!active) {
+      SleepUs(poll_interval_us_);
+    }
+  }
+}
+
+void BroadcastRadioInterface::HandlePacket(
+    const std::vector<uint8_t>& packet) {
+  if (packet.size() < kBroadcastHeaderSize) {
+    LOGE("Received short packet");
+    return;
+  }
+
+  packets_received_++;
+  last_rx_us_ = TimeNowUs();
+  uint16_t sequence = packet[kSequenceOffset]
+      | (packet[kSequenceOffset + 1] << 8);
+  uint16_t expected_sequence = rx_sequence_.value_or(sequence);
+  packets_lost_ += static_cast<uint16_t>(sequence - expected_sequence);
+  rx_sequence_ = sequence + 1;
+
+  uint8_t flags = packet[kFlagsOffset];
+  size_t index = flags & kIndexMask;
+  uint16_t group_start = sequence - index;
+  if (rx_group_start_.has_value() && rx_group_start_.value() != group_start) {
+    // The size of the previous group is implied by the start of this one,
+    // which also accounts for data packets lost at its end.
+    size_t count = static_cast<uint16_t>(
+        group_start - rx_group_start_.value());
+    CloseGroup(fec_group_size_ == 0 ? count : count - 1);
+  } else if (!rx_group_start_.has_value()
+      && static_cast<int16_t>(group_start - expected_sequence) > 0) {
+    // Whole groups were lost since the last one was closed.
+    DropFrame();
+  }
+
+  if (!rx_group_start_.has_value()) {
+    rx_group_start_ = group_start;
+  }
+
+  if (flags & kFlagParity) {
+    RecoverPacket(packet, index);
+    CloseGroup(index);
+    return;
+  }
+
+  if (rx_group_.size() <= index) {
+    rx_group_.resize(index + 1);
+  }
+
+  rx_group_[index] = packet;
+  DeliverGroup();
+}
+
+void BroadcastRadioInterface::RecoverPacket(
+    const std::vector<uint8_t>& parity, size_t count) {
+  size_t missing_index = 0;
+  size_t missing_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (i >= rx_group_.size() || rx_group_[i].empty()) {
+      missing_index = i;
+      missing_count++;
+    }
+  }
+
+  if (missing_count != 1) {
+    return;
+  }
+
+  std::vector<uint8_t> packet = parity;
+  packet.resize(kMaxPacketSize, 0x00);
+  for (size_t i = 0; i < count; i++) {
+    if (i == missing_index) {
+      continue;
+    }
+
+    const auto& data = rx_group_[i];
+    packet[kBytesLeftOffset] ^= data[kBytesLeftOffset];
+    for (size_t j = kBroadcastHeaderSize; j < data.size(); j++) {
+      packet[j] ^= data[j];
+    }
+  }
+
+  // The frame start flag is not recovered, which is only needed to resume
+  // after an unrecovered loss.
+  packet[kFlagsOffset] = missing_index;
+  packet.resize(kBroadcastHeaderSize + std::min(
+      static_cast<size_t>(packet[kBytesLeftOffset]), max_payload_size_));
+  if (rx_group_.size() <= missing_index) {
+    rx_group_.resize(missing_index + 1);
+  }
+
+  rx_group_[missing_index] = std::move(packet);
+  packets_recovered_++;
+}
+
+void BroadcastRadioInterface::DeliverGroup() {
+  while (rx_group_delivered_ < rx_group_.size()
+      && !rx_group_[rx_group_delivered_].empty()) {
+    DeliverPacket(rx_group_[rx_group_delivered_]);
+    rx_group_delivered_++;
+  }
+}
+
+void BroadcastRadioInterface::CloseGroup(size_t count) {
+  size_t received_count = std::min(count, rx_group_.size());
+  for (size_t i = rx_group_delivered_; i < received_count; i++) {
+    if (rx_group_[i].empty()) {
+      DropFrame();
+    } else {
+      DeliverPacket(rx_group_[i]);
+    }
+  }
+
+  if (count > rx_group_.size()) {
+    DropFrame();
+  }
+
+  rx_group_start_.reset();
+  rx_group_.clear();
+  rx_group_delivered_ = 0;
+}
+
+void BroadcastRadioInterface::DeliverPacket(
+    const std::vector<uint8_t>& packet) {
+  if (packet[kFlagsOffset] & kFlagFrameStart) {
+    if (!frame_buffers_[0].empty()) {
+      DropFrame();
+    }
+
+    rx_synced_ = true;
+  }
+
+  if (!rx_synced_) {
+    return;
+  }
+
+  // Frames are sent one at a time, so only the first stream is used.
+  auto& frame = frame_buffers_[0];
+  size_t payload_size = packet.size() - kBroadcastHeaderSize;
+  frame.insert(frame.end(), packet.begin() + kBroadcastHeaderSize,
+      packet.end());
+  if (packet[kBytesLeftOffset] <= payload_size) {
+    WriteTunnel(frame);
+  }
+}
+
+void BroadcastRadioInterface::DropFrame() {
+  if (rx_synced_) {
+    frames_dropped_++;
+  }
+
+  frame_buffers_[0].clear();
+  rx_synced_ = false;
+}
+
+void BroadcastRadioInterface::ReportStats() {
+  LOGI("Broadcast: %u packets received, %u lost, %u recovered, "
+      "%u frames dropped", packets_received_, packets_lost_,
+      packets_recovered_, frames_dropped_);
+  packets_received_ = 0;
+  packets_lost_ = 0;
+  packets_recovered_ = 0;
+  frames_dropped_ = 0;
+}
+
+}  // namespace nerfnet
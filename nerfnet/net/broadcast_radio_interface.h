@@ -0,0 +1,146 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_BROADCAST_RADIO_INTERFACE_H_
+#define NERFNET_NET_BROADCAST_RADIO_INTERFACE_H_
+
+#include <optional>
+
+#include "nerfnet/net/radio_interface.h"
+
+namespace nerfnet {
+
+// A one-way radio interface for streaming to any number of receivers. The
+// sender transmits the frames read from its tunnel to a shared address
+// without requesting acknowledgements, so the airtime used does not depend
+// on the number of receivers. Receivers never transmit.
+//
+// Each packet carries a sequence number so that receivers can detect gaps.
+// When enabled, a parity packet follows each group of data packets, which
+// lets receivers recover one lost packet per group. Frames with a loss that
+// could not be recovered are dropped.
+class BroadcastRadioInterface : public RadioInterface {
+ public:
+  // Setup the broadcast link. The sender transmits to the supplied address
+  // and receivers listen on it. The group size must match on all sides and
+  // is zero to disable parity packets.
+  BroadcastRadioInterface(Radio& radio, Tunnel& tunnel, uint32_t addr,
+                          uint8_t channel, bool is_sender,
+                          uint64_t idle_interval_us, size_t fec_group_size);
+
+  // The largest supported group size.
+  static constexpr size_t kMaxFecGroupSize = 32;
+
+  // Runs the interface.
+  void Run() final;
+
+ private:
+  // The layout of the header of each packet.
+  static constexpr size_t kBroadcastHeaderSize = 4;
+  static constexpr size_t kSequenceOffset = 0;
+  static constexpr size_t kBytesLeftOffset = 2;
+  static constexpr size_t kFlagsOffset = 3;
+
+  // The flags of a packet. The lower bits hold the index of a data packet
+  // within its group, or the number of data packets covered by a parity
+  // packet.
+  static constexpr uint8_t kFlagFrameStart = 0x80;
+  static constexpr uint8_t kFlagParity = 0x40;
+  static constexpr uint8_t kIndexMask = 0x3f;
+
+  // The time without packets after which a receiver gives up waiting for
+  // the parity packet of the current group.
+  static constexpr uint64_t kGroupTimeoutUs = 100000;
+
+  // The interval to log reception statistics at.
+  static constexpr uint64_t kReportIntervalUs = 10000000;
+
+  // The number of data packets per parity packet, zero when disabled.
+  const size_t fec_group_size_;
+
+  // The sequence number of the next packet to send.
+  uint16_t tx_sequence_;
+
+  // The number of data packets sent in the current group and their parity.
+  size_t tx_group_count_;
+  std::vector<uint8_t> tx_parity_;
+
+  // The sequence number expected next by a receiver.
+  std::optional<uint16_t> rx_sequence_;
+
+  // The sequence number that the current group starts at, the data packets
+  // received in it, empty where missing, and the number passed on so far.
+  std::optional<uint16_t> rx_group_start_;
+  std::vector<std::vector<uint8_t>> rx_group_;
+  size_t rx_group_delivered_;
+
+  // Set once the receiver has seen the start of the frame being received.
+  bool rx_synced_;
+
+  // The time that the last packet was received.
+  uint64_t last_rx_us_;
+
+  // Reception statistics since the last report and the time it was made.
+  uint32_t packets_received_;
+  uint32_t packets_lost_;
+  uint32_t packets_recovered_;
+  uint32_t frames_dropped_;
+  uint64_t report_start_us_;
+
+  // Runs the sending side.
+  void RunSender();
+
+  // Sends the next chunk of the read buffer, returning false if there is
+  // nothing to send. The read buffer lock must be held.
+  bool SendChunk();
+
+  // Sends the parity packet of the current group and starts a new one.
+  void SendParity();
+
+  // Transmits a packet to all receivers.
+  void Transmit(const std::vector<uint8_t>& packet);
+
+  // Runs the receiving side.
+  void RunReceiver();
+
+  // Handles a packet from the sender.
+  void HandlePacket(const std::vector<uint8_t>& packet);
+
+  // Rebuilds the only missing data packet of the current group from the
+  // supplied parity packet, if exactly one of the first count is missing.
+  void RecoverPacket(const std::vector<uint8_t>& parity, size_t count);
+
+  // Passes on the data packets of the current group up to the first one
+  // missing.
+  void DeliverGroup();
+
+  // Passes on the remaining data packets of the current group, which has
+  // the supplied number of them, and clears it.
+  void CloseGroup(size_t count);
+
+  // Adds the payload of a data packet to the frame being received.
+  void DeliverPacket(const std::vector<uint8_t>& packet);
+
+  // Discards the frame being received after a loss.
+  void DropFrame();
+
+  // Logs and resets the reception statistics.
+  void ReportStats();
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_BROADCAST_RADIO_INTERFACE_H_
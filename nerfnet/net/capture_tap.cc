@@ -0,0 +1,290 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/capture_tap.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+namespace {
+
+// The layout of the header of radio packets. Control packets have a zero
+// first byte followed by their type, and TxRx packets carry their ID and
+// ack ID in the first byte followed by the stream and the number of bytes
+// left in the frame.
+constexpr size_t kPacketHeaderSize = 2;
+constexpr uint8_t kIDMask = 0x0f;
+constexpr uint8_t kStreamShift = 5;
+constexpr uint8_t kBytesLeftMask = 0x1f;
+
+// Returns the size of a record in the ring including its header.
+size_t GetRecordSize(size_t header_size, size_t data_size) {
+  return (header_size + data_size + header_size - 1)
+      / header_size * header_size;
+}
+
+}  // anonymous namespace
+
+CaptureTap::CaptureTap(const std::string& path, size_t ring_size)
+    : ring_(nullptr),
+      ring_size_(GetRecordSize(sizeof(RecordHeader), ring_size)),
+      ring_head_(0),
+      ring_tail_(0),
+      dropped_records_(0),
+      writer_(path),
+      wall_offset_us_(RealTimeNowUs() - TimeNowUs()),
+      reported_dropped_records_(0),
+      running_(true) {
+  // The ring is prefaulted so that recording does not fault.
+  void* ring = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  CHECK(ring != MAP_FAILED, "Failed to map capture ring: %s (%d)",
+      strerror(errno), errno);
+  ring_ = static_cast<uint8_t*>(ring);
+
+  frames_interface_ = writer_.AddInterface(PcapngWriter::kLinkTypeRaw,
+      "frames");
+  packets_interface_ = writer_.AddInterface(PcapngWriter::kLinkTypeUser0,
+      "radio");
+  writer_thread_ = StartThread([this]() { WriterThread(); });
+}
+
+CaptureTap::~CaptureTap() {
+  running_ = false;
+  JoinThread(writer_thread_);
+  Drain();
+  munmap(ring_, ring_size_);
+}
+
+void CaptureTap::RecordFrameQueued(const std::vector<uint8_t>& frame) {
+  Record(RecordType::FrameQueued, frame.data(), frame.size());
+}
+
+void CaptureTap::RecordFrameSent(const std::vector<uint8_t>& frame) {
+  Record(RecordType::FrameSent, frame.data(), frame.size());
+}
+
+void CaptureTap::RecordFrameReceived(const std::vector<uint8_t>& frame) {
+  Record(RecordType::FrameReceived, frame.data(), frame.size());
+}
+
+void CaptureTap::RecordPacketSent(const std::vector<uint8_t>& packet,
+                                  bool acked) {
+  Record(RecordType::PacketSent, packet.data(), packet.size(), acked);
+}
+
+void CaptureTap::RecordPacketReceived(const std::vector<uint8_t>& packet) {
+  Record(RecordType::PacketReceived, packet.data(), packet.size());
+}
+
+void CaptureTap::Record(RecordType type, const uint8_t* data, size_t size,
+                        bool acked) {
+  RecordHeader header;
+  header.timestamp_us = TimeNowUs();
+  header.size = static_cast<uint32_t>(size);
+  header.type = type;
+  header.acked = acked;
+
+  size_t record_size = GetRecordSize(sizeof(RecordHeader), size);
+  std::lock_guard<std::mutex> lock(ring_mutex_);
+  size_t offset = ring_head_ % ring_size_;
+  size_t padding_size = 0;
+  if (ring_size_ - offset < record_size) {
+    padding_size = ring_size_ - offset;
+  }
+
+  if (ring_size_ - (ring_head_ - ring_tail_) < padding_size + record_size) {
+    dropped_records_++;
+    return;
+  }
+
+  if (padding_size != 0) {
+    RecordHeader padding = {};
+    padding.size = static_cast<uint32_t>(padding_size - sizeof(padding));
+    padding.type = RecordType::Padding;
+    memcpy(&ring_[offset], &padding, sizeof(padding));
+    ring_head_ += padding_size;
+    offset = 0;
+  }
+
+  memcpy(&ring_[offset], &header, sizeof(header));
+  if (size > 0) {
+    memcpy(&ring_[offset + sizeof(header)], data, size);
+  }
+
+  ring_head_ += record_size;
+}
+
+void CaptureTap::WriterThread() {
+  while (running_) {
+    Drain();
+    SleepUs(kDrainIntervalUs);
+  }
+}
+
+void CaptureTap::Drain() {
+  uint64_t head;
+  uint64_t tail;
+  uint64_t dropped_records;
+  {
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    head = ring_head_;
+    tail = ring_tail_;
+    dropped_records = dropped_records_;
+  }
+
+  if (dropped_records != reported_dropped_records_) {
+    LOGW("Capture ring is full, dropped %llu records",
+        static_cast<unsigned long long>(
+            dropped_records - reported_dropped_records_));
+    reported_dropped_records_ = dropped_records;
+  }
+
+  if (head == tail) {
+    return;
+  }
+
+  while (tail != head) {
+    const uint8_t* record = &ring_[tail % ring_size_];
+    RecordHeader header;
+    memcpy(&header, record, sizeof(header));
+    if (header.type != RecordType::Padding) {
+      WriteRecord(header, record + sizeof(header));
+    }
+
+    tail += GetRecordSize(sizeof(RecordHeader), header.size);
+  }
+
+  writer_.Flush();
+  std::lock_guard<std::mutex> lock(ring_mutex_);
+  ring_tail_ = tail;
+}
+
+void CaptureTap::WriteRecord(const RecordHeader& header,
+                             const uint8_t* data) {
+  comment_.clear();
+  uint32_t interface_id = packets_interface_;
+  auto direction = PcapngWriter::Direction::Inbound;
+  switch (header.type) {
+    case RecordType::FrameQueued:
+      // Queued frames are only written out once they have been sent.
+      queued_frames_.push_back(
+          {header.timestamp_us, Hash(data, header.size), header.size});
+      return;
+    case RecordType::FrameSent:
+      FormatFrameSentComment(header, data);
+      interface_id = frames_interface_;
+      direction = PcapngWriter::Direction::Outbound;
+      break;
+    case RecordType::FrameReceived:
+      interface_id = frames_interface_;
+      break;
+    case RecordType::PacketSent:
+      FormatPacketComment(header, data);
+      direction = PcapngWriter::Direction::Outbound;
+      break;
+    case RecordType::PacketReceived:
+      FormatPacketComment(header, data);
+      break;
+    default:
+      return;
+  }
+
+  writer_.WritePacket(interface_id, header.timestamp_us + wall_offset_us_,
+      data, header.size, direction, comment_);
+}
+
+void CaptureTap::FormatPacketComment(const RecordHeader& header,
+                                     const uint8_t* data) {
+  char buffer[96];
+  bool sent = (header.type == RecordType::PacketSent);
+  if (header.size < kPacketHeaderSize) {
+    comment_ = "short";
+  } else if (data[0] == 0x00) {
+    snprintf(buffer, sizeof(buffer), "control type=%u", data[1]);
+    comment_ = buffer;
+  } else {
+    uint8_t id = data[0] & kIDMask;
+    uint8_t ack_id = (data[0] >> 4) & kIDMask;
+    uint8_t bytes_left = data[1] & kBytesLeftMask;
+    snprintf(buffer, sizeof(buffer), "id=%u ack=%u stream=%u bytes_left=%u",
+        id, ack_id, data[1] >> kStreamShift, bytes_left);
+    comment_ = buffer;
+
+    // A payload is sent with the same ID until it is acknowledged, and the
+    // IDs of packets without a payload are unused.
+    if (bytes_left != 0 && id != 0) {
+      std::optional<uint8_t>& last_id =
+          sent ? last_sent_id_ : last_received_id_;
+      if (last_id.has_value() && last_id.value() == id) {
+        comment_ += sent ? " retransmit" : " duplicate";
+      }
+
+      last_id = id;
+    }
+  }
+
+  if (sent) {
+    comment_ += header.acked ? " acked" : " not-acked";
+  }
+}
+
+void CaptureTap::FormatFrameSentComment(const RecordHeader& header,
+                                        const uint8_t* data) {
+  uint64_t hash = Hash(data, header.size);
+  size_t index = 0;
+  while (index < queued_frames_.size()
+      && (queued_frames_[index].hash != hash
+          || queued_frames_[index].size != header.size)) {
+    index++;
+  }
+
+  char buffer[96];
+  if (index == queued_frames_.size()) {
+    comment_ = "sojourn_us=unknown";
+    return;
+  }
+
+  // Frames queued ahead of this one that were never sent were removed by
+  // the ack filter.
+  snprintf(buffer, sizeof(buffer), "sojourn_us=%llu",
+      static_cast<unsigned long long>(
+          header.timestamp_us - queued_frames_[index].queued_us));
+  comment_ = buffer;
+  if (index > 0) {
+    snprintf(buffer, sizeof(buffer), " filtered_ahead=%zu", index);
+    comment_ += buffer;
+  }
+
+  queued_frames_.erase(queued_frames_.begin(),
+      queued_frames_.begin() + index + 1);
+}
+
+uint64_t CaptureTap::Hash(const uint8_t* data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 0x100000001b3;
+  }
+
+  return hash;
+}
+
+}  // namespace nerfnet
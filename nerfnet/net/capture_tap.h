@@ -0,0 +1,161 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_CAPTURE_TAP_H_
+#define NERFNET_NET_CAPTURE_TAP_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "nerfnet/util/non_copyable.h"
+#include "nerfnet/util/pcapng.h"
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+
+// Captures the frames and radio packets of a radio interface to a pcapng
+// file. Frames are written to a raw IP interface and packets to a second
+// interface, with comments carrying the sequence and ack IDs of each packet,
+// whether it was acknowledged by the radio, retransmissions and the time
+// each frame spent queued for the link.
+//
+// Records are copied into a memory-mapped ring under a short lock and are
+// written to the file by a background thread, so the radio never waits on
+// the file. Records are dropped while the ring is full.
+class CaptureTap : public NonCopyable {
+ public:
+  // The default size of the ring in bytes.
+  static constexpr size_t kDefaultRingSize = 4 * 1024 * 1024;
+
+  // Creates the capture file and starts the thread that writes to it. Quits
+  // and logs the error on failure.
+  explicit CaptureTap(const std::string& path,
+                      size_t ring_size = kDefaultRingSize);
+  ~CaptureTap();
+
+  // Records a frame read from the tunnel and queued for the link, a frame
+  // that the peer has acknowledged all of, and a frame received from the
+  // peer.
+  void RecordFrameQueued(const std::vector<uint8_t>& frame);
+  void RecordFrameSent(const std::vector<uint8_t>& frame);
+  void RecordFrameReceived(const std::vector<uint8_t>& frame);
+
+  // Records a radio packet sent, with whether the radio received an
+  // acknowledgement for it, and a radio packet received.
+  void RecordPacketSent(const std::vector<uint8_t>& packet, bool acked);
+  void RecordPacketReceived(const std::vector<uint8_t>& packet);
+
+ private:
+  // The time between writing out the contents of the ring.
+  static constexpr uint64_t kDrainIntervalUs = 10000;
+
+  // The types of records in the ring. Padding fills the end of the ring
+  // when a record does not fit before it wraps.
+  enum class RecordType : uint8_t {
+    Padding,
+    FrameQueued,
+    FrameSent,
+    FrameReceived,
+    PacketSent,
+    PacketReceived,
+  };
+
+  // The header of each record, which is followed by the data. Records are
+  // aligned to the size of the header so that a header always fits before
+  // the end of the ring.
+  struct RecordHeader {
+    uint64_t timestamp_us;
+    uint32_t size;
+    RecordType type;
+    bool acked;
+  };
+
+  // A frame queued for the link, kept to find the sojourn time of the frame
+  // once it has been sent. Frames are matched by a hash of their contents
+  // since frames may be removed from the queue by the ack filter.
+  struct QueuedFrame {
+    uint64_t queued_us;
+    uint64_t hash;
+    size_t size;
+  };
+
+  // The ring and the positions that records are written at and read from.
+  // The positions only increase and are reduced modulo the size of the ring.
+  // Records between the tail and the head are only touched by the thread
+  // writing to the file.
+  uint8_t* ring_;
+  const size_t ring_size_;
+  std::mutex ring_mutex_;
+  uint64_t ring_head_;
+  uint64_t ring_tail_;
+
+  // The number of records dropped because the ring was full.
+  uint64_t dropped_records_;
+
+  // The capture file and the interfaces that frames and packets are written
+  // to.
+  PcapngWriter writer_;
+  uint32_t frames_interface_;
+  uint32_t packets_interface_;
+
+  // The offset from the link clock to the wall clock, which is used for the
+  // timestamps in the capture.
+  const uint64_t wall_offset_us_;
+
+  // The state used to annotate records. Only used by the writer thread.
+  std::deque<QueuedFrame> queued_frames_;
+  std::optional<uint8_t> last_sent_id_;
+  std::optional<uint8_t> last_received_id_;
+  uint64_t reported_dropped_records_;
+  std::string comment_;
+
+  // The thread writing records to the file.
+  std::atomic<bool> running_;
+  ClockThread writer_thread_;
+
+  // Copies a record into the ring, or drops it if the ring is full.
+  void Record(RecordType type, const uint8_t* data, size_t size,
+              bool acked = false);
+
+  // Writes records from the ring to the file until stopped.
+  void WriterThread();
+
+  // Writes out the records in the ring.
+  void Drain();
+
+  // Writes a record to the file.
+  void WriteRecord(const RecordHeader& header, const uint8_t* data);
+
+  // Formats the comment describing a radio packet.
+  void FormatPacketComment(const RecordHeader& header, const uint8_t* data);
+
+  // Formats the comment describing a sent frame and forgets the frames that
+  // were queued ahead of it.
+  void FormatFrameSentComment(const RecordHeader& header,
+                              const uint8_t* data);
+
+  // Returns the FNV-1a hash of the supplied bytes.
+  static uint64_t Hash(const uint8_t* data, size_t size);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_CAPTURE_TAP_H_
@@ -0,0 +1,294 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/control_socket.h"
+
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/string.h"
+
+namespace nerfnet {
+namespace {
+
+// The names of the power levels, indexed by rf24_pa_dbm_e.
+const char* kPALevelNames[] = {"min", "low", "high", "max"};
+
+// The names of the data rates, indexed by rf24_datarate_e.
+const char* kDataRateNames[] = {"1mbps", "2mbps", "250kbps"};
+
+// Parses a decimal value no larger than the supplied maximum.
+bool ParseUnsigned(const std::string& str, uint64_t max, uint64_t& value) {
+  if (str.empty() || str[0] == '-') {
+    return false;
+  }
+
+  char* end = nullptr;
+  errno = 0;
+  unsigned long long result = strtoull(str.c_str(), &end, 10);
+  if (errno != 0 || *end != '\0' || result > max) {
+    return false;
+  }
+
+  value = result;
+  return true;
+}
+
+// Returns the index of the supplied name in a table of names, or -1.
+template<size_t N>
+int ParseName(const std::string& str, const char* (&names)[N]) {
+  for (size_t i = 0; i < N; i++) {
+    if (str == names[i]) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+}  // anonymous namespace
+
+ControlSocket::ControlSocket(const std::string& path,
+                             RadioInterface& radio_interface)
+    : path_(path),
+      radio_interface_(radio_interface),
+      socket_fd_(socket(AF_UNIX, SOCK_STREAM, 0)),
+      running_(true) {
+  CHECK(socket_fd_ >= 0, "Failed to open control socket: %s (%d)",
+      strerror(errno), errno);
+
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  CHECK(path_.size() < sizeof(addr.sun_path),
+      "Control socket path is too long");
+  strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+
+  unlink(path_.c_str());
+  CHECK(bind(socket_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+      sizeof(addr)) == 0, "Failed to bind control socket '%s': %s (%d)",
+      path_.c_str(), strerror(errno), errno);
+  chmod(path_.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  CHECK(listen(socket_fd_, 1) == 0, "Failed to listen on control socket: "
+      "%s (%d)", strerror(errno), errno);
+  thread_ = std::thread(&ControlSocket::ServeThread, this);
+}
+
+ControlSocket::~ControlSocket() {
+  running_ = false;
+  shutdown(socket_fd_, SHUT_RDWR);
+  thread_.join();
+  close(socket_fd_);
+  unlink(path_.c_str());
+}
+
+void ControlSocket::ServeThread() {
+  while (running_) {
+    int client_fd = accept(socket_fd_, nullptr, nullptr);
+    if (client_fd < 0) {
+      if (running_) {
+        LOGE("Failed to accept control client: %s (%d)",
+            strerror(errno), errno);
+      }
+
+      continue;
+    }
+
+    ServeClient(client_fd);
+    close(client_fd);
+  }
+}
+
+void ControlSocket::ServeClient(int client_fd) {
+  std::string buffer;
+  char data[256];
+  while (running_) {
+    // An idle client must not keep the socket from closing, so reads wait
+    // for a bounded time.
+    struct pollfd pfd = {client_fd, POLLIN, 0};
+    int status = poll(&pfd, 1, kPollTimeoutMs);
+    if (status < 0 && errno != EINTR) {
+      LOGE("Failed to poll control client: %s (%d)", strerror(errno), errno);
+      return;
+    } else if (status <= 0) {
+      continue;
+    }
+
+    ssize_t size = read(client_fd, data, sizeof(data));
+    if (size <= 0) {
+      return;
+    }
+
+    buffer.append(data, size);
+    size_t line_end;
+    while ((line_end = buffer.find('\n')) != std::string::npos) {
+      std::string command = buffer.substr(0, line_end);
+      buffer.erase(0, line_end + 1);
+      if (!command.empty() && command.back() == '\r') {
+        command.pop_back();
+      }
+
+      std::string response = HandleCommand(command);
+      if (send(client_fd, response.data(), response.size(), MSG_NOSIGNAL)
+          != static_cast<ssize_t>(response.size())) {
+        return;
+      }
+    }
+  }
+}
+
+std::string ControlSocket::HandleCommand(const std::string& command) {
+  std::istringstream stream(command);
+  std::string verb;
+  stream >> verb;
+  if (verb == "get") {
+    return GetSettings() + "ok\n";
+  } else if (verb == "set") {
+    std::string name;
+    std::string value;
+    std::string extra;
+    stream >> name >> value >> extra;
+    if (name.empty() || value.empty() || !extra.empty()) {
+      return "error: usage is set <name> <value>\n";
+    }
+
+    std::string error;
+    if (!SetSetting(name, value, error)) {
+      return "error: " + error + "\n";
+    }
+
+    LOGI("Control socket set %s to %s", name.c_str(), value.c_str());
+    return "ok\n";
+  } else if (verb.empty()) {
+    return "";
+  }
+
+  return "error: unknown command '" + verb + "'\n";
+}
+
+std::string ControlSocket::GetSettings() {
+  auto radio_config = radio_interface_.GetRadioConfig();
+  std::string settings;
+  settings += StringFormat("poll_interval_us %llu\n",
+      static_cast<unsigned long long>(radio_interface_.GetPollIntervalUs()));
+  settings += StringFormat("max_backoff_us %llu\n",
+      static_cast<unsigned long long>(radio_interface_.GetMaxBackoffUs()));
+  settings += StringFormat("max_buffered_frames %zu\n",
+      radio_interface_.GetMaxBufferedFrames());
+  settings += StringFormat("tunnel_logs %d\n",
+      radio_interface_.GetTunnelLogsEnabled());
+  settings += StringFormat("ack_filter %d\n",
+      radio_interface_.GetAckFilterEnabled());
+  settings += StringFormat("pa_level %s\n",
+      kPALevelNames[radio_interface_.GetPALevel()]);
+  settings += StringFormat("channel %u\n", radio_config.channel);
+  settings += StringFormat("data_rate %s\n",
+      kDataRateNames[radio_config.data_rate]);
+
+  auto requested_radio_config = radio_interface_.GetRequestedRadioConfig();
+  if (requested_radio_config != radio_config) {
+    settings += StringFormat("pending channel %u data_rate %s\n",
+        requested_radio_config.channel,
+        kDataRateNames[requested_radio_config.data_rate]);
+  }
+
+  return settings;
+}
+
+bool ControlSocket::SetSetting(const std::string& name,
+    const std::string& value, std::string& error) {
+  uint64_t number = 0;
+  if (name == "poll_interval_us") {
+    if (!ParseUnsigned(value, kMaxPollIntervalUs, number)) {
+      error = StringFormat("poll_interval_us must be at most %llu",
+          static_cast<unsigned long long>(kMaxPollIntervalUs));
+      return false;
+    }
+
+    radio_interface_.SetPollIntervalUs(number);
+  } else if (name == "max_backoff_us") {
+    if (!ParseUnsigned(value, kMaxBackoffUs, number)) {
+      error = StringFormat("max_backoff_us must be at most %llu",
+          static_cast<unsigned long long>(kMaxBackoffUs));
+      return false;
+    }
+
+    radio_interface_.SetMaxBackoffUs(number);
+  } else if (name == "max_buffered_frames") {
+    if (!ParseUnsigned(value, kMaxBufferedFrames, number) || number == 0) {
+      error = StringFormat("max_buffered_frames must be between 1 and %llu",
+          static_cast<unsigned long long>(kMaxBufferedFrames));
+      return false;
+    }
+
+    radio_interface_.SetMaxBufferedFrames(number);
+  } else if (name == "tunnel_logs" || name == "ack_filter") {
+    if (!ParseUnsigned(value, 1, number)) {
+      error = name + " must be 0 or 1";
+      return false;
+    }
+
+    if (name == "tunnel_logs") {
+      radio_interface_.SetTunnelLogsEnabled(number);
+    } else {
+      radio_interface_.SetAckFilterEnabled(number);
+    }
+  } else if (name == "pa_level") {
+    int pa_level = ParseName(value, kPALevelNames);
+    if (pa_level < 0) {
+      error = "pa_level must be one of min, low, high or max";
+      return false;
+    }
+
+    radio_interface_.SetPALevel(static_cast<rf24_pa_dbm_e>(pa_level));
+  } else if (name == "channel" || name == "data_rate") {
+    auto radio_config = radio_interface_.GetRequestedRadioConfig();
+    if (name == "channel") {
+      if (!ParseUnsigned(value, 127, number)) {
+        error = "channel must be between 0 and 127";
+        return false;
+      }
+
+      radio_config.channel = number;
+    } else {
+      int data_rate = ParseName(value, kDataRateNames);
+      if (data_rate < 0) {
+        error = "data_rate must be one of 250kbps, 1mbps or 2mbps";
+        return false;
+      }
+
+      radio_config.data_rate = static_cast<rf24_datarate_e>(data_rate);
+    }
+
+    if (!radio_interface_.RequestRadioConfig(radio_config)) {
+      error = "radio config changes must be made on the primary of a "
+          "polled link";
+      return false;
+    }
+  } else {
+    error = "unknown setting '" + name + "'";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_CONTROL_SOCKET_H_
+#define NERFNET_NET_CONTROL_SOCKET_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "nerfnet/net/radio_interface.h"
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// A local control socket for tuning a running radio interface. Clients
+// connect to a unix stream socket and send one command per line.
+//
+//   get                  Lists the current settings.
+//   set <name> <value>   Changes a setting.
+//
+// Each command is answered with any output followed by a line containing
+// "ok" or "error: <reason>".
+class ControlSocket : public NonCopyable {
+ public:
+  // Listens for connections at the supplied path, replacing any existing
+  // socket file.
+  ControlSocket(const std::string& path, RadioInterface& radio_interface);
+  ~ControlSocket();
+
+ private:
+  // The time to wait for a command before checking whether to stop.
+  static constexpr int kPollTimeoutMs = 100;
+
+  // The largest poll interval that can be set. Longer intervals would cause
+  // the secondary to fall back to the startup radio config.
+  static constexpr uint64_t kMaxPollIntervalUs = 1000000;
+
+  // The largest backoff bound that can be set.
+  static constexpr uint64_t kMaxBackoffUs = 1000000;
+
+  // The largest queue limit that can be set.
+  static constexpr uint64_t kMaxBufferedFrames = 65536;
+
+  // The path of the socket file.
+  const std::string path_;
+
+  // The interface to control.
+  RadioInterface& radio_interface_;
+
+  // The listening socket.
+  int socket_fd_;
+
+  // The thread that serves clients.
+  std::atomic<bool> running_;
+  std::thread thread_;
+
+  // Accepts clients and serves them one at a time.
+  void ServeThread();
+
+  // Reads commands from a client until it disconnects or the socket is
+  // closed.
+  void ServeClient(int client_fd);
+
+  // Runs a command and returns the response to send.
+  std::string HandleCommand(const std::string& command);
+
+  // Returns the current settings, one per line.
+  std::string GetSettings();
+
+  // Changes a setting. Returns false and populates the error on failure.
+  bool SetSetting(const std::string& name, const std::string& value,
+      std::string& error);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_CONTROL_SOCKET_H_
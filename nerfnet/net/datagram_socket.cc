@@ -0,0 +1,180 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/datagram_socket.h"
+
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+
+DatagramSocket::DatagramSocket(const std::string& path,
+                               RadioInterface& radio_interface)
+    : path_(path),
+      radio_interface_(radio_interface),
+      socket_fd_(socket(AF_UNIX, SOCK_SEQPACKET, 0)),
+      running_(true) {
+  CHECK(socket_fd_ >= 0, "Failed to open datagram socket: %s (%d)",
+      strerror(errno), errno);
+
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  CHECK(path_.size() < sizeof(addr.sun_path),
+      "Datagram socket path is too long");
+  strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+
+  unlink(path_.c_str());
+  CHECK(bind(socket_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+      sizeof(addr)) == 0, "Failed to bind datagram socket '%s': %s (%d)",
+      path_.c_str(), strerror(errno), errno);
+  chmod(path_.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  CHECK(listen(socket_fd_, 4) == 0, "Failed to listen on datagram socket: "
+      "%s (%d)", strerror(errno), errno);
+
+  radio_interface_.SetDatagramHandler(
+      [this](uint8_t channel, const uint8_t* data, size_t size) {
+        Deliver(channel, data, size);
+      });
+  thread_ = std::thread(&DatagramSocket::ServeThread, this);
+}
+
+DatagramSocket::~DatagramSocket() {
+  radio_interface_.SetDatagramHandler(nullptr);
+  running_ = false;
+  thread_.join();
+  for (const auto& client : clients_) {
+    close(client.fd);
+  }
+
+  close(socket_fd_);
+  unlink(path_.c_str());
+}
+
+void DatagramSocket::ServeThread() {
+  std::vector<struct pollfd> fds;
+  while (running_) {
+    fds.clear();
+    fds.push_back({socket_fd_, POLLIN, 0});
+    {
+      std::lock_guard<std::mutex> lock(clients_mutex_);
+      for (const auto& client : clients_) {
+        fds.push_back({client.fd, POLLIN, 0});
+      }
+    }
+
+    int result = poll(fds.data(), fds.size(), kPollTimeoutMs);
+    if (result < 0 && errno != EINTR) {
+      LOGE("Failed to poll datagram socket: %s (%d)", strerror(errno), errno);
+      return;
+    } else if (result <= 0) {
+      continue;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      int client_fd = accept(socket_fd_, nullptr, nullptr);
+      if (client_fd < 0) {
+        LOGE("Failed to accept datagram client: %s (%d)",
+            strerror(errno), errno);
+      } else {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        clients_.push_back({client_fd, 0});
+      }
+    }
+
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (fds[i].revents != 0 && !ReadClient(fds[i].fd)) {
+        RemoveClient(fds[i].fd);
+      }
+    }
+  }
+}
+
+bool DatagramSocket::ReadClient(int client_fd) {
+  // One extra byte is read to detect messages that are too large.
+  uint8_t message[RadioInterface::kMaxDatagramSize + 2];
+  ssize_t size = recv(client_fd, message, sizeof(message), MSG_DONTWAIT);
+  if (size < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return true;
+  } else if (size <= 0) {
+    return false;
+  }
+
+  uint8_t channel = message[0];
+  if (channel > RadioInterface::kMaxDatagramChannel) {
+    LOGW("Ignoring datagram for invalid channel %u", channel);
+    return true;
+  } else if (static_cast<size_t>(size) > sizeof(message) - 1) {
+    LOGW("Ignoring datagram larger than %zu bytes",
+        RadioInterface::kMaxDatagramSize);
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    for (auto& client : clients_) {
+      if (client.fd == client_fd) {
+        client.channels |= (1 << channel);
+      }
+    }
+  }
+
+  if (size > 1
+      && !radio_interface_.SendDatagram(channel, &message[1], size - 1)) {
+    LOGW("Link queue is full, dropping datagram for channel %u", channel);
+  }
+
+  return true;
+}
+
+void DatagramSocket::RemoveClient(int client_fd) {
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  clients_.erase(std::remove_if(clients_.begin(), clients_.end(),
+      [client_fd](const Client& client) { return client.fd == client_fd; }),
+      clients_.end());
+  close(client_fd);
+}
+
+void DatagramSocket::Deliver(uint8_t channel, const uint8_t* data,
+                             size_t size) {
+  struct iovec iov[2];
+  iov[0].iov_base = &channel;
+  iov[0].iov_len = sizeof(channel);
+  iov[1].iov_base = const_cast<uint8_t*>(data);
+  iov[1].iov_len = size;
+  struct msghdr msg = {};
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  // Clients that are not keeping up miss datagrams rather than stalling the
+  // link.
+  std::lock_guard<std::mutex> lock(clients_mutex_);
+  for (const auto& client : clients_) {
+    if ((client.channels & (1 << channel)) != 0
+        && sendmsg(client.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+      LOGW("Failed to deliver datagram on channel %u: %s (%d)",
+          channel, strerror(errno), errno);
+    }
+  }
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_DATAGRAM_SOCKET_H_
+#define NERFNET_NET_DATAGRAM_SOCKET_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nerfnet/net/radio_interface.h"
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// A local socket for exchanging small datagrams with the peer directly over
+// the radio link, without the IP and UDP headers and the round trip through
+// the tunnel interface. Clients connect to a unix seqpacket socket and each
+// message is a channel ID from 0 to 15 followed by the payload.
+//
+// Messages sent by a client are queued for the peer. Datagrams received from
+// the peer are delivered to every client that has sent on their channel. A
+// message of only a channel ID subscribes to the channel without sending.
+class DatagramSocket : public NonCopyable {
+ public:
+  // Listens for connections at the supplied path, replacing any existing
+  // socket file, and receives datagrams from the supplied interface.
+  DatagramSocket(const std::string& path, RadioInterface& radio_interface);
+  ~DatagramSocket();
+
+ private:
+  // The time to wait for activity before checking whether to stop.
+  static constexpr int kPollTimeoutMs = 100;
+
+  // A connected client and the channels it is subscribed to.
+  struct Client {
+    int fd;
+    uint16_t channels;
+  };
+
+  // The path of the socket file.
+  const std::string path_;
+
+  // The interface to exchange datagrams over.
+  RadioInterface& radio_interface_;
+
+  // The listening socket.
+  int socket_fd_;
+
+  // The connected clients, which are delivered to from the tunnel writer
+  // thread of the interface.
+  std::mutex clients_mutex_;
+  std::vector<Client> clients_;
+
+  // The thread that serves clients.
+  std::atomic<bool> running_;
+  std::thread thread_;
+
+  // Accepts clients and reads their messages.
+  void ServeThread();
+
+  // Reads a message from a client and queues it for the peer. Returns false
+  // once the client has disconnected.
+  bool ReadClient(int client_fd);
+
+  // Closes a client and forgets its subscriptions.
+  void RemoveClient(int client_fd);
+
+  // Delivers a datagram from the peer to the subscribed clients.
+  void Deliver(uint8_t channel, const uint8_t* data, size_t size);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_DATAGRAM_SOCKET_H_
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/delivery_classifier.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#include "nerfnet/net/ip_packet.h"
+
+namespace nerfnet {
+namespace {
+
+// The largest deadline that can be configured.
+constexpr uint64_t kMaxDeadlineMs = 60000;
+
+// The largest datagram channel, which is carried in the lower nibble of the
+// first byte of the frame.
+constexpr uint64_t kMaxChannel = 0x0f;
+
+// Parses a decimal value between one and the supplied maximum.
+bool ParseValue(const std::string& str, uint64_t max, uint64_t& value) {
+  if (str.empty() || str[0] == '-') {
+    return false;
+  }
+
+  char* end = nullptr;
+  errno = 0;
+  unsigned long long result = strtoull(str.c_str(), &end, 10);
+  if (errno != 0 || *end != '\0' || result > max) {
+    return false;
+  }
+
+  value = result;
+  return true;
+}
+
+}  // anonymous namespace
+
+bool DeliveryClassifier::AddRule(const std::string& rule) {
+  size_t equals = rule.find('=');
+  if (equals == std::string::npos) {
+    return false;
+  }
+
+  Rule parsed;
+  uint64_t deadline_ms;
+  if (!ParseMatch(rule.substr(0, equals), parsed)
+      || parsed.field == Field::Channel
+      || !ParseValue(rule.substr(equals + 1), kMaxDeadlineMs, deadline_ms)
+      || deadline_ms == 0) {
+    return false;
+  }
+
+  parsed.deadline_us = deadline_ms * 1000;
+  rules_.push_back(parsed);
+  return true;
+}
+
+bool DeliveryClassifier::AddSpoolRule(const std::string& rule) {
+  Rule parsed;
+  if (!ParseMatch(rule, parsed)) {
+    return false;
+  }
+
+  parsed.deadline_us = 0;
+  spool_rules_.push_back(parsed);
+  return true;
+}
+
+uint64_t DeliveryClassifier::GetDeadlineUs(
+    const std::vector<uint8_t>& frame) const {
+  const Rule* rule = FindRule(rules_, frame);
+  return (rule != nullptr) ? rule->deadline_us : 0;
+}
+
+bool DeliveryClassifier::IsSpooled(const std::vector<uint8_t>& frame) const {
+  return FindRule(spool_rules_, frame) != nullptr;
+}
+
+bool DeliveryClassifier::ParseMatch(const std::string& match, Rule& rule) {
+  size_t colon = match.find(':');
+  if (colon == std::string::npos) {
+    return false;
+  }
+
+  std::string field = match.substr(0, colon);
+  uint64_t max_value;
+  if (field == "port") {
+    rule.field = Field::Port;
+    max_value = UINT16_MAX;
+  } else if (field == "dscp") {
+    rule.field = Field::Dscp;
+    max_value = 63;
+  } else if (field == "channel") {
+    rule.field = Field::Channel;
+    max_value = kMaxChannel;
+  } else {
+    return false;
+  }
+
+  uint64_t value;
+  if (!ParseValue(match.substr(colon + 1), max_value, value)) {
+    return false;
+  }
+
+  rule.value = static_cast<uint16_t>(value);
+  return true;
+}
+
+const DeliveryClassifier::Rule* DeliveryClassifier::FindRule(
+    const std::vector<Rule>& rules, const std::vector<uint8_t>& frame) {
+  if (rules.empty() || frame.empty()) {
+    return nullptr;
+  }
+
+  // Datagrams start with their channel, which takes the place of the IP
+  // version.
+  if ((frame[0] >> 4) == 0) {
+    for (const auto& rule : rules) {
+      if (rule.field == Field::Channel && frame[0] == rule.value) {
+        return &rule;
+      }
+    }
+
+    return nullptr;
+  }
+
+  IPPacketInfo info;
+  if (!ParseIPPacket(frame, info)) {
+    return nullptr;
+  }
+
+  bool has_ports = (info.protocol == kIPProtocolUdp
+          || info.protocol == kIPProtocolTcp)
+      && info.packet_size - info.transport_offset >= 4;
+  const uint8_t* ports = frame.data() + info.transport_offset;
+  for (const auto& rule : rules) {
+    if (rule.field == Field::Dscp && info.dscp == rule.value) {
+      return &rule;
+    } else if (rule.field == Field::Port && has_ports
+        && (((ports[0] << 8) | ports[1]) == rule.value
+            || ((ports[2] << 8) | ports[3]) == rule.value)) {
+      return &rule;
+    }
+  }
+
+  return nullptr;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_DELIVERY_CLASSIFIER_H_
+#define NERFNET_NET_DELIVERY_CLASSIFIER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nerfnet {
+
+// Selects the delivery class of frames read from the tunnel by their port
+// or DSCP. Frames that match a rule are delivered best-effort: they are
+// dropped if they have not started crossing the link by the deadline of the
+// rule. This suits real-time traffic, where a late frame is useless and
+// delays everything queued behind it. Frames that match a spool rule are
+// delay tolerant, and are stored until the link is otherwise idle. Frames
+// that match no rule are delivered reliably.
+class DeliveryClassifier {
+ public:
+  // Adds a rule of the form port:<number>=<deadline ms>, which matches the
+  // source or destination port of UDP and TCP packets, or
+  // dscp:<value>=<deadline ms>. Returns false if the rule is malformed.
+  bool AddRule(const std::string& rule);
+
+  // Adds a spool rule of the form port:<number>, dscp:<value> or
+  // channel:<number>, which matches datagrams sent on a channel. Returns
+  // false if the rule is malformed.
+  bool AddSpoolRule(const std::string& rule);
+
+  // Returns true if no rules have been added.
+  bool IsEmpty() const { return rules_.empty() && spool_rules_.empty(); }
+
+  // Returns the deadline of the first rule matching the supplied frame, or
+  // zero if the frame is to be delivered reliably.
+  uint64_t GetDeadlineUs(const std::vector<uint8_t>& frame) const;
+
+  // Returns true if the supplied frame matches a spool rule.
+  bool IsSpooled(const std::vector<uint8_t>& frame) const;
+
+ private:
+  // The field that a rule matches on.
+  enum class Field {
+    Port,
+    Dscp,
+    Channel,
+  };
+
+  // A rule and the deadline of the frames it matches.
+  struct Rule {
+    Field field;
+    uint16_t value;
+    uint64_t deadline_us;
+  };
+
+  // The rules in the order they were added and the spool rules.
+  std::vector<Rule> rules_;
+  std::vector<Rule> spool_rules_;
+
+  // Parses the <field>:<value> part of a rule. Returns false if it is
+  // malformed.
+  static bool ParseMatch(const std::string& match, Rule& rule);
+
+  // Returns the first of the supplied rules that matches a frame, or null if
+  // there is none.
+  static const Rule* FindRule(const std::vector<Rule>& rules,
+                              const std::vector<uint8_t>& frame);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_DELIVERY_CLASSIFIER_H_
@@ -0,0 +1,418 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/duplex_radio_interface.h"
+
+#include <algorithm>
+#include <sys/random.h>
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+
+DuplexRadioInterface::DuplexRadioInterface(
+    Radio& tx_radio, Radio& rx_radio, Tunnel& tunnel,
+    uint32_t primary_addr, uint32_t secondary_addr,
+    uint8_t primary_channel, uint8_t secondary_channel,
+    bool is_primary, uint64_t idle_interval_us)
+    : RadioInterface(tx_radio, tunnel, primary_addr, secondary_addr,
+                     is_primary ? primary_channel : secondary_channel,
+                     is_primary),
+      rx_radio_(rx_radio),
+      tx_cursor_frame_(0),
+      tx_cursor_offset_(0),
+      tx_window_sent_(0),
+      last_ack_progress_us_(0),
+      ack_pending_(false),
+      decode_failures_(0),
+      session_established_(false),
+      next_control_us_(0),
+      tx_backoff_us_(0) {
+  CHECK(primary_channel != secondary_channel,
+      "Duplex mode requires a separate channel for each direction");
+  poll_interval_us_ = idle_interval_us;
+  ConfigureRadio(rx_radio_, is_primary ? secondary_channel : primary_channel);
+
+  uint8_t writing_addr[5];
+  GetAddressBytes(is_primary ? primary_addr : secondary_addr, writing_addr);
+  uint8_t reading_addr[5];
+  GetAddressBytes(is_primary ? secondary_addr : primary_addr, reading_addr);
+
+  radio_.OpenWritingPipe(writing_addr);
+  radio_.StopListening();
+  rx_radio_.OpenReadingPipe(kPipeId, reading_addr);
+  rx_radio_.StartListening();
+}
+
+DuplexRadioInterface::DuplexRadioInterface(
+    Radio& radio, Tunnel& tunnel,
+    uint32_t primary_addr, uint32_t secondary_addr, uint8_t channel,
+    bool is_primary, uint64_t idle_interval_us)
+    : RadioInterface(radio, tunnel, primary_addr, secondary_addr, channel,
+                     is_primary),
+      rx_radio_(radio),
+      tx_cursor_frame_(0),
+      tx_cursor_offset_(0),
+      tx_window_sent_(0),
+      last_ack_progress_us_(0),
+      ack_pending_(false),
+      decode_failures_(0),
+      session_established_(false),
+      next_control_us_(0),
+      tx_backoff_us_(0) {
+  poll_interval_us_ = idle_interval_us;
+
+  uint8_t writing_addr[5];
+  GetAddressBytes(is_primary ? primary_addr : secondary_addr, writing_addr);
+  uint8_t reading_addr[5];
+  GetAddressBytes(is_primary ? secondary_addr : primary_addr, reading_addr);
+
+  radio_.OpenWritingPipe(writing_addr);
+  radio_.OpenReadingPipe(kPipeId, reading_addr);
+  radio_.StartListening();
+}
+
+void DuplexRadioInterface::Run() {
+  std::vector<uint8_t> packet(kMaxPacketSize);
+  while (running_) {
+    ApplyPendingSettings();
+    bool active = false;
+    {
+      std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+      while (rx_radio_.Available()) {
+        packet.resize(kMaxPacketSize);
+        packet.resize(rx_radio_.Read(packet.data(), packet.size()));
+        if (capture_tap_ != nullptr) {
+          capture_tap_->RecordPacketReceived(packet);
+        }
+
+        HandlePacket(packet);
+        active = true;
+      }
+
+      if (TransmitNext()) {
+        active = true;
+      }
+    }
+
+    NotifyTunnelWriter();
+    if (tx_backoff_us_ != 0) {
+      SleepUs(tx_backoff_us_);
+    } else if (!active) {
+      SleepUs(poll_interval_us_);
+    }
+  }
+}
+
+bool DuplexRadioInterface::Transmit(const std::vector<uint8_t>& packet) {
+  bool success = radio_.Write(packet.data(), packet.size());
+  if (capture_tap_ != nullptr) {
+    capture_tap_->RecordPacketSent(packet, success);
+  }
+
+  if (!success) {
+    tx_backoff_us_ = std::min(std::max(tx_backoff_us_ * 2, kMinBackoffUs),
+        max_backoff_us_.load());
+    return false;
+  }
+
+  tx_backoff_us_ = 0;
+  return true;
+}
+
+bool DuplexRadioInterface::ClearToTransmit() {
+  return true;
+}
+
+bool DuplexRadioInterface::TransmitNext() {
+  uint64_t now_us = TimeNowUs();
+  if (!session_established_) {
+    if (is_primary_ && now_us >= next_control_us_) {
+      if (reset_request_.empty()) {
+        StartReset();
+      }
+
+      next_control_us_ = now_us + kControlIntervalUs;
+      return ClearToTransmit() && Transmit(reset_request_);
+    }
+
+    return false;
+  }
+
+  // Rewind the window if the peer has stopped acknowledging.
+  if (tx_window_sent_ > 0
+      && now_us - last_ack_progress_us_ > kRetransmitTimeoutUs) {
+    LOGE("Acknowledgement timeout, retransmitting %zu chunks",
+        tx_window_sent_);
+    tx_window_sent_ = 0;
+  }
+
+  if (tx_window_sent_ < tx_window_.size()
+      || (tx_window_.size() < kWindowSize && AddChunkToWindow())) {
+    if (tx_window_sent_ == 0) {
+      last_ack_progress_us_ = now_us;
+    }
+
+    if (!TransmitChunk(tx_window_[tx_window_sent_])) {
+      return false;
+    }
+
+    tx_window_sent_++;
+    return true;
+  }
+
+  if (ack_pending_ && last_ack_id_.has_value() && ClearToTransmit()) {
+    TunnelTxRxPacket tunnel;
+    tunnel.ack_id = last_ack_id_.value();
+    std::vector<uint8_t> packet;
+    CHECK(EncodeTunnelTxRxPacket(tunnel, packet),
+        "Failed to encode tunnel packet");
+    if (Transmit(packet)) {
+      ack_pending_ = false;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool DuplexRadioInterface::AddChunkToWindow() {
+  if (tx_cursor_frame_ == tx_frames_.size()) {
+    PromoteBestEffortFrame();
+    if (read_buffer_.empty()) {
+      return false;
+    }
+
+    tx_frames_.push_back(std::move(read_buffer_.front()));
+    read_buffer_.pop_front();
+  }
+
+  const auto& frame = tx_frames_[tx_cursor_frame_];
+  size_t bytes_left = frame.size() - tx_cursor_offset_;
+  size_t transfer_size = std::min(bytes_left, max_payload_size_);
+
+  Chunk chunk;
+  chunk.id = next_id_;
+  chunk.bytes_left = std::min(bytes_left,
+      static_cast<size_t>(kMaxBytesLeft));
+  chunk.payload.assign(frame.begin() + tx_cursor_offset_,
+      frame.begin() + tx_cursor_offset_ + transfer_size);
+  chunk.last = (transfer_size == bytes_left);
+  tx_window_.push_back(std::move(chunk));
+  AdvanceID();
+
+  tx_cursor_offset_ += transfer_size;
+  if (tx_cursor_offset_ == frame.size()) {
+    tx_cursor_frame_++;
+    tx_cursor_offset_ = 0;
+  }
+
+  return true;
+}
+
+bool DuplexRadioInterface::TransmitChunk(const Chunk& chunk) {
+  if (!ClearToTransmit()) {
+    return false;
+  }
+
+  TunnelTxRxPacket tunnel;
+  tunnel.id = chunk.id;
+  if (last_ack_id_.has_value()) {
+    tunnel.ack_id = last_ack_id_.value();
+  }
+
+  tunnel.bytes_left = chunk.bytes_left;
+  tunnel.payload = chunk.payload;
+
+  std::vector<uint8_t> packet;
+  CHECK(EncodeTunnelTxRxPacket(tunnel, packet),
+      "Failed to encode tunnel packet");
+  if (!Transmit(packet)) {
+    return false;
+  }
+
+  ack_pending_ = false;
+  return true;
+}
+
+void DuplexRadioInterface::HandlePacket(const std::vector<uint8_t>& packet) {
+  if (packet.size() < kHeaderSize) {
+    return;
+  }
+
+  if (packet[0] == 0x00) {
+    HandleControlPacket(packet);
+    return;
+  }
+
+  if (!session_established_) {
+    uint64_t now_us = TimeNowUs();
+    if (!is_primary_ && now_us >= next_control_us_) {
+      LOGW("Received chunk without a session, rejecting");
+      next_control_us_ = now_us + kControlIntervalUs;
+      if (ClearToTransmit()) {
+        Transmit(BuildControlPacket(ControlType::ResumeReject));
+      }
+    }
+
+    return;
+  }
+
+  TunnelTxRxPacket tunnel;
+  if (!DecodeTunnelTxRxPacket(packet, tunnel)) {
+    if (++decode_failures_ >= kMaxDecodeFailures) {
+      DropSession();
+    }
+
+    return;
+  }
+
+  decode_failures_ = 0;
+
+  if (tunnel.ack_id.has_value()) {
+    HandleAck(tunnel.ack_id.value());
+  }
+
+  if (!tunnel.id.has_value()) {
+    return;
+  }
+
+  // Chunks are only accepted in order and while the tunnel writer keeps up.
+  // Anything else is discarded and the last in-order chunk is acknowledged
+  // again.
+  ack_pending_ = true;
+  uint8_t expected_id = last_ack_id_.has_value()
+      ? NextID(last_ack_id_.value()) : 1;
+  if (tunnel.id.value() != expected_id || !CanReceivePayload(tunnel)) {
+    return;
+  }
+
+  last_ack_id_ = tunnel.id.value();
+  if (!tunnel.payload.empty()) {
+    ReceivePayload(tunnel);
+  }
+}
+
+void DuplexRadioInterface::HandleControlPacket(
+    const std::vector<uint8_t>& packet) {
+  auto type = static_cast<ControlType>(packet[kControlTypeOffset]);
+  if (is_primary_) {
+    if (type == ControlType::Reset && !session_established_
+        && !reset_request_.empty()) {
+      auto primary_salt = LinkCipher::GetSalt(reset_request_);
+      if (!OpenControlPacket(packet, primary_salt)) {
+        LOGE("Invalid tunnel reset response");
+        return;
+      }
+
+      if (cipher_ != nullptr) {
+        cipher_->StartSession(primary_salt, LinkCipher::GetSalt(packet));
+      }
+
+      LOGI("Connection reset successfully");
+      session_established_ = true;
+      reset_request_.clear();
+    } else if (type == ControlType::ResumeReject && session_established_
+        && OpenControlPacket(packet)) {
+      LOGW("Secondary rejected the session, resetting connection");
+      session_established_ = false;
+      next_control_us_ = 0;
+    }
+  } else if (type == ControlType::Reset) {
+    // Retries of a request that was already handled receive the same
+    // response so that the session is not reset again.
+    if (packet != reset_request_) {
+      if (!OpenControlPacket(packet)) {
+        LOGE("Failed to authenticate tunnel reset request");
+        return;
+      }
+
+      LOGI("Responding to tunnel reset request");
+      ResetSession(GetSessionToken(packet));
+      ResetStreams();
+      auto primary_salt = LinkCipher::GetSalt(packet);
+      reset_request_ = packet;
+      reset_response_ = BuildControlPacket(ControlType::Reset, primary_salt);
+      if (cipher_ != nullptr) {
+        cipher_->StartSession(primary_salt,
+            LinkCipher::GetSalt(reset_response_));
+      }
+
+      session_established_ = true;
+    }
+
+    if (ClearToTransmit()) {
+      Transmit(reset_response_);
+    }
+  }
+}
+
+void DuplexRadioInterface::HandleAck(uint8_t ack_id) {
+  for (size_t i = 0; i < tx_window_sent_; i++) {
+    if (tx_window_[i].id != ack_id) {
+      continue;
+    }
+
+    for (size_t j = 0; j <= i; j++) {
+      if (tx_window_.front().last) {
+        if (capture_tap_ != nullptr) {
+          capture_tap_->RecordFrameSent(tx_frames_.front());
+        }
+
+        tx_frames_.pop_front();
+        tx_cursor_frame_--;
+      }
+
+      tx_window_.pop_front();
+    }
+
+    tx_window_sent_ -= i + 1;
+    last_ack_progress_us_ = TimeNowUs();
+    return;
+  }
+}
+
+void DuplexRadioInterface::StartReset() {
+  uint32_t session_token = 0;
+  while (session_token == 0) {
+    CHECK(getrandom(&session_token, sizeof(session_token), 0)
+        == sizeof(session_token), "Failed to generate session token");
+  }
+
+  LOGI("Resetting connection");
+  ResetSession(session_token);
+  ResetStreams();
+  reset_request_ = BuildControlPacket(ControlType::Reset);
+}
+
+void DuplexRadioInterface::DropSession() {
+  LOGW("Packets from the peer no longer decode, dropping the session");
+  session_established_ = false;
+  next_control_us_ = 0;
+  decode_failures_ = 0;
+}
+
+void DuplexRadioInterface::ResetStreams() {
+  tx_window_.clear();
+  tx_window_sent_ = 0;
+  tx_cursor_frame_ = 0;
+  tx_cursor_offset_ = 0;
+  ack_pending_ = false;
+  decode_failures_ = 0;
+}
+
+}  // namespace nerfnet
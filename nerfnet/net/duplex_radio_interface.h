@@ -0,0 +1,166 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_DUPLEX_RADIO_INTERFACE_H_
+#define NERFNET_NET_DUPLEX_RADIO_INTERFACE_H_
+
+#include <deque>
+
+#include "nerfnet/net/radio_interface.h"
+
+namespace nerfnet {
+
+// A full-duplex radio interface that uses two radios on each side of the
+// link: one that only transmits and one that only receives, on separate
+// channels. Each direction streams chunks continuously using a go-back-N
+// sliding window, with acknowledgements carried by the stream in the opposite
+// direction. Neither radio switches between transmit and receive modes.
+//
+// The primary establishes the session using the same reset handshake as the
+// polled interfaces. The secondary responds to chunks received without a
+// session with a reject, which prompts the primary to reset. Either side
+// drops the session when packets from the peer keep failing to decode, which
+// happens when more encrypted packets were lost than the receive window of
+// the cipher covers, and the session is then reset.
+class DuplexRadioInterface : public RadioInterface {
+ public:
+  // Setup the duplex radio link. The primary transmits on the primary channel
+  // and the secondary transmits on the secondary channel.
+  DuplexRadioInterface(Radio& tx_radio, Radio& rx_radio, Tunnel& tunnel,
+                       uint32_t primary_addr, uint32_t secondary_addr,
+                       uint8_t primary_channel, uint8_t secondary_channel,
+                       bool is_primary, uint64_t idle_interval_us);
+
+  // Runs the interface.
+  void Run() override;
+
+ protected:
+  // Setup the link on a single radio that switches between transmitting and
+  // receiving on one channel.
+  DuplexRadioInterface(Radio& radio, Tunnel& tunnel,
+                       uint32_t primary_addr, uint32_t secondary_addr,
+                       uint8_t channel, bool is_primary,
+                       uint64_t idle_interval_us);
+
+  // The maximum number of unacknowledged chunks in flight. This must be less
+  // than half of the ID space to keep acknowledgements unambiguous.
+  static constexpr size_t kWindowSize = 7;
+
+  // The time without acknowledgement progress after which the window is
+  // retransmitted.
+  static constexpr uint64_t kRetransmitTimeoutUs = 10000;
+
+  // The interval between reset requests and rejects.
+  static constexpr uint64_t kControlIntervalUs = 10000;
+
+  // The lower bound of the backoff applied when the radio fails to transmit.
+  static constexpr uint64_t kMinBackoffUs = 1000;
+
+  // The number of consecutive packets from the peer that fail to decode
+  // after which the session is dropped.
+  static constexpr size_t kMaxDecodeFailures = 8;
+
+  // A chunk of a frame in the transmit window.
+  struct Chunk {
+    uint8_t id;
+    uint8_t bytes_left;
+    std::vector<uint8_t> payload;
+
+    // Set for the final chunk of a frame.
+    bool last;
+  };
+
+  // The radio used for receiving. The radio in the base class only
+  // transmits.
+  Radio& rx_radio_;
+
+  // Frames that are being chunked or have chunks in flight. Frames are moved
+  // here from the read buffer so that they are kept until acknowledged.
+  std::deque<std::vector<uint8_t>> tx_frames_;
+
+  // The frame and offset of the next chunk to add to the window.
+  size_t tx_cursor_frame_;
+  size_t tx_cursor_offset_;
+
+  // The chunks in flight and the number of them that have been sent since
+  // the window was last rewound.
+  std::deque<Chunk> tx_window_;
+  size_t tx_window_sent_;
+
+  // The time that the acknowledged position last moved.
+  uint64_t last_ack_progress_us_;
+
+  // Set when a chunk has been received that has not been acknowledged.
+  bool ack_pending_;
+
+  // The number of consecutive packets from the peer that failed to decode.
+  size_t decode_failures_;
+
+  // Whether a session has been established with the peer.
+  bool session_established_;
+
+  // The outstanding reset request on the primary, or the last handled reset
+  // request on the secondary along with the response sent for it.
+  std::vector<uint8_t> reset_request_;
+  std::vector<uint8_t> reset_response_;
+
+  // The earliest time to send the next reset request or reject.
+  uint64_t next_control_us_;
+
+  // The current transmit failure backoff.
+  uint64_t tx_backoff_us_;
+
+  // Sends a packet on the transmit radio.
+  virtual bool Transmit(const std::vector<uint8_t>& packet);
+
+  // Returns true if a packet may be transmitted now. This is checked before
+  // a tunnel packet is sealed, as sealing consumes a nonce counter even if
+  // the packet is never sent.
+  virtual bool ClearToTransmit();
+
+  // Sends the next packet that is due. Returns true if a packet was sent.
+  bool TransmitNext();
+
+  // Adds the next chunk of the queued frames to the window. Returns false if
+  // there is no data to send.
+  bool AddChunkToWindow();
+
+  // Sends a chunk from the window along with the current acknowledgement.
+  bool TransmitChunk(const Chunk& chunk);
+
+  // Handles a packet received from the peer.
+  void HandlePacket(const std::vector<uint8_t>& packet);
+  void HandleControlPacket(const std::vector<uint8_t>& packet);
+
+  // Removes chunks up to and including the acknowledged ID from the window.
+  void HandleAck(uint8_t ack_id);
+
+  // Starts a new session from the primary.
+  void StartReset();
+
+  // Drops a session that packets from the peer no longer decode in. The
+  // primary resets the connection and the secondary rejects the chunks it
+  // receives until the primary does.
+  void DropSession();
+
+  // Clears the state of both streams for a new session. Frames with chunks
+  // in flight are restarted from the beginning.
+  void ResetStreams();
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_DUPLEX_RADIO_INTERFACE_H_
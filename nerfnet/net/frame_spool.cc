@@ -0,0 +1,221 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/frame_spool.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nerfnet/util/crc32.h"
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+namespace {
+
+// Returns the size of a record in the ring including its header.
+size_t GetRecordSize(size_t header_size, size_t data_size) {
+  return (header_size + data_size + header_size - 1)
+      / header_size * header_size;
+}
+
+}  // anonymous namespace
+
+FrameSpool::FrameSpool(const std::string& path, size_t ring_size)
+    : fd_(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600)),
+      file_size_(0),
+      header_(nullptr),
+      ring_(nullptr),
+      ring_size_(GetRecordSize(sizeof(RecordHeader), ring_size)) {
+  CHECK(ring_size_ >= GetRecordSize(sizeof(RecordHeader), kMaxFrameSize),
+      "Spool ring of %zu bytes can not hold a %zu byte frame", ring_size_,
+      kMaxFrameSize);
+  CHECK(fd_ >= 0, "Failed to open spool '%s': %s (%d)", path.c_str(),
+      strerror(errno), errno);
+  struct stat file_stat;
+  CHECK(fstat(fd_, &file_stat) == 0, "Failed to stat spool '%s': %s (%d)",
+      path.c_str(), strerror(errno), errno);
+
+  // The file is allocated up front so that writing to the mapping can not
+  // fail for lack of disk space.
+  file_size_ = sizeof(FileHeader) + ring_size_;
+  if (static_cast<size_t>(file_stat.st_size) != file_size_) {
+    CHECK(ftruncate(fd_, file_size_) == 0,
+        "Failed to resize spool '%s': %s (%d)", path.c_str(),
+        strerror(errno), errno);
+  }
+
+  int status = posix_fallocate(fd_, 0, file_size_);
+  CHECK(status == 0, "Failed to allocate spool '%s': %s (%d)", path.c_str(),
+      strerror(status), status);
+
+  void* mapping = mmap(nullptr, file_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd_, 0);
+  CHECK(mapping != MAP_FAILED, "Failed to map spool '%s': %s (%d)",
+      path.c_str(), strerror(errno), errno);
+  header_ = static_cast<FileHeader*>(mapping);
+  ring_ = static_cast<uint8_t*>(mapping) + sizeof(FileHeader);
+
+  if (!IsHeaderValid()) {
+    if (file_stat.st_size != 0) {
+      LOGW("Discarding spool '%s' of another size or format", path.c_str());
+    }
+
+    ResetRing();
+  } else if (header_->frame_count > 0) {
+    LOGI("Spool '%s' holds %llu frames from a previous run", path.c_str(),
+        static_cast<unsigned long long>(header_->frame_count));
+  }
+}
+
+FrameSpool::~FrameSpool() {
+  msync(header_, file_size_, MS_SYNC);
+  munmap(header_, file_size_);
+  close(fd_);
+}
+
+bool FrameSpool::Push(const std::vector<uint8_t>& frame) {
+  size_t record_size = GetRecordSize(sizeof(RecordHeader), frame.size());
+  if (frame.empty() || record_size > ring_size_) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t head = header_->head;
+  size_t offset = head % ring_size_;
+  size_t padding_size = 0;
+  if (ring_size_ - offset < record_size) {
+    padding_size = ring_size_ - offset;
+  }
+
+  if (ring_size_ - (head - header_->tail) < padding_size + record_size) {
+    return false;
+  }
+
+  if (padding_size != 0) {
+    WriteRecord(offset, static_cast<uint32_t>(
+        padding_size - sizeof(RecordHeader)) | kPaddingFlag, nullptr);
+    head += padding_size;
+    offset = 0;
+  }
+
+  WriteRecord(offset, static_cast<uint32_t>(frame.size()), frame.data());
+
+  // The head is moved once the record is complete, so that a partial record
+  // is never read back after a restart.
+  header_->head = head + record_size;
+  header_->frame_count++;
+  return true;
+}
+
+bool FrameSpool::Peek(std::vector<uint8_t>& frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  RecordHeader record;
+  if (!ReadTail(record)) {
+    return false;
+  }
+
+  const uint8_t* data = &ring_[header_->tail % ring_size_ + sizeof(record)];
+  frame.assign(data, data + record.size);
+  return true;
+}
+
+void FrameSpool::Pop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  RecordHeader record;
+  if (ReadTail(record)) {
+    header_->tail += GetRecordSize(sizeof(record), record.size);
+    header_->frame_count--;
+  }
+}
+
+uint64_t FrameSpool::GetFrameCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return header_->frame_count;
+}
+
+void FrameSpool::ResetRing() {
+  header_->magic = kMagic;
+  header_->version = kVersion;
+  header_->ring_size = ring_size_;
+  header_->head = 0;
+  header_->tail = 0;
+  header_->frame_count = 0;
+}
+
+bool FrameSpool::IsHeaderValid() const {
+  return header_->magic == kMagic
+      && header_->version == kVersion
+      && header_->ring_size == ring_size_
+      && header_->tail <= header_->head
+      && header_->head - header_->tail <= ring_size_
+      && header_->tail % sizeof(RecordHeader) == 0
+      && header_->head % sizeof(RecordHeader) == 0;
+}
+
+void FrameSpool::WriteRecord(size_t offset, uint32_t size,
+                             const uint8_t* data) {
+  RecordHeader record;
+  record.size = size;
+  record.checksum = Crc32(reinterpret_cast<const uint8_t*>(&size),
+      sizeof(size));
+  if (data != nullptr) {
+    record.checksum = Crc32(data, size, record.checksum);
+    memcpy(&ring_[offset + sizeof(record)], data, size);
+  }
+
+  memcpy(&ring_[offset], &record, sizeof(record));
+}
+
+bool FrameSpool::ReadTail(RecordHeader& record) {
+  while (header_->tail != header_->head) {
+    size_t offset = header_->tail % ring_size_;
+    memcpy(&record, &ring_[offset], sizeof(record));
+    bool padding = (record.size & kPaddingFlag) != 0;
+    uint32_t size = record.size & ~kPaddingFlag;
+    size_t record_size = GetRecordSize(sizeof(record), size);
+    bool valid = record_size <= ring_size_ - offset
+        && record_size <= header_->head - header_->tail
+        && (padding || header_->frame_count > 0);
+    if (valid) {
+      uint32_t checksum = Crc32(reinterpret_cast<const uint8_t*>(
+          &record.size), sizeof(record.size));
+      if (!padding) {
+        checksum = Crc32(&ring_[offset + sizeof(record)], size, checksum);
+      }
+
+      valid = checksum == record.checksum;
+    }
+
+    if (!valid) {
+      LOGE("Spool is corrupt, discarding %llu frames",
+          static_cast<unsigned long long>(header_->frame_count));
+      ResetRing();
+      return false;
+    } else if (!padding) {
+      return true;
+    }
+
+    header_->tail += record_size;
+  }
+
+  return false;
+}
+
+}  // namespace nerfnet
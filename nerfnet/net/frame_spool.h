@@ -0,0 +1,131 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_FRAME_SPOOL_H_
+#define NERFNET_NET_FRAME_SPOOL_H_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// A bounded queue of frames stored in a memory-mapped file, which holds
+// delay tolerant traffic through long outages of the link. The file is
+// mapped shared, so the frames are paged out by the kernel instead of
+// growing the process, and are kept across restarts.
+//
+// Frames are stored in a ring of records following a header that holds the
+// positions of the oldest and newest records. Frames are only removed once
+// they have been sent, so a frame in flight when the process stops is sent
+// again.
+//
+// Records reach the disk when the kernel writes back the mapping, which is
+// typically within 30 seconds, and when the spool is closed. Frames spooled
+// shortly before a power loss may be lost. Each record carries a checksum,
+// so a record that only partly reached the disk is detected and the spool
+// is discarded from that record on, rather than sending a corrupt frame.
+class FrameSpool : public NonCopyable {
+ public:
+  // The default size of the ring in bytes.
+  static constexpr size_t kDefaultRingSize = 64 * 1024 * 1024;
+
+  // The largest frame that the ring must be able to hold, the largest IP
+  // packet.
+  static constexpr size_t kMaxFrameSize = UINT16_MAX;
+
+  // Opens the spool file, creating it if needed. Frames left by a previous
+  // run are kept unless the file was created with another size. Quits and
+  // logs the error on failure, or if the ring can not hold a frame of the
+  // maximum size.
+  explicit FrameSpool(const std::string& path,
+                      size_t ring_size = kDefaultRingSize);
+  ~FrameSpool();
+
+  // Appends a frame. Returns false if the spool does not have room for it.
+  bool Push(const std::vector<uint8_t>& frame);
+
+  // Copies the oldest frame without removing it. Returns false if the spool
+  // is empty.
+  bool Peek(std::vector<uint8_t>& frame);
+
+  // Removes the oldest frame.
+  void Pop();
+
+  // Returns the number of frames in the spool.
+  uint64_t GetFrameCount();
+
+ private:
+  // Identifies the file and its layout.
+  static constexpr uint32_t kMagic = 0x4e465350;
+  static constexpr uint32_t kVersion = 2;
+
+  // The header at the start of the file. The positions only increase and are
+  // reduced modulo the size of the ring.
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_size;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t frame_count;
+  };
+
+  // The header of each record, which is followed by the frame. Records are
+  // aligned to the size of the header so that a header always fits before
+  // the end of the ring. Padding fills the end of the ring when a record
+  // does not fit before it wraps, and has the padding flag set in its size.
+  // The checksum is the CRC-32 of the size followed by the frame.
+  struct RecordHeader {
+    uint32_t size;
+    uint32_t checksum;
+  };
+
+  // Set in the size of padding records.
+  static constexpr uint32_t kPaddingFlag = 0x80000000;
+
+  // The file, its mapping and the ring that follows the header.
+  int fd_;
+  size_t file_size_;
+  FileHeader* header_;
+  uint8_t* ring_;
+  const size_t ring_size_;
+
+  // Guards the ring, which is written by the tunnel thread and read by the
+  // radio thread.
+  std::mutex mutex_;
+
+  // Starts an empty ring.
+  void ResetRing();
+
+  // Returns true if the header describes a ring of the expected size.
+  bool IsHeaderValid() const;
+
+  // Writes a record header and the frame, if any, at an offset in the ring.
+  void WriteRecord(size_t offset, uint32_t size, const uint8_t* data);
+
+  // Moves the tail past padding and reads the header of the oldest record.
+  // The ring is reset if the record is corrupt. Returns false if the spool
+  // is empty. The lock must be held.
+  bool ReadTail(RecordHeader& record);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_FRAME_SPOOL_H_
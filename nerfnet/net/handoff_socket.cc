@@ -0,0 +1,242 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/handoff_socket.h"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+namespace {
+
+// Fills in the address of a unix socket. Returns false if the path is too
+// long.
+bool GetSocketAddress(const std::string& path, struct sockaddr_un& addr) {
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  return true;
+}
+
+// Sends all of the supplied bytes. Returns false on failure.
+bool SendAll(int fd, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    } else if (sent <= 0) {
+      return false;
+    }
+
+    data += sent;
+    size -= sent;
+  }
+
+  return true;
+}
+
+// Receives exactly the supplied number of bytes. Returns false on failure.
+bool ReceiveAll(int fd, uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t received = recv(fd, data, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    } else if (received <= 0) {
+      return false;
+    }
+
+    data += received;
+    size -= received;
+  }
+
+  return true;
+}
+
+}  // anonymous namespace
+
+HandoffSocket::HandoffSocket(const std::string& path,
+                             RadioInterface& radio_interface)
+    : path_(path),
+      radio_interface_(radio_interface),
+      socket_fd_(socket(AF_UNIX, SOCK_STREAM, 0)),
+      client_fd_(-1),
+      running_(true) {
+  CHECK(socket_fd_ >= 0, "Failed to open handoff socket: %s (%d)",
+      strerror(errno), errno);
+
+  struct sockaddr_un addr;
+  CHECK(GetSocketAddress(path_, addr), "Handoff socket path is too long");
+  unlink(path_.c_str());
+
+  // The socket file is created without access for other users, rather than
+  // restricted after it is bound, so that no other user can connect first.
+  mode_t previous_umask = umask(S_IRWXG | S_IRWXO);
+  int status = bind(socket_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+      sizeof(addr));
+  int bind_errno = errno;
+  umask(previous_umask);
+  CHECK(status == 0, "Failed to bind handoff socket '%s': %s (%d)",
+      path_.c_str(), strerror(bind_errno), bind_errno);
+  CHECK(listen(socket_fd_, 1) == 0, "Failed to listen on handoff socket: "
+      "%s (%d)", strerror(errno), errno);
+  thread_ = std::thread(&HandoffSocket::ServeThread, this);
+}
+
+HandoffSocket::~HandoffSocket() {
+  running_ = false;
+  shutdown(socket_fd_, SHUT_RDWR);
+  thread_.join();
+  close(socket_fd_);
+  unlink(path_.c_str());
+}
+
+bool HandoffSocket::Complete(int tunnel_fd) {
+  std::vector<uint8_t> state;
+  if (!radio_interface_.SaveState(state)) {
+    LOGE("The interface does not support handoff");
+    return false;
+  } else if (state.size() > kMaxStateSize) {
+    LOGE("Session of %zu bytes is too large to hand over", state.size());
+    return false;
+  }
+
+  // The size of the session is sent with the tunnel file descriptor.
+  uint8_t header[4];
+  for (size_t i = 0; i < sizeof(header); i++) {
+    header[i] = static_cast<uint8_t>(state.size() >> (i * 8));
+  }
+
+  struct iovec iov = {header, sizeof(header)};
+  alignas(struct cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &tunnel_fd, sizeof(int));
+
+  if (sendmsg(client_fd_, &msg, MSG_NOSIGNAL) != sizeof(header)
+      || !SendAll(client_fd_, state.data(), state.size())) {
+    LOGE("Failed to send session to replacement: %s (%d)",
+        strerror(errno), errno);
+    return false;
+  }
+
+  LOGI("Handed over session of %zu bytes", state.size());
+  return true;
+}
+
+bool HandoffSocket::Request(const std::string& path, int& tunnel_fd,
+                            std::vector<uint8_t>& state) {
+  struct sockaddr_un addr;
+  if (!GetSocketAddress(path, addr)) {
+    return false;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK(fd >= 0, "Failed to open handoff socket: %s (%d)",
+      strerror(errno), errno);
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+      sizeof(addr)) != 0) {
+    close(fd);
+    return false;
+  }
+
+  LOGI("Taking over session from the running instance");
+  uint8_t header[4];
+  struct iovec iov = {header, sizeof(header)};
+  alignas(struct cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t received = recvmsg(fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (received != sizeof(header) || cmsg == nullptr
+      || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+      || cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+    LOGE("Failed to receive tunnel from the running instance");
+    close(fd);
+    return false;
+  }
+
+  memcpy(&tunnel_fd, CMSG_DATA(cmsg), sizeof(int));
+  size_t state_size = 0;
+  for (size_t i = 0; i < sizeof(header); i++) {
+    state_size |= static_cast<size_t>(header[i]) << (i * 8);
+  }
+
+  if (state_size > kMaxStateSize) {
+    LOGE("Session of %zu bytes from the running instance is too large",
+        state_size);
+    close(tunnel_fd);
+    close(fd);
+    return false;
+  }
+
+  state.resize(state_size);
+  if (!ReceiveAll(fd, state.data(), state.size())) {
+    LOGE("Failed to receive session from the running instance");
+    close(tunnel_fd);
+    close(fd);
+    return false;
+  }
+
+  // Wait for the connection to close as the running instance exits.
+  uint8_t data;
+  ssize_t result;
+  do {
+    result = recv(fd, &data, sizeof(data), 0);
+  } while (result > 0 || (result < 0 && errno == EINTR));
+
+  close(fd);
+  return true;
+}
+
+void HandoffSocket::ServeThread() {
+  while (running_) {
+    int client_fd = accept(socket_fd_, nullptr, nullptr);
+    if (client_fd < 0) {
+      if (running_) {
+        LOGE("Failed to accept handoff client: %s (%d)",
+            strerror(errno), errno);
+      }
+
+      continue;
+    }
+
+    LOGI("Replacement connected, stopping for handoff");
+    client_fd_ = client_fd;
+    radio_interface_.Stop();
+    return;
+  }
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_HANDOFF_SOCKET_H_
+#define NERFNET_NET_HANDOFF_SOCKET_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nerfnet/net/radio_interface.h"
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// A local socket for handing the session over to a replacement process, so
+// that the daemon can be upgraded or reconfigured without resetting the
+// link. The replacement connects to the socket, which stops the interface.
+// Once Run has returned, the tunnel file descriptor is passed to the
+// replacement along with the saved session, and this process exits.
+class HandoffSocket : public NonCopyable {
+ public:
+  // Listens for a replacement at the supplied path, replacing any existing
+  // socket file. Only the owner of the process may connect.
+  HandoffSocket(const std::string& path, RadioInterface& radio_interface);
+  ~HandoffSocket();
+
+  // Returns true once a replacement has connected.
+  bool IsRequested() const { return client_fd_ >= 0; }
+
+  // Saves the session and sends it to the replacement with the tunnel file
+  // descriptor. Must be called after Run has returned. The connection is
+  // left open until this process exits, which tells the replacement that
+  // the radio and socket paths have been released. Returns false on failure.
+  bool Complete(int tunnel_fd);
+
+  // Connects to the process listening at the supplied path and takes over
+  // its session, receiving the tunnel file descriptor and the saved session.
+  // Waits for the process to exit. Returns false if no process is listening
+  // or the handoff fails.
+  static bool Request(const std::string& path, int& tunnel_fd,
+                      std::vector<uint8_t>& state);
+
+ private:
+  // The largest saved session that is handed over, far larger than a session
+  // with the default frame queue full of tunnel frames.
+  static constexpr size_t kMaxStateSize = 64 * 1024 * 1024;
+
+  // The path of the socket file.
+  const std::string path_;
+
+  // The interface to hand over.
+  RadioInterface& radio_interface_;
+
+  // The listening socket and the connected replacement, or -1.
+  int socket_fd_;
+  std::atomic<int> client_fd_;
+
+  // The thread that waits for a replacement.
+  std::atomic<bool> running_;
+  std::thread thread_;
+
+  // Accepts a replacement and stops the interface.
+  void ServeThread();
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_HANDOFF_SOCKET_H_
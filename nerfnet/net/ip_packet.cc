@@ -0,0 +1,234 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/ip_packet.h"
+
+#include <algorithm>
+
+namespace nerfnet {
+namespace {
+
+// The TCP options.
+constexpr uint8_t kTcpOptionEnd = 0;
+constexpr uint8_t kTcpOptionNop = 1;
+constexpr uint8_t kTcpOptionMss = 2;
+constexpr uint8_t kTcpOptionSack = 5;
+
+// The IP ECN congestion experienced codepoint.
+constexpr uint8_t kECNCongestionExperienced = 0x03;
+
+uint16_t LoadBe16(const uint8_t* bytes) {
+  return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+}
+
+uint32_t LoadBe32(const uint8_t* bytes) {
+  return (static_cast<uint32_t>(bytes[0]) << 24)
+      | (static_cast<uint32_t>(bytes[1]) << 16)
+      | (static_cast<uint32_t>(bytes[2]) << 8)
+      | static_cast<uint32_t>(bytes[3]);
+}
+
+void StoreBe16(uint8_t* bytes, uint16_t value) {
+  bytes[0] = static_cast<uint8_t>(value >> 8);
+  bytes[1] = static_cast<uint8_t>(value);
+}
+
+// Adds bytes to a ones-complement sum as a sequence of big endian words.
+uint32_t ChecksumAdd(uint32_t sum, const uint8_t* data, size_t size) {
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    sum += LoadBe16(&data[i]);
+  }
+
+  if (size % 2 != 0) {
+    sum += static_cast<uint32_t>(data[size - 1]) << 8;
+  }
+
+  return sum;
+}
+
+// Computes the TCP checksum of a segment including the IP pseudo-header.
+uint16_t ComputeTcpChecksum(const std::vector<uint8_t>& frame,
+                            const IPPacketInfo& info) {
+  size_t segment_size = info.packet_size - info.transport_offset;
+  uint32_t sum = 0;
+  if (info.version == 4) {
+    sum = ChecksumAdd(sum, &frame[12], 8);
+  } else {
+    sum = ChecksumAdd(sum, &frame[8], 32);
+  }
+
+  sum += info.protocol;
+  sum += static_cast<uint32_t>(segment_size >> 16);
+  sum += static_cast<uint32_t>(segment_size & 0xffff);
+  sum = ChecksumAdd(sum, &frame[info.transport_offset], segment_size);
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+
+  return static_cast<uint16_t>(~sum);
+}
+
+}  // anonymous namespace
+
+bool ParseIPPacket(const std::vector<uint8_t>& frame, IPPacketInfo& info) {
+  if (frame.empty()) {
+    return false;
+  }
+
+  info.version = frame[0] >> 4;
+  if (info.version == 4) {
+    if (frame.size() < kIPv4HeaderSize) {
+      return false;
+    }
+
+    // Only the first fragment carries the transport header and the checksum
+    // covers all fragments, so fragmented packets are left alone.
+    uint16_t fragment = LoadBe16(&frame[6]);
+    if ((fragment & 0x3fff) != 0) {
+      return false;
+    }
+
+    info.protocol = frame[9];
+    info.dscp = frame[1] >> 2;
+    info.transport_offset = (frame[0] & 0x0f) * 4;
+    info.packet_size = LoadBe16(&frame[2]);
+  } else if (info.version == 6) {
+    if (frame.size() < kIPv6HeaderSize) {
+      return false;
+    }
+
+    info.protocol = frame[6];
+    info.dscp = ((frame[0] & 0x0f) << 2) | (frame[1] >> 6);
+    info.transport_offset = kIPv6HeaderSize;
+    info.packet_size = kIPv6HeaderSize + LoadBe16(&frame[4]);
+  } else {
+    return false;
+  }
+
+  return info.transport_offset >= kIPv4HeaderSize
+      && info.packet_size <= frame.size()
+      && info.transport_offset <= info.packet_size;
+}
+
+bool ParseTcpAck(const std::vector<uint8_t>& frame, TcpAckInfo& info) {
+  IPPacketInfo ip_info;
+  if (!ParseIPPacket(frame, ip_info) || ip_info.protocol != kIPProtocolTcp
+      || ip_info.packet_size - ip_info.transport_offset < kTcpHeaderSize) {
+    return false;
+  }
+
+  const uint8_t* tcp = &frame[ip_info.transport_offset];
+  size_t tcp_header_size = (tcp[12] >> 4) * 4;
+  info.flags = tcp[13];
+  if (tcp_header_size < kTcpHeaderSize
+      || ip_info.transport_offset + tcp_header_size != ip_info.packet_size
+      || (info.flags & kTcpFlagAck) == 0
+      || (info.flags & (kTcpFlagSyn | kTcpFlagFin | kTcpFlagRst
+          | kTcpFlagUrg)) != 0) {
+    return false;
+  }
+
+  info.flow.fill(0);
+  if (ip_info.version == 4) {
+    std::copy(&frame[12], &frame[20], info.flow.begin());
+    info.ecn_ce = (frame[1] & 0x03) == kECNCongestionExperienced;
+  } else {
+    std::copy(&frame[8], &frame[40], info.flow.begin());
+    info.ecn_ce = ((frame[1] >> 4) & 0x03) == kECNCongestionExperienced;
+  }
+
+  std::copy(&tcp[0], &tcp[4], info.flow.end() - 4);
+  info.ack_number = LoadBe32(&tcp[8]);
+
+  info.has_sack = false;
+  size_t offset = kTcpHeaderSize;
+  while (offset < tcp_header_size) {
+    uint8_t kind = tcp[offset];
+    if (kind == kTcpOptionEnd) {
+      break;
+    } else if (kind == kTcpOptionNop) {
+      offset++;
+      continue;
+    } else if (offset + 1 >= tcp_header_size || tcp[offset + 1] < 2) {
+      // Treat malformed options as SACK so the segment is never dropped.
+      info.has_sack = true;
+      break;
+    } else if (kind == kTcpOptionSack) {
+      info.has_sack = true;
+    }
+
+    offset += tcp[offset + 1];
+  }
+
+  return true;
+}
+
+bool ClampTcpMss(std::vector<uint8_t>& frame, uint16_t mtu) {
+  IPPacketInfo info;
+  if (!ParseIPPacket(frame, info) || info.protocol != kIPProtocolTcp
+      || info.packet_size - info.transport_offset < kTcpHeaderSize) {
+    return false;
+  }
+
+  uint8_t* tcp = &frame[info.transport_offset];
+  if ((tcp[13] & kTcpFlagSyn) == 0) {
+    return false;
+  }
+
+  size_t ip_header_size = (info.version == 4)
+      ? kIPv4HeaderSize : kIPv6HeaderSize;
+  if (mtu <= ip_header_size + kTcpHeaderSize) {
+    return false;
+  }
+
+  uint16_t max_mss = mtu - ip_header_size - kTcpHeaderSize;
+  size_t tcp_header_size = (tcp[12] >> 4) * 4;
+  if (tcp_header_size < kTcpHeaderSize
+      || info.transport_offset + tcp_header_size > info.packet_size) {
+    return false;
+  }
+
+  size_t offset = kTcpHeaderSize;
+  while (offset < tcp_header_size) {
+    uint8_t kind = tcp[offset];
+    if (kind == kTcpOptionEnd) {
+      break;
+    } else if (kind == kTcpOptionNop) {
+      offset++;
+      continue;
+    } else if (offset + 1 >= tcp_header_size || tcp[offset + 1] < 2
+        || offset + tcp[offset + 1] > tcp_header_size) {
+      return false;
+    }
+
+    if (kind == kTcpOptionMss && tcp[offset + 1] == 4) {
+      if (LoadBe16(&tcp[offset + 2]) <= max_mss) {
+        return false;
+      }
+
+      StoreBe16(&tcp[offset + 2], max_mss);
+      StoreBe16(&tcp[16], 0);
+      StoreBe16(&tcp[16], ComputeTcpChecksum(frame, info));
+      return true;
+    }
+
+    offset += tcp[offset + 1];
+  }
+
+  return false;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_IP_PACKET_H_
+#define NERFNET_NET_IP_PACKET_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nerfnet {
+
+// The IP protocol numbers for TCP and UDP.
+constexpr uint8_t kIPProtocolTcp = 6;
+constexpr uint8_t kIPProtocolUdp = 17;
+
+// The sizes of IP and TCP headers without options.
+constexpr size_t kIPv4HeaderSize = 20;
+constexpr size_t kIPv6HeaderSize = 40;
+constexpr size_t kTcpHeaderSize = 20;
+
+// The smallest MTU of an interface that IPv6 is enabled on.
+constexpr size_t kIPv6MinMtu = 1280;
+
+// The location of the transport header within an IP packet.
+struct IPPacketInfo {
+  // The IP version, either 4 or 6.
+  uint8_t version = 0;
+
+  // The protocol of the transport header.
+  uint8_t protocol = 0;
+
+  // The differentiated services codepoint.
+  uint8_t dscp = 0;
+
+  // The offset of the transport header and the size of the IP packet.
+  size_t transport_offset = 0;
+  size_t packet_size = 0;
+};
+
+// The fields of a TCP segment that carries no data.
+struct TcpAckInfo {
+  // The addresses and ports that identify the flow, zero padded for IPv4.
+  std::array<uint8_t, 36> flow = {};
+
+  // The acknowledgement number.
+  uint32_t ack_number = 0;
+
+  // The TCP flags.
+  uint8_t flags = 0;
+
+  // Whether the segment carries a selective acknowledgement option.
+  bool has_sack = false;
+
+  // Whether the IP header carries a congestion experienced mark.
+  bool ecn_ce = false;
+};
+
+// The TCP flags.
+constexpr uint8_t kTcpFlagFin = 0x01;
+constexpr uint8_t kTcpFlagSyn = 0x02;
+constexpr uint8_t kTcpFlagRst = 0x04;
+constexpr uint8_t kTcpFlagPsh = 0x08;
+constexpr uint8_t kTcpFlagAck = 0x10;
+constexpr uint8_t kTcpFlagUrg = 0x20;
+constexpr uint8_t kTcpFlagEce = 0x40;
+constexpr uint8_t kTcpFlagCwr = 0x80;
+
+// Parses the IP header of a frame read from or written to the tunnel.
+// Returns false if the frame is not an IP packet with an accessible transport
+// header, such as a non-initial fragment or an IPv6 packet with extension
+// headers.
+bool ParseIPPacket(const std::vector<uint8_t>& frame, IPPacketInfo& info);
+
+// Parses a TCP segment that carries an acknowledgement and no data, with
+// none of the SYN, FIN, RST or URG flags set. Returns false for any other
+// frame.
+bool ParseTcpAck(const std::vector<uint8_t>& frame, TcpAckInfo& info);
+
+// Reduces the maximum segment size option in a TCP SYN packet to fit the
+// supplied MTU, updating the TCP checksum. Returns true if the frame was
+// modified.
+bool ClampTcpMss(std::vector<uint8_t>& frame, uint16_t mtu);
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_IP_PACKET_H_
@@ -0,0 +1,223 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/link_cipher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/random.h>
+
+#include "nerfnet/util/chacha20_poly1305.h"
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+
+LinkCipher::LinkCipher(const std::vector<uint8_t>& key, bool is_primary)
+    : session_started_(false),
+      session_pending_(false),
+      tx_direction_(is_primary ? 0 : 1),
+      rx_direction_(is_primary ? 1 : 0),
+      tx_counter_(0),
+      rx_counter_(0) {
+  CHECK(key.size() == kKeySize, "Link key must be %zu bytes", kKeySize);
+  std::copy(key.begin(), key.end(), key_);
+  std::fill(session_key_, session_key_ + kKeySize, 0x00);
+  std::fill(pending_session_key_, pending_session_key_ + kKeySize, 0x00);
+}
+
+void LinkCipher::SealHandshake(std::vector<uint8_t>& packet,
+                               const std::vector<uint8_t>& peer_salt) {
+  CHECK(packet.size() >= kSaltOffset + kSaltSize + kTagSize,
+      "Handshake packet is too small");
+  uint8_t* salt = &packet[kSaltOffset];
+  CHECK(getrandom(salt, kSaltSize, 0) == kSaltSize,
+      "Failed to generate salt: %s (%d)", strerror(errno), errno);
+
+  // The salt is unique per handshake and doubles as the nonce.
+  std::vector<uint8_t> ad(packet.begin(), packet.end() - kTagSize);
+  ad.insert(ad.end(), peer_salt.begin(), peer_salt.end());
+  ChaCha20Poly1305Seal(key_, salt, ad.data(), ad.size(), nullptr, 0,
+      &packet[packet.size() - kTagSize], kTagSize);
+}
+
+bool LinkCipher::OpenHandshake(const std::vector<uint8_t>& packet,
+                               const std::vector<uint8_t>& peer_salt) {
+  if (packet.size() < kSaltOffset + kSaltSize + kTagSize) {
+    return false;
+  }
+
+  std::vector<uint8_t> ad(packet.begin(), packet.end() - kTagSize);
+  ad.insert(ad.end(), peer_salt.begin(), peer_salt.end());
+  return ChaCha20Poly1305Open(key_, &packet[kSaltOffset],
+      ad.data(), ad.size(), nullptr, 0,
+      &packet[packet.size() - kTagSize], kTagSize);
+}
+
+std::vector<uint8_t> LinkCipher::GetSalt(const std::vector<uint8_t>& packet) {
+  return {packet.begin() + kSaltOffset,
+          packet.begin() + kSaltOffset + kSaltSize};
+}
+
+void LinkCipher::StartSession(const std::vector<uint8_t>& primary_salt,
+                              const std::vector<uint8_t>& secondary_salt) {
+  DeriveSessionKey(primary_salt, secondary_salt, session_key_);
+  session_started_ = true;
+  session_pending_ = false;
+  tx_counter_ = 0;
+  rx_counter_ = 0;
+}
+
+void LinkCipher::SetPendingSession(const std::vector<uint8_t>& primary_salt,
+                                   const std::vector<uint8_t>& secondary_salt) {
+  DeriveSessionKey(primary_salt, secondary_salt, pending_session_key_);
+  session_pending_ = true;
+}
+
+bool LinkCipher::StartPendingSession(const std::vector<uint8_t>& packet,
+                                     size_t header_size) {
+  if (!session_pending_) {
+    return false;
+  }
+
+  std::vector<uint8_t> decrypted = packet;
+  uint64_t counter;
+  if (!OpenWithKey(pending_session_key_, 0, decrypted, header_size,
+        counter)) {
+    return false;
+  }
+
+  // The packet is opened again once the session has started.
+  std::copy(pending_session_key_, pending_session_key_ + kKeySize,
+      session_key_);
+  session_started_ = true;
+  session_pending_ = false;
+  tx_counter_ = 0;
+  rx_counter_ = 0;
+  return true;
+}
+
+void LinkCipher::ResumeSession(uint64_t peer_tx_counter) {
+  rx_counter_ = std::max(rx_counter_, peer_tx_counter);
+}
+
+std::vector<uint8_t> LinkCipher::SaveSession() const {
+  std::vector<uint8_t> session;
+  if (!session_started_) {
+    return session;
+  }
+
+  session.assign(session_key_, session_key_ + kKeySize);
+  for (uint64_t counter : {tx_counter_, rx_counter_}) {
+    for (size_t i = 0; i < 8; i++) {
+      session.push_back(static_cast<uint8_t>(counter >> (i * 8)));
+    }
+  }
+
+  return session;
+}
+
+bool LinkCipher::RestoreSession(const std::vector<uint8_t>& session) {
+  if (session.empty()) {
+    session_started_ = false;
+    return true;
+  } else if (session.size() != kKeySize + 16) {
+    return false;
+  }
+
+  std::copy(session.begin(), session.begin() + kKeySize, session_key_);
+  tx_counter_ = 0;
+  rx_counter_ = 0;
+  for (size_t i = 0; i < 8; i++) {
+    tx_counter_ |= static_cast<uint64_t>(session[kKeySize + i]) << (i * 8);
+    rx_counter_ |= static_cast<uint64_t>(session[kKeySize + 8 + i]) << (i * 8);
+  }
+
+  session_started_ = true;
+  session_pending_ = false;
+  return true;
+}
+
+void LinkCipher::Seal(std::vector<uint8_t>& packet, size_t header_size) {
+  CHECK(session_started_, "Sealing a packet without a session");
+  CHECK(packet.size() >= header_size + kTagSize, "Packet is too small");
+  uint8_t nonce[kChaCha20NonceSize];
+  BuildNonce(tx_direction_, tx_counter_++, nonce);
+
+  size_t data_size = packet.size() - header_size - kTagSize;
+  ChaCha20Poly1305Seal(session_key_, nonce, packet.data(), header_size,
+      &packet[header_size], data_size,
+      &packet[packet.size() - kTagSize], kTagSize);
+}
+
+bool LinkCipher::Open(std::vector<uint8_t>& packet, size_t header_size) {
+  uint64_t counter;
+  if (!session_started_
+      || !OpenWithKey(session_key_, rx_counter_, packet, header_size,
+          counter)) {
+    return false;
+  }
+
+  // The peer is still using the current session, so a pending session was
+  // not started by it.
+  rx_counter_ = counter + 1;
+  session_pending_ = false;
+  return true;
+}
+
+void LinkCipher::BuildNonce(uint8_t direction, uint64_t counter,
+                            uint8_t* nonce) {
+  std::fill(nonce, nonce + kChaCha20NonceSize, 0x00);
+  nonce[0] = direction;
+  for (size_t i = 0; i < 8; i++) {
+    nonce[4 + i] = static_cast<uint8_t>(counter >> (i * 8));
+  }
+}
+
+void LinkCipher::DeriveSessionKey(const std::vector<uint8_t>& primary_salt,
+                                  const std::vector<uint8_t>& secondary_salt,
+                                  uint8_t* session_key) const {
+  CHECK(primary_salt.size() == kSaltSize && secondary_salt.size() == kSaltSize,
+      "Invalid handshake salt");
+  uint8_t intermediate_key[kKeySize];
+  HChaCha20(key_, primary_salt.data(), intermediate_key);
+  HChaCha20(intermediate_key, secondary_salt.data(), session_key);
+}
+
+bool LinkCipher::OpenWithKey(const uint8_t* session_key,
+                             uint64_t first_counter,
+                             std::vector<uint8_t>& packet, size_t header_size,
+                             uint64_t& counter) const {
+  if (packet.size() < header_size + kTagSize) {
+    return false;
+  }
+
+  size_t data_size = packet.size() - header_size - kTagSize;
+  uint8_t nonce[kChaCha20NonceSize];
+  for (counter = first_counter;
+       counter < first_counter + kCounterWindow; counter++) {
+    BuildNonce(rx_direction_, counter, nonce);
+    if (ChaCha20Poly1305Open(session_key, nonce, packet.data(), header_size,
+          &packet[header_size], data_size,
+          &packet[packet.size() - kTagSize], kTagSize)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace nerfnet
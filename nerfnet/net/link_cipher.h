@@ -0,0 +1,156 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_LINK_CIPHER_H_
+#define NERFNET_NET_LINK_CIPHER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "nerfnet/util/chacha20.h"
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// Authenticated encryption for radio packets using ChaCha20-Poly1305 with a
+// pre-shared key.
+//
+// Each connection reset exchanges a random salt from each side to derive a
+// fresh session key. The responder keeps its current session until the
+// initiator sends a packet sealed with the new key, which only a peer that
+// holds both salts can do, so a recorded reset request that is replayed can
+// not end the session. Within a session every packet sent in a direction
+// consumes the next value of a 64 bit counter which forms the nonce. The
+// counter is never sent over the air: the receiver tracks the last counter it
+// accepted and searches a small window ahead of it to tolerate lost packets.
+// Replayed packets fall behind the window and fail authentication.
+class LinkCipher : public NonCopyable {
+ public:
+  // The size of the pre-shared key.
+  static constexpr size_t kKeySize = kChaCha20KeySize;
+
+  // The number of tag bytes appended to each packet.
+  static constexpr size_t kTagSize = 4;
+
+  // The offset and size of the salt carried in control packets.
+  static constexpr size_t kSaltOffset = 2;
+  static constexpr size_t kSaltSize = 16;
+
+  // Setup the cipher with the pre-shared key and the side of the link that
+  // this cipher is used for.
+  LinkCipher(const std::vector<uint8_t>& key, bool is_primary);
+
+  // Writes a random salt into a control packet and authenticates the whole
+  // packet with the pre-shared key. The salt of the peer is bound into the
+  // tag when supplied so that responses can not be replayed.
+  void SealHandshake(std::vector<uint8_t>& packet,
+                     const std::vector<uint8_t>& peer_salt = {});
+
+  // Verifies a control packet sealed by the peer.
+  bool OpenHandshake(const std::vector<uint8_t>& packet,
+                     const std::vector<uint8_t>& peer_salt = {});
+
+  // Returns the salt carried in a control packet.
+  static std::vector<uint8_t> GetSalt(const std::vector<uint8_t>& packet);
+
+  // Derives the session key from the salts exchanged in the handshake and
+  // resets the nonce counters.
+  void StartSession(const std::vector<uint8_t>& primary_salt,
+                    const std::vector<uint8_t>& secondary_salt);
+
+  // Derives the key of a session from the salts of a handshake without
+  // starting it. The current session is kept until the peer sends a packet
+  // sealed with the pending session, so that a replayed handshake can not end
+  // the current session.
+  void SetPendingSession(const std::vector<uint8_t>& primary_salt,
+                         const std::vector<uint8_t>& secondary_salt);
+
+  // Starts the pending session if the packet authenticates with it. The
+  // packet is not modified. Returns false if there is no pending session or
+  // the packet was not sealed with it.
+  bool StartPendingSession(const std::vector<uint8_t>& packet,
+                           size_t header_size);
+
+  // Returns true if a session has been established.
+  bool HasSession() const { return session_started_; }
+
+  // Returns the counter for the next packet to send.
+  uint64_t GetTxCounter() const { return tx_counter_; }
+
+  // Moves the receive window forward to the transmit counter reported by the
+  // peer when resuming a session. Packets sent during an outage may have
+  // moved the peer beyond the window. The window never moves backwards.
+  void ResumeSession(uint64_t peer_tx_counter);
+
+  // Saves the session key and counters so that a replacement process can
+  // continue the session. Returns an empty vector if there is no session.
+  std::vector<uint8_t> SaveSession() const;
+
+  // Restores a session saved by SaveSession, or clears the session if it is
+  // empty. Returns false if it is malformed.
+  bool RestoreSession(const std::vector<uint8_t>& session);
+
+  // Encrypts the packet in place after the header and writes the tag into the
+  // final bytes of the packet. The header is authenticated but not encrypted.
+  void Seal(std::vector<uint8_t>& packet, size_t header_size);
+
+  // Authenticates and decrypts a packet sealed by the peer. Returns false if
+  // no session is established or the packet fails authentication.
+  bool Open(std::vector<uint8_t>& packet, size_t header_size);
+
+ private:
+  // The number of counter values past the last accepted packet to attempt
+  // when opening a packet.
+  static constexpr uint64_t kCounterWindow = 32;
+
+  // The pre-shared key and the current session key.
+  uint8_t key_[kKeySize];
+  uint8_t session_key_[kKeySize];
+  bool session_started_;
+
+  // The key of a session derived from a handshake that the peer has not yet
+  // used.
+  uint8_t pending_session_key_[kKeySize];
+  bool session_pending_;
+
+  // The direction identifiers for packets sent and received.
+  const uint8_t tx_direction_;
+  const uint8_t rx_direction_;
+
+  // The counter for the next packet to send and the counter for the next
+  // packet expected from the peer.
+  uint64_t tx_counter_;
+  uint64_t rx_counter_;
+
+  // Builds the nonce for a direction and counter.
+  static void BuildNonce(uint8_t direction, uint64_t counter, uint8_t* nonce);
+
+  // Derives a session key from the salts exchanged in a handshake.
+  void DeriveSessionKey(const std::vector<uint8_t>& primary_salt,
+                        const std::vector<uint8_t>& secondary_salt,
+                        uint8_t* session_key) const;
+
+  // Authenticates and decrypts a packet with a session key, searching the
+  // window of counters from the first counter. Returns the counter that the
+  // packet was sealed with.
+  bool OpenWithKey(const uint8_t* session_key, uint64_t first_counter,
+                   std::vector<uint8_t>& packet, size_t header_size,
+                   uint64_t& counter) const;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_LINK_CIPHER_H_
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/link_probe_stats.h"
+
+#include <algorithm>
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/stats.h"
+
+namespace nerfnet {
+namespace {
+
+// Returns the percentage of the total that the supplied count makes up.
+double Percent(uint64_t count, uint64_t total) {
+  return (total == 0) ? 0.0 : (count * 100.0) / total;
+}
+
+}  // anonymous namespace
+
+LinkProbeStats::LinkProbeStats() {
+  round_trip_us_.reserve(kMaxSamples);
+  downlink_delay_us_.reserve(kMaxSamples);
+  uplink_delay_us_.reserve(kMaxSamples);
+  Reset();
+}
+
+void LinkProbeStats::Reset() {
+  sent_ = 0;
+  answered_ = 0;
+  last_sequence_.reset();
+  last_received_count_ = 0;
+  downlink_delivered_ = 0;
+  uplink_delivered_ = 0;
+  downlink_lost_ = 0;
+  uplink_lost_ = 0;
+  current_burst_ = 0;
+  bursts_ = 0;
+  burst_total_ = 0;
+  max_burst_ = 0;
+  round_trip_us_.clear();
+  downlink_delay_us_.clear();
+  uplink_delay_us_.clear();
+}
+
+void LinkProbeStats::RecordUnanswered() {
+  sent_++;
+  current_burst_++;
+}
+
+void LinkProbeStats::RecordAnswered(uint16_t sequence,
+    uint16_t received_count, const Times& times) {
+  sent_++;
+  answered_++;
+  EndBurst();
+
+  // The secondary answers every probe that it receives, so the probes that
+  // it received but were not answered were lost on the way back. The first
+  // answer only sets the baseline as the probes before it are unknown.
+  if (last_sequence_.has_value()) {
+    uint16_t sent = sequence - last_sequence_.value();
+    uint16_t received = received_count - last_received_count_;
+    if (received <= sent && received > 0) {
+      downlink_delivered_ += received;
+      uplink_delivered_++;
+      downlink_lost_ += sent - received;
+      uplink_lost_ += received - 1;
+    }
+  }
+
+  last_sequence_ = sequence;
+  last_received_count_ = received_count;
+  if (round_trip_us_.size() < kMaxSamples) {
+    round_trip_us_.push_back(
+        static_cast<uint32_t>(times.primary_received_us
+            - times.primary_sent_us));
+    downlink_delay_us_.push_back(static_cast<int32_t>(
+        times.secondary_received_us - times.primary_sent_us));
+    uplink_delay_us_.push_back(static_cast<int32_t>(
+        times.primary_received_us - times.secondary_sent_us));
+  }
+}
+
+void LinkProbeStats::Log(const char* name) const {
+  uint64_t downlink_sent = downlink_delivered_ + downlink_lost_;
+  uint64_t uplink_sent = uplink_delivered_ + uplink_lost_;
+  LOGI("%s: %llu probes, %llu answered, downlink loss %.2f%%, "
+       "uplink loss %.2f%%", name, static_cast<unsigned long long>(sent_),
+       static_cast<unsigned long long>(answered_),
+       Percent(downlink_lost_, downlink_sent),
+       Percent(uplink_lost_, uplink_sent));
+  LOGI("%s: %llu loss bursts, mean length %.1f, max length %llu", name,
+       static_cast<unsigned long long>(bursts_),
+       (bursts_ == 0) ? 0.0 : static_cast<double>(burst_total_) / bursts_,
+       static_cast<unsigned long long>(std::max(max_burst_, current_burst_)));
+
+  std::vector<int64_t> round_trip_us = round_trip_us_;
+  std::sort(round_trip_us.begin(), round_trip_us.end());
+  LOGI("%s: round trip p50 %lld us, p90 %lld us, p99 %lld us, max %lld us",
+       name, static_cast<long long>(Percentile(round_trip_us, 0.50)),
+       static_cast<long long>(Percentile(round_trip_us, 0.90)),
+       static_cast<long long>(Percentile(round_trip_us, 0.99)),
+       static_cast<long long>(Percentile(round_trip_us, 1.0)));
+
+  // The delay variation is relative to the shortest delay, which removes the
+  // offset between the clocks of the two sides.
+  for (const auto* delays_us : {&downlink_delay_us_, &uplink_delay_us_}) {
+    std::vector<int64_t> sorted = *delays_us;
+    std::sort(sorted.begin(), sorted.end());
+    int64_t min_us = Percentile(sorted, 0.0);
+    LOGI("%s: %s delay variation p50 %lld us, p90 %lld us, p99 %lld us",
+         name, (delays_us == &downlink_delay_us_) ? "downlink" : "uplink",
+         static_cast<long long>(Percentile(sorted, 0.50) - min_us),
+         static_cast<long long>(Percentile(sorted, 0.90) - min_us),
+         static_cast<long long>(Percentile(sorted, 0.99) - min_us));
+  }
+}
+
+void LinkProbeStats::EndBurst() {
+  if (current_burst_ > 0) {
+    bursts_++;
+    burst_total_ += current_burst_;
+    max_burst_ = std::max(max_burst_, current_burst_);
+    current_burst_ = 0;
+  }
+}
+
+}  // namespace nerfnet
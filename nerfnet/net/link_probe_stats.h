@@ -0,0 +1,98 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_LINK_PROBE_STATS_H_
+#define NERFNET_NET_LINK_PROBE_STATS_H_
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace nerfnet {
+
+// Statistics of the link measured with probe packets sent by the primary and
+// answered by the secondary. Each side timestamps probes with its own clock,
+// so one-way delays are only compared with each other, which cancels the
+// offset between the clocks.
+class LinkProbeStats {
+ public:
+  // The times of a probe exchange, truncated to 32 bits.
+  struct Times {
+    uint32_t primary_sent_us;
+    uint32_t secondary_received_us;
+    uint32_t secondary_sent_us;
+    uint32_t primary_received_us;
+  };
+
+  LinkProbeStats();
+
+  // Clears the statistics.
+  void Reset();
+
+  // Records a probe that was not answered.
+  void RecordUnanswered();
+
+  // Records the answer to a probe. The sequence number of the probe and the
+  // number of probes that the secondary has received are compared with those
+  // of the previous answer to attribute the probes lost since to each
+  // direction.
+  void RecordAnswered(uint16_t sequence, uint16_t received_count,
+                      const Times& times);
+
+  // Returns the number of probes delivered in each direction.
+  uint64_t GetDownlinkDelivered() const { return downlink_delivered_; }
+  uint64_t GetUplinkDelivered() const { return uplink_delivered_; }
+
+  // Logs the statistics, prefixed with the supplied name.
+  void Log(const char* name) const;
+
+ private:
+  // The maximum number of samples kept of each delay. Storage is allocated
+  // up front so that recording does not allocate.
+  static constexpr size_t kMaxSamples = 65536;
+
+  // The number of probes sent and answered.
+  uint64_t sent_;
+  uint64_t answered_;
+
+  // The sequence number and received count of the previous answer.
+  std::optional<uint16_t> last_sequence_;
+  uint16_t last_received_count_;
+
+  // The probes delivered and lost in each direction.
+  uint64_t downlink_delivered_;
+  uint64_t uplink_delivered_;
+  uint64_t downlink_lost_;
+  uint64_t uplink_lost_;
+
+  // The runs of consecutive unanswered probes.
+  uint64_t current_burst_;
+  uint64_t bursts_;
+  uint64_t burst_total_;
+  uint64_t max_burst_;
+
+  // The round-trip times and the one-way delays in each direction.
+  std::vector<int64_t> round_trip_us_;
+  std::vector<int64_t> downlink_delay_us_;
+  std::vector<int64_t> uplink_delay_us_;
+
+  // Ends the current run of unanswered probes.
+  void EndBurst();
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_LINK_PROBE_STATS_H_
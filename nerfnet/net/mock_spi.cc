@@ -0,0 +1,212 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/mock_spi.h"
+
+#include <algorithm>
+
+namespace nerfnet {
+namespace {
+
+// The registers and bits of the NRF24L01 that are emulated.
+constexpr uint8_t kRegisterConfig = 0x00;
+constexpr uint8_t kRegisterChannel = 0x05;
+constexpr uint8_t kRegisterStatus = 0x07;
+constexpr uint8_t kRegisterRxAddrP1 = 0x0b;
+constexpr uint8_t kRegisterTxAddr = 0x10;
+constexpr uint8_t kRegisterRxPayloadWidthP1 = 0x12;
+constexpr uint8_t kRegisterDynamicPayload = 0x1c;
+constexpr uint8_t kRegisterFeature = 0x1d;
+constexpr uint8_t kConfigPrimaryRx = 0x01;
+constexpr uint8_t kStatusRxReady = 0x40;
+constexpr uint8_t kStatusTxSent = 0x20;
+constexpr uint8_t kStatusMaxRetries = 0x10;
+constexpr uint8_t kStatusFlags =
+    kStatusRxReady | kStatusTxSent | kStatusMaxRetries;
+constexpr uint8_t kFeatureDynamicPayload = 0x04;
+
+}  // anonymous namespace
+
+MockSpi::MockSpi()
+    : peer_(nullptr),
+      ce_enabled_(false) {
+  registers_.fill(0);
+  for (auto& addr : addresses_) {
+    addr.fill(0xe7);
+  }
+}
+
+void MockSpi::Connect(MockSpi& a, MockSpi& b) {
+  a.peer_ = &b;
+  b.peer_ = &a;
+}
+
+MockSpi::Counters MockSpi::GetCounters() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return counters_;
+}
+
+bool MockSpi::TransferBatch(Transfer* transfers, size_t count) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_.operations++;
+    if (count == 1 && transfers[0].size == 1 && transfers[0].data[0] == 0xff) {
+      counters_.status_polls++;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      counters_.transfers++;
+      counters_.bytes += transfers[i].size;
+      HandleTransfer(transfers[i]);
+    }
+  }
+
+  // A payload written while the chip is enabled is sent immediately.
+  TransmitPending();
+  return true;
+}
+
+void MockSpi::SetChipEnable(bool enabled) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (enabled != ce_enabled_) {
+      counters_.chip_enable_changes++;
+    }
+
+    ce_enabled_ = enabled;
+  }
+
+  TransmitPending();
+}
+
+uint8_t MockSpi::GetStatus() {
+  uint8_t status = registers_[kRegisterStatus] & kStatusFlags;
+  status |= rx_fifo_.empty() ? 0x0e : 0x02;
+  if (tx_fifo_.size() >= kFifoSize) {
+    status |= 0x01;
+  }
+
+  return status;
+}
+
+bool MockSpi::IsAddressRegister(uint8_t reg) {
+  return reg == 0x0a || reg == kRegisterRxAddrP1 || reg == kRegisterTxAddr;
+}
+
+void MockSpi::HandleTransfer(Transfer& transfer) {
+  uint8_t command = transfer.data[0];
+  transfer.data[0] = GetStatus();
+  uint8_t* payload = transfer.data + 1;
+  size_t payload_size = transfer.size - 1;
+  if (command < 0x20) {
+    uint8_t reg = command & 0x1f;
+    for (size_t i = 0; i < payload_size; i++) {
+      payload[i] = IsAddressRegister(reg)
+          ? addresses_[reg][std::min<size_t>(i, 4)] : registers_[reg];
+    }
+  } else if (command < 0x40) {
+    uint8_t reg = command & 0x1f;
+    if (reg == kRegisterStatus && payload_size > 0) {
+      registers_[reg] &= ~(payload[0] & kStatusFlags);
+    } else if (IsAddressRegister(reg)) {
+      std::copy(payload, payload + std::min<size_t>(payload_size, 5),
+          addresses_[reg].begin());
+    } else if (payload_size > 0) {
+      registers_[reg] = payload[0];
+    }
+  } else if (command == 0x60) {
+    if (payload_size > 0) {
+      payload[0] = rx_fifo_.empty() ? 0 : rx_fifo_.front().size();
+    }
+  } else if (command == 0x61) {
+    if (!rx_fifo_.empty()) {
+      const auto& packet = rx_fifo_.front();
+      std::copy(packet.begin(),
+          packet.begin() + std::min(packet.size(), payload_size), payload);
+      rx_fifo_.pop_front();
+      counters_.packets_received++;
+    }
+  } else if (command == 0xa0 || command == 0xb0) {
+    if (tx_fifo_.size() < kFifoSize) {
+      tx_fifo_.push_back({std::vector<uint8_t>(payload, payload + payload_size),
+          command == 0xb0});
+    }
+  } else if (command == 0xe1) {
+    tx_fifo_.clear();
+  } else if (command == 0xe2) {
+    rx_fifo_.clear();
+  }
+}
+
+void MockSpi::TransmitPending() {
+  while (true) {
+    TxPacket packet;
+    uint8_t channel;
+    std::array<uint8_t, 5> addr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!ce_enabled_ || (registers_[kRegisterConfig] & kConfigPrimaryRx)
+          || tx_fifo_.empty()
+          || (registers_[kRegisterStatus] & kStatusMaxRetries)) {
+        return;
+      }
+
+      packet = tx_fifo_.front();
+      channel = registers_[kRegisterChannel];
+      addr = addresses_[kRegisterTxAddr];
+    }
+
+    // The peer is locked separately to avoid holding both locks.
+    bool acknowledged = peer_ != nullptr
+        && peer_->Receive(packet.data, channel, addr);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (acknowledged || packet.no_ack) {
+      tx_fifo_.pop_front();
+      registers_[kRegisterStatus] |= kStatusTxSent;
+      counters_.packets_sent++;
+    } else {
+      registers_[kRegisterStatus] |= kStatusMaxRetries;
+    }
+  }
+}
+
+bool MockSpi::Receive(const std::vector<uint8_t>& packet, uint8_t channel,
+    const std::array<uint8_t, 5>& addr) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!ce_enabled_ || !(registers_[kRegisterConfig] & kConfigPrimaryRx)
+      || registers_[kRegisterChannel] != channel
+      || !std::equal(addr.begin(), addr.begin() + 3,
+          addresses_[kRegisterRxAddrP1].begin())
+      || rx_fifo_.size() >= kFifoSize) {
+    return false;
+  }
+
+  // Payloads are padded or truncated to the configured width unless dynamic
+  // payloads are enabled on the pipe.
+  std::vector<uint8_t> payload(packet);
+  if (!(registers_[kRegisterFeature] & kFeatureDynamicPayload)
+      || !(registers_[kRegisterDynamicPayload] & 0x02)) {
+    payload.resize(std::min<size_t>(registers_[kRegisterRxPayloadWidthP1],
+        32));
+  }
+
+  rx_fifo_.push_back(std::move(payload));
+  registers_[kRegisterStatus] |= kStatusRxReady;
+  return true;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_MOCK_SPI_H_
+#define NERFNET_NET_MOCK_SPI_H_
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "nerfnet/net/spi_device.h"
+
+namespace nerfnet {
+
+// An SPI device that emulates the registers and FIFOs of an NRF24L01 and
+// counts the SPI traffic used to drive it. Two mocks can be connected so
+// that packets transmitted by one are received by the other.
+class MockSpi : public SpiDevice {
+ public:
+  // The SPI traffic used to drive the radio.
+  struct Counters {
+    // The number of batches, each of which is a system call on hardware.
+    uint64_t operations = 0;
+
+    // The number of operations that only polled the status.
+    uint64_t status_polls = 0;
+
+    // The number of chip-select framed transfers and bytes sent.
+    uint64_t transfers = 0;
+    uint64_t bytes = 0;
+
+    // The number of changes of the chip-enable pin.
+    uint64_t chip_enable_changes = 0;
+
+    // The number of packets acknowledged by the peer and read from the
+    // receive FIFO.
+    uint64_t packets_sent = 0;
+    uint64_t packets_received = 0;
+  };
+
+  MockSpi();
+
+  // Connects two mocks so that each receives the packets of the other.
+  static void Connect(MockSpi& a, MockSpi& b);
+
+  // Returns the traffic counted so far.
+  Counters GetCounters();
+
+  // SpiDevice implementation.
+  bool TransferBatch(Transfer* transfers, size_t count) final;
+  void SetChipEnable(bool enabled) final;
+
+ private:
+  // The number of packets held by each FIFO.
+  static constexpr size_t kFifoSize = 3;
+
+  // Guards the state of the mock.
+  std::mutex mutex_;
+
+  // The mock that receives transmitted packets, or null.
+  MockSpi* peer_;
+
+  // The register file. Address registers are held separately.
+  std::array<uint8_t, 0x20> registers_;
+  std::array<std::array<uint8_t, 5>, 0x20> addresses_;
+
+  // A packet waiting in the transmit FIFO and whether it was written without
+  // requesting an acknowledgement.
+  struct TxPacket {
+    std::vector<uint8_t> data;
+    bool no_ack;
+  };
+
+  // The FIFOs and the chip-enable level.
+  std::deque<TxPacket> tx_fifo_;
+  std::deque<std::vector<uint8_t>> rx_fifo_;
+  bool ce_enabled_;
+
+  // The traffic counted so far.
+  Counters counters_;
+
+  // Returns the STATUS byte. Must be called with the lock held.
+  uint8_t GetStatus();
+
+  // Returns true if the register holds an address.
+  static bool IsAddressRegister(uint8_t reg);
+
+  // Handles a single transfer. Must be called with the lock held.
+  void HandleTransfer(Transfer& transfer);
+
+  // Transmits the packets in the transmit FIFO if the radio is in transmit
+  // mode with the chip enabled.
+  void TransmitPending();
+
+  // Accepts a packet from the peer. Returns true if it was acknowledged.
+  bool Receive(const std::vector<uint8_t>& packet, uint8_t channel,
+      const std::array<uint8_t, 5>& addr);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_MOCK_SPI_H_
@@ -15,19 +15,35 @@
  */
 
 #include <arpa/inet.h>
+#include <cctype>
+#include <cstdint>
 #include <fcntl.h>
+#include <fstream>
+#include <memory>
 #include <linux/if.h>
 #include <linux/if_tun.h>
-#include <RF24/RF24.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <tclap/CmdLine.h>
 #include <unistd.h>
+#include <utility>
 
+#include "nerfnet/net/control_socket.h"
+#include "nerfnet/net/datagram_socket.h"
+#include "nerfnet/net/broadcast_radio_interface.h"
+#include "nerfnet/net/duplex_radio_interface.h"
+#include "nerfnet/net/handoff_socket.h"
+#include "nerfnet/net/ip_packet.h"
+#include "nerfnet/net/nrf24_radio.h"
+#include "nerfnet/net/pcap_tunnel.h"
 #include "nerfnet/net/primary_radio_interface.h"
+#include "nerfnet/net/rf24_radio.h"
 #include "nerfnet/net/secondary_radio_interface.h"
+#include "nerfnet/net/spidev_spi.h"
+#include "nerfnet/net/symmetric_radio_interface.h"
+#include "nerfnet/net/tun_tunnel.h"
 #include "nerfnet/util/log.h"
 
 // A description of the program.
@@ -37,6 +53,9 @@ constexpr char kDescription[] =
 // The version of the program.
 constexpr char kVersion[] = "0.0.1";
 
+// The clock speed of the SPI bus when driving the radios through spidev.
+constexpr uint32_t kSpiSpeedHz = 8000000;
+
 // Sets flags for a given interface. Quits and logs the error on failure.
 void SetInterfaceFlags(const std::string_view& device_name, int flags) {
   int fd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -77,6 +96,20 @@ void SetIPAddress(const std::string_view& device_name,
   close(fd);
 }
 
+// Sets the MTU for a given interface. Quits and logs the error on failure.
+void SetInterfaceMtu(const std::string_view& device_name, int mtu) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  CHECK(fd >= 0, "Failed to open socket: %s (%d)", strerror(errno), errno);
+
+  struct ifreq ifr = {};
+  ifr.ifr_mtu = mtu;
+  strncpy(ifr.ifr_name, std::string(device_name).c_str(), IFNAMSIZ);
+  int status = ioctl(fd, SIOCSIFMTU, &ifr);
+  CHECK(status >= 0, "Failed to set tunnel interface mtu: %s (%d)",
+      strerror(errno), errno);
+  close(fd);
+}
+
 // Opens the tunnel interface to listen on. Always returns a valid file
 // descriptor or quits and logs the error.
 int OpenTunnel(const std::string_view& device_name) {
@@ -93,6 +126,33 @@ int OpenTunnel(const std::string_view& device_name) {
   return fd;
 }
 
+// Reads a pre-shared key from a file containing 64 hex characters. Always
+// returns a valid key or quits and logs the error.
+std::vector<uint8_t> ReadKeyFile(const std::string& path) {
+  std::ifstream file(path);
+  CHECK(file.good(), "Failed to open key file '%s'", path.c_str());
+
+  std::string hex;
+  char c;
+  while (file.get(c)) {
+    if (!isspace(static_cast<unsigned char>(c))) {
+      CHECK(isxdigit(static_cast<unsigned char>(c)),
+          "Key file contains invalid character '%c'", c);
+      hex.push_back(c);
+    }
+  }
+
+  CHECK(hex.size() == nerfnet::LinkCipher::kKeySize * 2,
+      "Key file must contain %zu hex characters",
+      nerfnet::LinkCipher::kKeySize * 2);
+  std::vector<uint8_t> key;
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    key.push_back(std::stoi(hex.substr(i, 2), nullptr, 16));
+  }
+
+  return key;
+}
+
 int main(int argc, char** argv) {
   // Parse command-line arguments.
   TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
@@ -125,8 +185,121 @@ int main(int argc, char** argv) {
       false, 100, "microseconds", cmd);
   TCLAP::SwitchArg enable_tunnel_logs_arg("", "enable_tunnel_logs",
       "Set to enable verbose logs for read/writes from the tunnel.", cmd);
+  TCLAP::ValueArg<std::string> key_file_arg("", "key_file",
+      "A file containing a 32 byte pre-shared key in hex. Enables encryption "
+      "and authentication of all packets.", false, "", "path", cmd);
+  TCLAP::ValueArg<std::string> replay_pcap_arg("", "replay_pcap",
+      "Replay IP packets from a pcap file instead of reading the tunnel "
+      "interface.", false, "", "path", cmd);
+  TCLAP::ValueArg<double> replay_speed_arg("", "replay_speed",
+      "The factor to speed up replayed inter-arrival times by. Set to 0 to "
+      "replay as fast as the link allows.", false, 1.0, "factor", cmd);
+  TCLAP::ValueArg<std::string> offered_pcap_arg("", "offered_pcap",
+      "Record replayed packets to a pcap file as they are offered to the "
+      "link.", false, "", "path", cmd);
+  TCLAP::ValueArg<std::string> record_pcap_arg("", "record_pcap",
+      "Record packets delivered by the link to a pcap file instead of "
+      "writing the tunnel interface.", false, "", "path", cmd);
+  TCLAP::ValueArg<uint16_t> tunnel_mtu_arg("", "tunnel_mtu",
+      "The MTU to use for the tunnel interface. Defaults to the smallest "
+      "size that fits IPv6 and splits evenly into radio packets.", false, 0,
+      "bytes", cmd);
+  TCLAP::SwitchArg ack_filter_arg("", "ack_filter",
+      "Set to drop queued TCP acks that are made redundant by a newer ack for "
+      "the same flow.", cmd);
+  TCLAP::ValueArg<uint16_t> interleave_size_arg("", "interleave_size",
+      "Frames up to this size are sent ahead of larger frames, between the "
+      "packets of a larger frame in flight. Set to 0 to send frames in "
+      "order.", false, nerfnet::RadioInterface::kDefaultInterleaveMaxSize,
+      "bytes", cmd);
+  TCLAP::MultiArg<std::string> best_effort_arg("", "best_effort",
+      "Deliver frames matching port:<number> or dscp:<value> best-effort, "
+      "dropping them if they have not been sent within the deadline given "
+      "in milliseconds after an '=', such as port:5004=100. May be "
+      "repeated.", false, "rule", cmd);
+  TCLAP::ValueArg<std::string> spool_arg("", "spool",
+      "Store frames matching a spool rule in a file at this path and send "
+      "them while the link is otherwise idle, so that delay tolerant "
+      "traffic waits out outages of the link.", false, "", "path", cmd);
+  TCLAP::ValueArg<uint32_t> spool_size_arg("", "spool_size",
+      "The size of the spool file in megabytes.", false, 64, "megabytes",
+      cmd);
+  TCLAP::MultiArg<std::string> spool_rule_arg("", "spool_rule",
+      "Spool frames matching port:<number> or dscp:<value>, or datagrams "
+      "sent on channel:<number>. May be repeated.", false, "rule", cmd);
+  TCLAP::ValueArg<uint16_t> duplex_ce_pin_arg("", "duplex_ce_pin",
+      "Set to the chip-enable pin of a second NRF24L01 to run the link in "
+      "full-duplex mode. The second radio is used for receiving.", false, 0,
+      "index", cmd);
+  TCLAP::ValueArg<uint8_t> duplex_channel_arg("", "duplex_channel",
+      "The channel used by the secondary to transmit in full-duplex mode.",
+      false, 2, "channel", cmd);
+  TCLAP::SwitchArg symmetric_arg("", "symmetric",
+      "Set to let either side transmit when it has data, listening before "
+      "talking, instead of polling from the primary.", cmd);
+  TCLAP::SwitchArg broadcast_arg("", "broadcast",
+      "Set to stream one-way without acknowledgements from the primary to "
+      "any number of secondaries listening on the broadcast address.", cmd);
+  TCLAP::ValueArg<uint32_t> broadcast_addr_arg("", "broadcast_addr",
+      "The address shared by all sides in broadcast mode.", false,
+      0x90029002, "address", cmd);
+  TCLAP::ValueArg<uint32_t> broadcast_fec_arg("", "broadcast_fec",
+      "Set to send a parity packet after this many data packets in broadcast "
+      "mode, which lets receivers recover one loss per group. Must match on "
+      "all sides.", false, 0, "packets", cmd);
+  TCLAP::ValueArg<std::string> spi_device_arg("", "spi_device",
+      "Drive the NRF24L01 directly through an spidev device instead of the "
+      "RF24 library. The chip-enable pin is a line of --gpio_chip.", false, "",
+      "path", cmd);
+  TCLAP::ValueArg<std::string> duplex_spi_device_arg("", "duplex_spi_device",
+      "The spidev device of the second NRF24L01 in full-duplex mode.", false,
+      "/dev/spidev0.1", "path", cmd);
+  TCLAP::ValueArg<std::string> gpio_chip_arg("", "gpio_chip",
+      "The GPIO chip that the chip-enable pins are attached to.", false,
+      "/dev/gpiochip0", "path", cmd);
+  TCLAP::ValueArg<std::string> control_socket_arg("", "control_socket",
+      "The path of a unix socket to listen on for commands that change "
+      "settings while running.", false, "", "path", cmd);
+  TCLAP::ValueArg<int> realtime_priority_arg("", "realtime_priority",
+      "Set to run the radio with SCHED_FIFO scheduling at this priority, with "
+      "memory locked. The tunnel thread runs one level lower.", false, 0,
+      "priority", cmd);
+  TCLAP::ValueArg<int> radio_cpu_arg("", "radio_cpu",
+      "The CPU to pin the radio thread to in realtime mode.", false, -1,
+      "index", cmd);
+  TCLAP::ValueArg<int> tunnel_cpu_arg("", "tunnel_cpu",
+      "The CPU to pin the tunnel thread to in realtime mode.", false, -1,
+      "index", cmd);
+  TCLAP::ValueArg<uint32_t> turnaround_report_s_arg("", "turnaround_report_s",
+      "Set to log the distribution of turnaround times at this interval.",
+      false, 0, "seconds", cmd);
+  TCLAP::ValueArg<std::string> handoff_socket_arg("", "handoff_socket",
+      "Set to hand the tunnel and session over to a replacement process "
+      "through this unix socket path. A process started with the same path "
+      "takes over from the one running, which exits.", false, "", "path",
+      cmd);
+  TCLAP::ValueArg<std::string> datagram_socket_arg("", "datagram_socket",
+      "Set to listen on this unix socket path for datagrams to exchange "
+      "with the peer outside of the tunnel.", false, "", "path", cmd);
+  TCLAP::ValueArg<std::string> capture_pcapng_arg("", "capture_pcapng",
+      "Set to capture frames and radio packets with link metadata to this "
+      "pcapng file.", false, "", "path", cmd);
+  TCLAP::ValueArg<uint32_t> measure_s_arg("", "measure_s",
+      "Set to measure the link for this long and exit instead of carrying "
+      "traffic. Primary only.", false, 0, "seconds", cmd);
+  TCLAP::ValueArg<uint32_t> probe_interval_ms_arg("", "probe_interval_ms",
+      "Set to send a link probe in place of a poll at this interval. Primary "
+      "only.", false, 0, "milliseconds", cmd);
+  TCLAP::ValueArg<uint32_t> probe_report_s_arg("", "probe_report_s",
+      "The interval to log the results of link probes at.", false, 10,
+      "seconds", cmd);
   cmd.parse(argc, argv);
 
+  std::vector<uint8_t> key;
+  if (key_file_arg.isSet()) {
+    key = ReadKeyFile(key_file_arg.getValue());
+  }
+
   std::string tunnel_ip = tunnel_ip_arg.getValue();
   if (!tunnel_ip_arg.isSet()) {
     if (primary_arg.getValue()) {
@@ -137,33 +310,216 @@ int main(int argc, char** argv) {
   }
 
   // Setup tunnel.
-  int tunnel_fd = OpenTunnel(interface_name_arg.getValue());
-  LOGI("tunnel '%s' opened", interface_name_arg.getValue().c_str());
-  SetInterfaceFlags(interface_name_arg.getValue(), IFF_UP);
-  LOGI("tunnel '%s' up", interface_name_arg.getValue().c_str());
-  SetIPAddress(interface_name_arg.getValue(), tunnel_ip,
-      tunnel_ip_mask.getValue());
-  LOGI("tunnel '%s' configured with '%s' mask '%s'",
-       interface_name_arg.getValue().c_str(), tunnel_ip.c_str(),
-       tunnel_ip_mask.getValue().c_str());
-
-  if (primary_arg.getValue()) {
-    nerfnet::PrimaryRadioInterface radio_interface(
-        ce_pin_arg.getValue(), tunnel_fd,
+  std::unique_ptr<nerfnet::Tunnel> tunnel;
+  bool pcap_tunnel = replay_pcap_arg.isSet() || record_pcap_arg.isSet();
+  CHECK(!handoff_socket_arg.isSet() || (!pcap_tunnel
+      && !duplex_ce_pin_arg.isSet() && !symmetric_arg.getValue()
+      && !broadcast_arg.getValue()),
+      "Handoff requires the polled mode with a tunnel interface");
+  int tunnel_fd = -1;
+  std::vector<uint8_t> handoff_state;
+  if (handoff_socket_arg.isSet()
+      && nerfnet::HandoffSocket::Request(handoff_socket_arg.getValue(),
+          tunnel_fd, handoff_state)) {
+    tunnel = std::make_unique<nerfnet::TunTunnel>(tunnel_fd);
+    LOGI("tunnel '%s' taken over", interface_name_arg.getValue().c_str());
+  } else if (pcap_tunnel) {
+    tunnel = std::make_unique<nerfnet::PcapTunnel>(
+        replay_pcap_arg.getValue(), replay_speed_arg.getValue(),
+        offered_pcap_arg.getValue(), record_pcap_arg.getValue());
+    LOGI("pcap tunnel opened");
+  } else {
+    tunnel_fd = OpenTunnel(interface_name_arg.getValue());
+    LOGI("tunnel '%s' opened", interface_name_arg.getValue().c_str());
+    SetInterfaceFlags(interface_name_arg.getValue(), IFF_UP);
+    LOGI("tunnel '%s' up", interface_name_arg.getValue().c_str());
+    SetIPAddress(interface_name_arg.getValue(), tunnel_ip,
+        tunnel_ip_mask.getValue());
+    LOGI("tunnel '%s' configured with '%s' mask '%s'",
+         interface_name_arg.getValue().c_str(), tunnel_ip.c_str(),
+         tunnel_ip_mask.getValue().c_str());
+    tunnel = std::make_unique<nerfnet::TunTunnel>(tunnel_fd);
+  }
+
+  // Setup radios.
+  std::unique_ptr<nerfnet::SpiDevice> spi;
+  std::unique_ptr<nerfnet::SpiDevice> duplex_spi;
+  std::unique_ptr<nerfnet::Radio> radio;
+  std::unique_ptr<nerfnet::Radio> duplex_radio;
+  if (spi_device_arg.isSet()) {
+    spi = std::make_unique<nerfnet::SpidevSpi>(spi_device_arg.getValue(),
+        kSpiSpeedHz, gpio_chip_arg.getValue(), ce_pin_arg.getValue());
+    radio = std::make_unique<nerfnet::Nrf24Radio>(*spi);
+    if (duplex_ce_pin_arg.isSet()) {
+      duplex_spi = std::make_unique<nerfnet::SpidevSpi>(
+          duplex_spi_device_arg.getValue(), kSpiSpeedHz,
+          gpio_chip_arg.getValue(), duplex_ce_pin_arg.getValue());
+      duplex_radio = std::make_unique<nerfnet::Nrf24Radio>(*duplex_spi);
+    }
+  } else {
+    radio = std::make_unique<nerfnet::RF24Radio>(ce_pin_arg.getValue(), 0);
+    if (duplex_ce_pin_arg.isSet()) {
+      duplex_radio = std::make_unique<nerfnet::RF24Radio>(
+          duplex_ce_pin_arg.getValue(), 1);
+    }
+  }
+
+  std::unique_ptr<nerfnet::RadioInterface> radio_interface;
+  nerfnet::PrimaryRadioInterface* primary_interface = nullptr;
+  CHECK(!symmetric_arg.getValue() || duplex_radio == nullptr,
+      "Symmetric mode uses a single radio");
+  CHECK(!broadcast_arg.getValue()
+      || (duplex_radio == nullptr && !symmetric_arg.getValue()),
+      "Broadcast mode uses a single radio");
+  CHECK(!broadcast_arg.getValue() || key.empty(),
+      "Broadcast mode does not support encryption");
+  CHECK(!interleave_size_arg.isSet() || (duplex_radio == nullptr
+      && !symmetric_arg.getValue() && !broadcast_arg.getValue()),
+      "Interleaving is only supported in the polled mode");
+  CHECK(!spool_arg.isSet() || (duplex_radio == nullptr
+      && !symmetric_arg.getValue() && !broadcast_arg.getValue()),
+      "Spooling is only supported in the polled mode");
+  CHECK(spool_rule_arg.getValue().empty() || spool_arg.isSet(),
+      "Spool rules require a spool");
+  CHECK(spool_size_arg.getValue() > 0 && spool_size_arg.getValue() <= 4096,
+      "Spool size must be between 1 and 4096 megabytes");
+  uint64_t spool_size =
+      static_cast<uint64_t>(spool_size_arg.getValue()) * 1024 * 1024;
+  uint64_t max_spool_size = static_cast<uint64_t>(SIZE_MAX) / 4 + 1;
+  CHECK(spool_size <= max_spool_size,
+      "Spool size must be at most a quarter of the address space (%llu MB)",
+      static_cast<unsigned long long>(max_spool_size / 1024 / 1024));
+  if (broadcast_arg.getValue()) {
+    radio_interface = std::make_unique<nerfnet::BroadcastRadioInterface>(
+        *radio, *tunnel, broadcast_addr_arg.getValue(),
+        channel_arg.getValue(), primary_arg.getValue(),
+        poll_interval_us_arg.getValue(), broadcast_fec_arg.getValue());
+  } else if (symmetric_arg.getValue()) {
+    radio_interface = std::make_unique<nerfnet::SymmetricRadioInterface>(
+        *radio, *tunnel,
+        primary_addr_arg.getValue(), secondary_addr_arg.getValue(),
+        channel_arg.getValue(), primary_arg.getValue(),
+        poll_interval_us_arg.getValue());
+  } else if (duplex_radio != nullptr) {
+    radio_interface = std::make_unique<nerfnet::DuplexRadioInterface>(
+        *radio, *duplex_radio, *tunnel,
+        primary_addr_arg.getValue(), secondary_addr_arg.getValue(),
+        channel_arg.getValue(), duplex_channel_arg.getValue(),
+        primary_arg.getValue(), poll_interval_us_arg.getValue());
+  } else if (primary_arg.getValue()) {
+    auto primary = std::make_unique<nerfnet::PrimaryRadioInterface>(
+        *radio, *tunnel,
         primary_addr_arg.getValue(), secondary_addr_arg.getValue(),
         channel_arg.getValue(), poll_interval_us_arg.getValue());
-    radio_interface.SetTunnelLogsEnabled(enable_tunnel_logs_arg.getValue());
-    radio_interface.Run();
+    primary_interface = primary.get();
+    radio_interface = std::move(primary);
   } else if (secondary_arg.getValue()) {
-    nerfnet::SecondaryRadioInterface radio_interface(
-        ce_pin_arg.getValue(), tunnel_fd,
+    radio_interface = std::make_unique<nerfnet::SecondaryRadioInterface>(
+        *radio, *tunnel,
         primary_addr_arg.getValue(), secondary_addr_arg.getValue(),
         channel_arg.getValue());
-    radio_interface.SetTunnelLogsEnabled(enable_tunnel_logs_arg.getValue());
-    radio_interface.Run();
   } else {
     CHECK(false, "Primary or secondary mode must be enabled");
   }
 
+  radio_interface->SetTunnelLogsEnabled(enable_tunnel_logs_arg.getValue());
+  radio_interface->SetAckFilterEnabled(ack_filter_arg.getValue());
+  radio_interface->SetInterleaveMaxSize(interleave_size_arg.getValue());
+
+  nerfnet::DeliveryClassifier delivery_classifier;
+  for (const auto& rule : best_effort_arg.getValue()) {
+    CHECK(delivery_classifier.AddRule(rule),
+        "Invalid best-effort rule '%s'", rule.c_str());
+  }
+
+  for (const auto& rule : spool_rule_arg.getValue()) {
+    CHECK(delivery_classifier.AddSpoolRule(rule),
+        "Invalid spool rule '%s'", rule.c_str());
+  }
+
+  radio_interface->SetDeliveryClassifier(delivery_classifier);
+  if (spool_arg.isSet()) {
+    radio_interface->EnableSpool(spool_arg.getValue(),
+        static_cast<size_t>(spool_size));
+  }
+
+  if (!key.empty()) {
+    radio_interface->SetEncryptionKey(key);
+  }
+
+  if (!handoff_state.empty()) {
+    CHECK(radio_interface->RestoreState(handoff_state),
+        "Failed to restore the session taken over");
+  }
+
+  if (!pcap_tunnel) {
+    uint16_t tunnel_mtu = tunnel_mtu_arg.isSet()
+        ? tunnel_mtu_arg.getValue() : radio_interface->GetChunkAlignedMtu();
+    if (tunnel_mtu < nerfnet::kIPv6MinMtu) {
+      LOGW("IPv6 is disabled on interfaces with an MTU below 1280 bytes");
+    }
+
+    SetInterfaceMtu(interface_name_arg.getValue(), tunnel_mtu);
+    radio_interface->SetTunnelMtu(tunnel_mtu);
+    LOGI("tunnel '%s' mtu set to %u", interface_name_arg.getValue().c_str(),
+         tunnel_mtu);
+  }
+
+  std::unique_ptr<nerfnet::ControlSocket> control_socket;
+  if (control_socket_arg.isSet()) {
+    control_socket = std::make_unique<nerfnet::ControlSocket>(
+        control_socket_arg.getValue(), *radio_interface);
+    LOGI("control socket listening at '%s'",
+         control_socket_arg.getValue().c_str());
+  }
+
+  std::unique_ptr<nerfnet::DatagramSocket> datagram_socket;
+  if (datagram_socket_arg.isSet()) {
+    datagram_socket = std::make_unique<nerfnet::DatagramSocket>(
+        datagram_socket_arg.getValue(), *radio_interface);
+    LOGI("datagram socket listening at '%s'",
+         datagram_socket_arg.getValue().c_str());
+  }
+
+  if (capture_pcapng_arg.isSet()) {
+    radio_interface->EnableCapture(capture_pcapng_arg.getValue());
+    LOGI("capturing to '%s'", capture_pcapng_arg.getValue().c_str());
+  }
+
+  radio_interface->SetTurnaroundReportIntervalUs(
+      static_cast<uint64_t>(turnaround_report_s_arg.getValue()) * 1000000);
+  if (realtime_priority_arg.isSet()) {
+    radio_interface->EnableRealtime(radio_cpu_arg.getValue(),
+        tunnel_cpu_arg.getValue(), realtime_priority_arg.getValue());
+    LOGI("realtime mode enabled with priority %d",
+         realtime_priority_arg.getValue());
+  }
+
+  bool link_probes = measure_s_arg.isSet() || probe_interval_ms_arg.isSet();
+  CHECK(!link_probes || primary_interface != nullptr,
+      "Link probes require the polled primary mode");
+  if (measure_s_arg.isSet()) {
+    primary_interface->MeasureLink(
+        static_cast<uint64_t>(measure_s_arg.getValue()) * 1000000);
+    return 0;
+  } else if (probe_interval_ms_arg.isSet()) {
+    primary_interface->SetLinkProbeIntervalUs(
+        static_cast<uint64_t>(probe_interval_ms_arg.getValue()) * 1000,
+        static_cast<uint64_t>(probe_report_s_arg.getValue()) * 1000000);
+  }
+
+  std::unique_ptr<nerfnet::HandoffSocket> handoff_socket;
+  if (handoff_socket_arg.isSet()) {
+    handoff_socket = std::make_unique<nerfnet::HandoffSocket>(
+        handoff_socket_arg.getValue(), *radio_interface);
+    LOGI("handoff socket listening at '%s'",
+         handoff_socket_arg.getValue().c_str());
+  }
+
+  radio_interface->Run();
+  if (handoff_socket != nullptr && handoff_socket->IsRequested()) {
+    CHECK(handoff_socket->Complete(tunnel_fd), "Handoff failed");
+  }
+
   return 0;
 }
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/nrf24_radio.h"
+
+#include <algorithm>
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+
+Nrf24Radio::Nrf24Radio(SpiDevice& spi)
+    : spi_(spi),
+      batch_size_(0),
+      status_(0),
+      data_rate_(RF24_1MBPS),
+      pa_level_(RF24_PA_MAX) {
+  registers_.fill(-1);
+  spi_.SetChipEnable(false);
+
+  // Reset the features used by the link to a known state.
+  WriteRegister(kRegisterConfig, kConfigEnableCrc | kConfigPowerUp);
+  WriteRegister(kRegisterEnableAutoAck, 0x3f);
+  WriteRegister(kRegisterSetupAddrWidth, kAddressSize - 2);
+  WriteRegister(kRegisterFeature,
+      kFeatureDynamicPayload | kFeatureDynamicAck);
+  WriteRegister(kRegisterDynamicPayload, 0x3f);
+
+  UpdateSetup();
+  QueueTransfer(kCommandFlushTx, 1);
+  QueueTransfer(kCommandFlushRx, 1);
+  WriteRegister(kRegisterStatus,
+      kStatusRxReady | kStatusTxSent | kStatusMaxRetries);
+  Flush();
+  SleepUs(kPowerUpDelayUs);
+  CHECK(ReadRegister(kRegisterSetupAddrWidth) == kAddressSize - 2,
+      "NRF24L01 is unavailable");
+}
+
+void Nrf24Radio::SetChannel(uint8_t channel) {
+  WriteRegister(kRegisterChannel, channel);
+}
+
+void Nrf24Radio::SetDataRate(rf24_datarate_e data_rate) {
+  data_rate_ = data_rate;
+  UpdateSetup();
+}
+
+void Nrf24Radio::SetPALevel(rf24_pa_dbm_e pa_level) {
+  pa_level_ = pa_level;
+  UpdateSetup();
+}
+
+void Nrf24Radio::SetRetries(uint8_t delay, uint8_t count) {
+  WriteRegister(kRegisterSetupRetries,
+      ((delay & 0x0f) << 4) | (count & 0x0f));
+}
+
+void Nrf24Radio::OpenWritingPipe(const uint8_t* addr) {
+  // Pipe 0 receives the acknowledgements for transmitted packets.
+  WriteRegister(kRegisterRxAddrP0, addr, kAddressSize);
+  WriteRegister(kRegisterTxAddr, addr, kAddressSize);
+}
+
+void Nrf24Radio::OpenReadingPipe(uint8_t pipe, const uint8_t* addr) {
+  CHECK(pipe > 0 && pipe < 6, "Invalid reading pipe %u", pipe);
+
+  // Pipes 2 to 5 share all but the first address byte with pipe 1.
+  WriteRegister(kRegisterRxAddrP0 + pipe, addr,
+      (pipe == 1) ? kAddressSize : 1);
+  int16_t enabled = registers_[kRegisterEnableRxAddr];
+  WriteRegister(kRegisterEnableRxAddr,
+      ((enabled < 0) ? 0x01 : enabled) | (1 << pipe));
+}
+
+void Nrf24Radio::StartListening() {
+  WriteRegister(kRegisterConfig,
+      kConfigEnableCrc | kConfigPowerUp | kConfigPrimaryRx);
+  WriteRegister(kRegisterStatus,
+      kStatusRxReady | kStatusTxSent | kStatusMaxRetries);
+  Flush();
+  spi_.SetChipEnable(true);
+}
+
+void Nrf24Radio::StopListening() {
+  // The mode change is sent along with the next transfer.
+  spi_.SetChipEnable(false);
+  WriteRegister(kRegisterConfig, kConfigEnableCrc | kConfigPowerUp);
+}
+
+bool Nrf24Radio::Write(const uint8_t* data, size_t size) {
+  return Transmit(kCommandWritePayload, data, size);
+}
+
+bool Nrf24Radio::WriteNoAck(const uint8_t* data, size_t size) {
+  return Transmit(kCommandWritePayloadNoAck, data, size);
+}
+
+bool Nrf24Radio::TxStandBy() {
+  // Writes complete before returning, so the transmit FIFO is always empty.
+  return true;
+}
+
+bool Nrf24Radio::TestCarrier() {
+  return (ReadRegister(kRegisterReceivedPower) & 0x01) != 0;
+}
+
+bool Nrf24Radio::Available() {
+  QueueTransfer(kCommandNop, 1);
+  Flush();
+  return (status_ & kStatusRxPipeMask) != kStatusRxPipeMask;
+}
+
+size_t Nrf24Radio::Read(uint8_t* data, size_t size) {
+  // The width is read in the same operation as the payload. Reading past the
+  // end of a shorter payload is harmless.
+  Flush();
+  QueueTransfer(kCommandReadPayloadWidth, 2);
+  QueueTransfer(kCommandReadPayload, 1 + kPayloadSize);
+  WriteRegister(kRegisterStatus, kStatusRxReady);
+  Flush();
+
+  size_t width = batch_[0].data[1];
+  if (width > kPayloadSize) {
+    // The datasheet requires flushing the FIFO after a corrupt width.
+    QueueTransfer(kCommandFlushRx, 1);
+    Flush();
+    return 0;
+  }
+
+  const uint8_t* payload = batch_[1].data + 1;
+  size = std::min(size, width);
+  std::copy(payload, payload + size, data);
+  return size;
+}
+
+SpiDevice::Transfer& Nrf24Radio::QueueTransfer(uint8_t command, size_t size) {
+  if (batch_size_ == batch_.size()) {
+    Flush();
+  }
+
+  auto& transfer = batch_[batch_size_++];
+  transfer.data[0] = command;
+  std::fill(transfer.data + 1, transfer.data + size, kCommandNop);
+  transfer.size = size;
+  return transfer;
+}
+
+void Nrf24Radio::WriteRegister(uint8_t reg, uint8_t value) {
+  // Flags are cleared by writing them to STATUS, so it is never cached.
+  if (reg != kRegisterStatus) {
+    if (registers_[reg] == value) {
+      return;
+    }
+
+    registers_[reg] = value;
+  }
+
+  auto& transfer = QueueTransfer(kCommandWriteRegister | reg, 2);
+  transfer.data[1] = value;
+}
+
+void Nrf24Radio::WriteRegister(uint8_t reg, const uint8_t* data,
+    size_t size) {
+  auto& transfer = QueueTransfer(kCommandWriteRegister | reg, 1 + size);
+  std::copy(data, data + size, transfer.data + 1);
+}
+
+bool Nrf24Radio::Transmit(uint8_t command, const uint8_t* data,
+                          size_t size) {
+  size = std::min(size, kPayloadSize);
+  auto& transfer = QueueTransfer(command, 1 + size);
+  std::copy(data, data + size, transfer.data + 1);
+  Flush();
+
+  spi_.SetChipEnable(true);
+  uint64_t start_us = TimeNowUs();
+  uint64_t min_tx_time_us = GetMinTxTimeUs(size);
+  while (TimeNowUs() - start_us < min_tx_time_us) {}
+  do {
+    QueueTransfer(kCommandNop, 1);
+    Flush();
+  } while (!(status_ & (kStatusTxSent | kStatusMaxRetries))
+      && TimeNowUs() - start_us < kTxTimeoutUs);
+  spi_.SetChipEnable(false);
+
+  bool sent = (status_ & kStatusTxSent) != 0;
+  WriteRegister(kRegisterStatus, kStatusTxSent | kStatusMaxRetries);
+  if (!sent) {
+    QueueTransfer(kCommandFlushTx, 1);
+  }
+
+  Flush();
+  return sent;
+}
+
+uint8_t Nrf24Radio::ReadRegister(uint8_t reg) {
+  Flush();
+  QueueTransfer(kCommandReadRegister | reg, 2);
+  Flush();
+  return batch_[0].data[1];
+}
+
+void Nrf24Radio::Flush() {
+  if (batch_size_ == 0) {
+    return;
+  }
+
+  if (spi_.TransferBatch(batch_.data(), batch_size_)) {
+    status_ = batch_[batch_size_ - 1].data[0];
+  }
+
+  batch_size_ = 0;
+}
+
+void Nrf24Radio::UpdateSetup() {
+  uint8_t setup = (pa_level_ & 0x03) << 1;
+  if (data_rate_ == RF24_250KBPS) {
+    setup |= kSetupDataRateLow;
+  } else if (data_rate_ == RF24_2MBPS) {
+    setup |= kSetupDataRateHigh;
+  }
+
+  WriteRegister(kRegisterSetup, setup);
+}
+
+uint64_t Nrf24Radio::GetMinTxTimeUs(size_t size) const {
+  // The preamble, address, packet control field, payload and CRC, plus the
+  // time for the transmitter to settle.
+  uint64_t bits = (1 + kAddressSize + 2 + size + 1) * 8;
+  if (data_rate_ == RF24_250KBPS) {
+    bits *= 4;
+  } else if (data_rate_ == RF24_2MBPS) {
+    bits /= 2;
+  }
+
+  return bits + 130;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_NRF24_RADIO_H_
+#define NERFNET_NET_NRF24_RADIO_H_
+
+#include <array>
+
+#include "nerfnet/net/radio.h"
+#include "nerfnet/net/spi_device.h"
+
+namespace nerfnet {
+
+// A lean NRF24L01 driver. Register writes are cached so that redundant
+// writes are skipped, and queued so that they are sent in the same SPI
+// operation as the next payload transfer. The STATUS byte returned by every
+// transfer is used in place of reading status registers.
+class Nrf24Radio : public Radio {
+ public:
+  // Starts the radio on the supplied SPI device. Quits and logs the error if
+  // the radio is unavailable.
+  explicit Nrf24Radio(SpiDevice& spi);
+
+  // Radio implementation.
+  void SetChannel(uint8_t channel) final;
+  void SetDataRate(rf24_datarate_e data_rate) final;
+  void SetPALevel(rf24_pa_dbm_e pa_level) final;
+  void SetRetries(uint8_t delay, uint8_t count) final;
+  void OpenWritingPipe(const uint8_t* addr) final;
+  void OpenReadingPipe(uint8_t pipe, const uint8_t* addr) final;
+  void StartListening() final;
+  void StopListening() final;
+  bool Write(const uint8_t* data, size_t size) final;
+  bool WriteNoAck(const uint8_t* data, size_t size) final;
+  bool TxStandBy() final;
+  bool TestCarrier() final;
+  bool Available() final;
+  size_t Read(uint8_t* data, size_t size) final;
+
+ private:
+  // The largest payload size.
+  static constexpr size_t kPayloadSize = 32;
+
+  // The size of addresses.
+  static constexpr size_t kAddressSize = 3;
+
+  // The largest number of transfers queued before they are sent.
+  static constexpr size_t kMaxBatchSize = 8;
+
+  // The time for the oscillator to start after powering up.
+  static constexpr uint64_t kPowerUpDelayUs = 5000;
+
+  // The time to wait for a transmission to complete before giving up.
+  static constexpr uint64_t kTxTimeoutUs = 100000;
+
+  // Commands.
+  static constexpr uint8_t kCommandReadRegister = 0x00;
+  static constexpr uint8_t kCommandWriteRegister = 0x20;
+  static constexpr uint8_t kCommandReadPayloadWidth = 0x60;
+  static constexpr uint8_t kCommandReadPayload = 0x61;
+  static constexpr uint8_t kCommandWritePayload = 0xa0;
+  static constexpr uint8_t kCommandWritePayloadNoAck = 0xb0;
+  static constexpr uint8_t kCommandFlushTx = 0xe1;
+  static constexpr uint8_t kCommandFlushRx = 0xe2;
+  static constexpr uint8_t kCommandNop = 0xff;
+
+  // Registers.
+  static constexpr uint8_t kRegisterConfig = 0x00;
+  static constexpr uint8_t kRegisterEnableAutoAck = 0x01;
+  static constexpr uint8_t kRegisterEnableRxAddr = 0x02;
+  static constexpr uint8_t kRegisterSetupAddrWidth = 0x03;
+  static constexpr uint8_t kRegisterSetupRetries = 0x04;
+  static constexpr uint8_t kRegisterChannel = 0x05;
+  static constexpr uint8_t kRegisterSetup = 0x06;
+  static constexpr uint8_t kRegisterStatus = 0x07;
+  static constexpr uint8_t kRegisterReceivedPower = 0x09;
+  static constexpr uint8_t kRegisterRxAddrP0 = 0x0a;
+  static constexpr uint8_t kRegisterRxAddrP1 = 0x0b;
+  static constexpr uint8_t kRegisterTxAddr = 0x10;
+  static constexpr uint8_t kRegisterDynamicPayload = 0x1c;
+  static constexpr uint8_t kRegisterFeature = 0x1d;
+  static constexpr uint8_t kRegisterCount = 0x1e;
+
+  // CONFIG register bits.
+  static constexpr uint8_t kConfigEnableCrc = 0x08;
+  static constexpr uint8_t kConfigPowerUp = 0x02;
+  static constexpr uint8_t kConfigPrimaryRx = 0x01;
+
+  // STATUS register bits.
+  static constexpr uint8_t kStatusRxReady = 0x40;
+  static constexpr uint8_t kStatusTxSent = 0x20;
+  static constexpr uint8_t kStatusMaxRetries = 0x10;
+  static constexpr uint8_t kStatusRxPipeMask = 0x0e;
+
+  // FEATURE register bits.
+  static constexpr uint8_t kFeatureDynamicPayload = 0x04;
+  static constexpr uint8_t kFeatureDynamicAck = 0x01;
+
+  // RF_SETUP register bits.
+  static constexpr uint8_t kSetupDataRateLow = 0x20;
+  static constexpr uint8_t kSetupDataRateHigh = 0x08;
+
+  // The SPI device the radio is attached to.
+  SpiDevice& spi_;
+
+  // The last known value of each single byte register, or -1 if unknown.
+  std::array<int16_t, kRegisterCount> registers_;
+
+  // The queued transfers.
+  std::array<SpiDevice::Transfer, kMaxBatchSize> batch_;
+  size_t batch_size_;
+
+  // The STATUS byte returned by the last transfer.
+  uint8_t status_;
+
+  // The data rate and transmit power, which share a register.
+  rf24_datarate_e data_rate_;
+  rf24_pa_dbm_e pa_level_;
+
+  // Queues a transfer and returns it to be populated. The queue is sent
+  // first if it is full.
+  SpiDevice::Transfer& QueueTransfer(uint8_t command, size_t size);
+
+  // Queues a write of a single byte register, skipping it if the register
+  // already has the value.
+  void WriteRegister(uint8_t reg, uint8_t value);
+
+  // Queues a write of a multi-byte register.
+  void WriteRegister(uint8_t reg, const uint8_t* data, size_t size);
+
+  // Writes a payload with the supplied command and waits for it to be sent.
+  bool Transmit(uint8_t command, const uint8_t* data, size_t size);
+
+  // Reads a single byte register.
+  uint8_t ReadRegister(uint8_t reg);
+
+  // Sends the queued transfers and updates the status.
+  void Flush();
+
+  // Updates the RF_SETUP register for the current data rate and power.
+  void UpdateSetup();
+
+  // Returns the minimum time taken to transmit a payload of the supplied
+  // size. The status is not polled before this has passed.
+  uint64_t GetMinTxTimeUs(size_t size) const;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_NRF24_RADIO_H_
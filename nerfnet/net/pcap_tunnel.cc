@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/pcap_tunnel.h"
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+
+PcapTunnel::PcapTunnel(const std::string& replay_path, double replay_speed,
+                       const std::string& offered_path,
+                       const std::string& record_path)
+    : replay_speed_(replay_speed),
+      first_capture_us_(0),
+      first_offered_us_(0),
+      replayed_frames_(0),
+      replayed_bytes_(0) {
+  CHECK(replay_speed >= 0.0, "Replay speed must not be negative");
+  if (!replay_path.empty()) {
+    replay_ = std::make_unique<PcapReader>(replay_path);
+  }
+
+  if (!offered_path.empty()) {
+    offered_ = std::make_unique<PcapWriter>(offered_path);
+  }
+
+  if (!record_path.empty()) {
+    record_ = std::make_unique<PcapWriter>(record_path);
+  }
+}
+
+bool PcapTunnel::Read(std::vector<uint8_t>& frame) {
+  PcapPacket packet;
+  if (replay_ == nullptr || !replay_->ReadPacket(packet)) {
+    if (replay_ != nullptr) {
+      uint64_t duration_us = TimeNowUs() - first_offered_us_;
+      LOGI("Replay complete: %llu frames, %llu bytes in %llu us",
+          static_cast<unsigned long long>(replayed_frames_),
+          static_cast<unsigned long long>(replayed_bytes_),
+          static_cast<unsigned long long>(duration_us));
+      replay_.reset();
+    }
+
+    SleepUs(kIdleReadTimeoutUs);
+    return false;
+  }
+
+  uint64_t now_us = TimeNowUs();
+  if (replayed_frames_ == 0) {
+    first_capture_us_ = packet.timestamp_us;
+    first_offered_us_ = now_us;
+  } else if (replay_speed_ > 0.0 && packet.timestamp_us > first_capture_us_) {
+    uint64_t offset_us = static_cast<uint64_t>(
+        (packet.timestamp_us - first_capture_us_) / replay_speed_);
+    uint64_t deadline_us = first_offered_us_ + offset_us;
+    if (deadline_us > now_us) {
+      SleepUs(deadline_us - now_us);
+    }
+  }
+
+  replayed_frames_++;
+  replayed_bytes_ += packet.data.size();
+  if (offered_ != nullptr) {
+    offered_->WritePacket(RealTimeNowUs(),
+        packet.data.data(), packet.data.size());
+  }
+
+  frame = std::move(packet.data);
+  return true;
+}
+
+bool PcapTunnel::Write(const std::vector<uint8_t>& frame) {
+  if (record_ != nullptr) {
+    record_->WritePacket(RealTimeNowUs(), frame.data(), frame.size());
+  }
+
+  return true;
+}
+
+}  // namespace nerfnet
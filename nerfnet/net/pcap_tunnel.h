@@ -0,0 +1,77 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_PCAP_TUNNEL_H_
+#define NERFNET_NET_PCAP_TUNNEL_H_
+
+#include <memory>
+#include <string>
+
+#include "nerfnet/net/tunnel.h"
+#include "nerfnet/util/pcap.h"
+
+namespace nerfnet {
+
+// A tunnel that replays IP packets from a capture file into the link and
+// records packets delivered by the link to a capture file. This allows
+// reproducing traffic patterns against a build without a network stack.
+class PcapTunnel : public Tunnel {
+ public:
+  // Setup the tunnel. Each path may be empty to disable that function.
+  //
+  // replay_path: the capture to offer to the link.
+  // replay_speed: the factor to speed up inter-arrival times by. A speed of
+  //     zero offers packets as fast as the link accepts them.
+  // offered_path: records each replayed packet as it is offered to the link.
+  // record_path: records each packet delivered by the link.
+  //
+  // Timestamps in recorded captures use the wall clock so that offered and
+  // delivered captures from two systems with synchronized clocks can be
+  // compared.
+  PcapTunnel(const std::string& replay_path, double replay_speed,
+             const std::string& offered_path, const std::string& record_path);
+
+  // Tunnel implementation. Once the replay is complete, reads wait for
+  // kIdleReadTimeoutUs and return no frame, like an idle network device, so
+  // that the reading thread can be stopped.
+  bool Read(std::vector<uint8_t>& frame) final;
+  bool Write(const std::vector<uint8_t>& frame) final;
+
+ private:
+  // The time to wait on each read once there are no frames to replay.
+  static constexpr uint64_t kIdleReadTimeoutUs = 100000;
+
+  // The capture files.
+  std::unique_ptr<PcapReader> replay_;
+  std::unique_ptr<PcapWriter> offered_;
+  std::unique_ptr<PcapWriter> record_;
+
+  // The replay speed factor.
+  const double replay_speed_;
+
+  // The capture timestamp of the first replayed packet and the local time
+  // that it was offered at.
+  uint64_t first_capture_us_;
+  uint64_t first_offered_us_;
+
+  // Statistics for the replayed packets.
+  uint64_t replayed_frames_;
+  uint64_t replayed_bytes_;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_PCAP_TUNNEL_H_
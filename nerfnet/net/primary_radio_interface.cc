@@ -16,6 +16,7 @@
 
 #include "nerfnet/net/primary_radio_interface.h"
 
+#include <sys/random.h>
 #include <unistd.h>
 
 #include "nerfnet/util/log.h"
@@ -25,36 +26,41 @@
 namespace nerfnet {
 
 PrimaryRadioInterface::PrimaryRadioInterface(
-    uint16_t ce_pin, int tunnel_fd,
+    Radio& radio, Tunnel& tunnel,
     uint32_t primary_addr, uint32_t secondary_addr, uint8_t channel,
     uint64_t poll_interval_us)
-    : RadioInterface(ce_pin, tunnel_fd, primary_addr, secondary_addr, channel),
-      poll_interval_us_(poll_interval_us),
-      current_poll_interval_us_(poll_interval_us_),
-      connection_reset_required_(true) {
-  uint8_t writing_addr[5] = {
-    static_cast<uint8_t>(primary_addr),
-    static_cast<uint8_t>(primary_addr >> 8),
-    static_cast<uint8_t>(primary_addr >> 16),
-    static_cast<uint8_t>(primary_addr >> 24),
-    0,
-  };
-
-  uint8_t reading_addr[5] = {
-    static_cast<uint8_t>(secondary_addr),
-    static_cast<uint8_t>(secondary_addr >> 8),
-    static_cast<uint8_t>(secondary_addr >> 16),
-    static_cast<uint8_t>(secondary_addr >> 24),
-    0,
-  };
-
-  radio_.openWritingPipe(writing_addr);
-  radio_.openReadingPipe(kPipeId, reading_addr);
+    : RadioInterface(radio, tunnel, primary_addr, secondary_addr, channel,
+                     /*is_primary=*/true),
+      receive_timeout_us_(kDefaultReceiveTimeoutUs),
+      failures_before_recovery_(kDefaultFailuresBeforeRecovery),
+      poll_fail_count_(0),
+      current_poll_interval_us_(poll_interval_us),
+      connection_reset_required_(true),
+      resume_required_(false),
+      outage_start_us_(0),
+      link_probe_interval_us_(0),
+      next_link_probe_us_(0),
+      link_probe_report_interval_us_(0),
+      link_probe_report_start_us_(0),
+      link_probe_sequence_(0),
+      applied_radio_config_(startup_radio_config_),
+      radio_config_in_doubt_(false) {
+  poll_interval_us_ = poll_interval_us;
+
+  uint8_t writing_addr[5];
+  GetAddressBytes(primary_addr, writing_addr);
+  uint8_t reading_addr[5];
+  GetAddressBytes(secondary_addr, reading_addr);
+
+  radio_.OpenWritingPipe(writing_addr);
+  radio_.OpenReadingPipe(kPipeId, reading_addr);
 }
 
 void PrimaryRadioInterface::Run() {
-  while (1) {
+  while (running_) {
     SleepUs(current_poll_interval_us_);
+    ApplyPendingSettings();
+    auto pending_radio_config = GetPendingRadioConfig();
     std::lock_guard<std::mutex> lock(read_buffer_mutex_);
     if (connection_reset_required_) {
       LOGI("Resetting connection");
@@ -64,22 +70,81 @@ void PrimaryRadioInterface::Run() {
       } else {
         LOGI("Connection reset successfully");
         connection_reset_required_ = false;
+        resume_required_ = false;
+        HandleTransactionSuccess();
+      }
+    } else if (resume_required_) {
+      if (ConnectionResume()) {
+        LOGI("Connection resumed successfully");
+        resume_required_ = false;
+        HandleTransactionSuccess();
+      } else {
+        HandleTransactionFailure();
+      }
+    } else if (pending_radio_config.has_value()) {
+      if (ConnectionConfigure(pending_radio_config.value())) {
+        HandleTransactionSuccess();
+      } else {
+        HandleTransactionFailure();
+      }
+    } else if (link_probe_interval_us_ != 0
+        && TimeNowUs() >= next_link_probe_us_) {
+      next_link_probe_us_ = TimeNowUs() + link_probe_interval_us_;
+      if (PerformBackgroundLinkProbe()) {
+        HandleTransactionSuccess();
+      } else {
+        HandleTransactionFailure();
       }
     } else if (PerformTunnelTransfer()) {
-      poll_fail_count_ = 0;
-      current_poll_interval_us_ = poll_interval_us_;
+      HandleTransactionSuccess();
     } else {
       HandleTransactionFailure();
     }
+
+    NotifyTunnelWriter();
+  }
+}
+
+void PrimaryRadioInterface::MeasureLink(uint64_t duration_us) {
+  LOGI("Resetting connection to measure the link");
+  while (running_) {
+    {
+      std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+      if (ConnectionReset()) {
+        break;
+      }
+    }
+
+    SleepUs(kMinProbeIntervalUs);
   }
+
+  size_t min_size = GetMinProbePacketSize();
+  uint64_t phase_us = duration_us / 3;
+  MeasurePhase("Latency", phase_us, min_size, min_size, poll_interval_us_);
+  MeasurePhase("Downlink", phase_us, kMaxPacketSize, min_size, 0);
+  MeasurePhase("Uplink", phase_us, min_size, kMaxPacketSize, 0);
+}
+
+bool PrimaryRadioInterface::RequestRadioConfig(const RadioConfig& config) {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  if (config == radio_config_) {
+    pending_radio_config_.reset();
+  } else {
+    pending_radio_config_ = config;
+  }
+
+  return true;
 }
 
 bool PrimaryRadioInterface::ConnectionReset() {
-  next_id_ = 1;
-  last_ack_id_.reset();
-  frame_buffer_.clear();
+  uint32_t session_token = 0;
+  while (session_token == 0) {
+    CHECK(getrandom(&session_token, sizeof(session_token), 0)
+        == sizeof(session_token), "Failed to generate session token");
+  }
 
-  std::vector<uint8_t> request(kMaxPacketSize, 0x00);
+  ResetSession(session_token);
+  auto request = BuildControlPacket(ControlType::Reset);
   auto result = Send(request);
   if (result != RequestResult::Success) {
     LOGE("Failed to send tunnel reset request");
@@ -87,13 +152,92 @@ bool PrimaryRadioInterface::ConnectionReset() {
   }
 
   std::vector<uint8_t> response(kMaxPacketSize, 0x00);
-  result = Receive(response, /*timeout_us=*/100000);
+  result = Receive(response, kProbeTimeoutUs);
   if (result != RequestResult::Success) {
     LOGE("Failed to receive tunnel reset response");
     return false;
   }
 
-  return response[0] == 0x00;
+  auto primary_salt = LinkCipher::GetSalt(request);
+  if (!OpenControlPacket(response, primary_salt)
+      || response[kControlTypeOffset]
+          != static_cast<uint8_t>(ControlType::Reset)) {
+    LOGE("Invalid tunnel reset response");
+    return false;
+  }
+
+  if (cipher_ != nullptr) {
+    cipher_->StartSession(primary_salt, LinkCipher::GetSalt(response));
+  }
+
+  return true;
+}
+
+bool PrimaryRadioInterface::ConnectionResume() {
+  auto request = BuildControlPacket(ControlType::Resume);
+  auto result = Send(request);
+  if (result != RequestResult::Success) {
+    LOGE("Failed to send tunnel resume request");
+    return false;
+  }
+
+  std::vector<uint8_t> response(kMaxPacketSize, 0x00);
+  result = Receive(response, kProbeTimeoutUs);
+  if (result != RequestResult::Success) {
+    LOGE("Failed to receive tunnel resume response");
+    return false;
+  }
+
+  if (!OpenControlPacket(response, LinkCipher::GetSalt(request))) {
+    LOGE("Invalid tunnel resume response");
+    return false;
+  }
+
+  if (response[kControlTypeOffset]
+          != static_cast<uint8_t>(ControlType::Resume)
+      || !ValidateResumeState(response)) {
+    LOGW("Tunnel resume rejected");
+    connection_reset_required_ = true;
+    return false;
+  }
+
+  return true;
+}
+
+bool PrimaryRadioInterface::ConnectionConfigure(const RadioConfig& config) {
+  auto request = BuildControlPacket(ControlType::Configure, {}, config);
+  auto result = Send(request);
+  if (result != RequestResult::Success) {
+    LOGE("Failed to send radio configure request");
+    return false;
+  }
+
+  // The secondary switches once it has received the request, even if the
+  // response is lost.
+  radio_config_in_doubt_ = true;
+  std::vector<uint8_t> response(kMaxPacketSize, 0x00);
+  result = Receive(response, kProbeTimeoutUs);
+  if (result != RequestResult::Success) {
+    LOGE("Failed to receive radio configure response");
+    return false;
+  }
+
+  RadioConfig response_config;
+  if (!OpenControlPacket(response, LinkCipher::GetSalt(request))
+      || response[kControlTypeOffset]
+          != static_cast<uint8_t>(ControlType::Configure)
+      || GetSessionToken(response) != session_token_
+      || !GetConfigurePacketConfig(response, response_config)
+      || response_config != config) {
+    LOGE("Invalid radio configure response");
+    return false;
+  }
+
+  LOGI("Switching to channel %u at data rate %u", config.channel,
+      config.data_rate);
+  applied_radio_config_ = config;
+  ApplyRadioConfig(config);
+  return true;
 }
 
 bool PrimaryRadioInterface::PerformTunnelTransfer() {
@@ -103,18 +247,12 @@ bool PrimaryRadioInterface::PerformTunnelTransfer() {
     tunnel.ack_id = last_ack_id_.value();
   }
 
-  tunnel.bytes_left = 0;
-  if (!read_buffer_.empty()) {
-    auto& frame = read_buffer_.front();
-    size_t transfer_size = GetTransferSize(frame);
-    tunnel.payload = {frame.begin(), frame.begin() + transfer_size};
-    tunnel.bytes_left = std::min(frame.size(), static_cast<size_t>(UINT8_MAX));
-  }
-
+  PopulateTxPayload(tunnel);
   std::vector<uint8_t> request;
   CHECK(EncodeTunnelTxRxPacket(tunnel, request),
       "Failed to encode tunnel packet");
 
+  uint64_t start_us = TimeNowUs();
   auto result = Send(request);
   if (result != RequestResult::Success) {
     LOGE("Failed to send network tunnel txrx request");
@@ -122,12 +260,13 @@ bool PrimaryRadioInterface::PerformTunnelTransfer() {
   }
 
   std::vector<uint8_t> response(kMaxPacketSize);
-  result = Receive(response, /*timeout_us=*/100000);
+  result = Receive(response, receive_timeout_us_);
   if (result != RequestResult::Success) {
     LOGE("Failed to receive network tunnel txrx request");
     return false;
   }
-  
+
+  RecordTurnaround(start_us);
   if (!DecodeTunnelTxRxPacket(response, tunnel)) {
     return false;
   }
@@ -145,37 +284,188 @@ bool PrimaryRadioInterface::PerformTunnelTransfer() {
     success = false;
   } else {
     AdvanceID();
-    if (!read_buffer_.empty()) {
-      auto& frame = read_buffer_.front();
-      frame.erase(frame.begin(), frame.begin() + GetTransferSize(frame));
-      if (frame.empty()) {
-        read_buffer_.pop_front();
-      }
-    }
+    AdvanceTxPayload();
   }
 
-  if (!ValidateID(tunnel.id.value())) {
+  if (!CanReceivePayload(tunnel)) {
+    // The tunnel writer is behind, so the chunk is left unacknowledged.
+  } else if (!ValidateID(tunnel.id.value())) {
     LOGE("Received non-sequential packet");
     success = false;
   } else if (!tunnel.payload.empty()) {
-    frame_buffer_.insert(frame_buffer_.end(),
-        tunnel.payload.begin(), tunnel.payload.end());
-    if (tunnel.bytes_left <= kMaxPayloadSize) {
-      WriteTunnel();
-    }
+    ReceivePayload(tunnel);
+  }
+
+  return success;
+}
+
+bool PrimaryRadioInterface::PerformLinkProbe(size_t request_size,
+                                         size_t response_size) {
+  uint16_t sequence = link_probe_sequence_++;
+  std::vector<uint8_t> request(request_size, 0x00);
+  uint64_t start_us = TimeNowUs();
+  SetProbeField(request, kProbeSequenceOffset, sequence, 2);
+  SetProbeField(request, kProbePrimarySentOffset,
+      static_cast<uint32_t>(start_us), 4);
+  request[kProbeResponseSizeOffset] = static_cast<uint8_t>(response_size);
+  SealProbePacket(request);
+  auto result = Send(request);
+  if (result != RequestResult::Success) {
+    LOGE("Failed to send probe");
+    link_probe_stats_.RecordUnanswered();
+    return false;
+  }
+
+  std::vector<uint8_t> response(kMaxPacketSize);
+  result = Receive(response, kProbeTimeoutUs);
+  uint64_t end_us = TimeNowUs();
+  if (result != RequestResult::Success) {
+    LOGE("Failed to receive probe response");
+    link_probe_stats_.RecordUnanswered();
+    return false;
+  }
+
+  if (!OpenProbePacket(response)
+      || GetProbeField(response, kProbeSequenceOffset, 2) != sequence) {
+    LOGE("Invalid probe response");
+    link_probe_stats_.RecordUnanswered();
+    return false;
+  }
+
+  LinkProbeStats::Times times;
+  times.primary_sent_us = static_cast<uint32_t>(start_us);
+  times.secondary_received_us =
+      GetProbeField(response, kProbeSecondaryReceivedOffset, 4);
+  times.secondary_sent_us =
+      GetProbeField(response, kProbeSecondarySentOffset, 4);
+  times.primary_received_us = static_cast<uint32_t>(end_us);
+  link_probe_stats_.RecordAnswered(sequence,
+      GetProbeField(response, kProbeReceivedCountOffset, 2), times);
+  return true;
+}
+
+bool PrimaryRadioInterface::PerformBackgroundLinkProbe() {
+  size_t min_size = GetMinProbePacketSize();
+  bool success = PerformLinkProbe(min_size, min_size);
+
+  uint64_t now_us = TimeNowUs();
+  if (link_probe_report_start_us_ == 0) {
+    link_probe_report_start_us_ = now_us;
+  } else if (link_probe_report_interval_us_ != 0 && now_us
+      - link_probe_report_start_us_ >= link_probe_report_interval_us_) {
+    link_probe_stats_.Log("Link probe");
+    link_probe_stats_.Reset();
+    link_probe_report_start_us_ = now_us;
   }
 
   return success;
 }
 
+void PrimaryRadioInterface::MeasurePhase(const char* name,
+    uint64_t duration_us, size_t request_size, size_t response_size,
+    uint64_t interval_us) {
+  link_probe_stats_.Reset();
+  uint64_t start_us = TimeNowUs();
+  while (running_ && TimeNowUs() - start_us < duration_us) {
+    if (interval_us != 0) {
+      SleepUs(interval_us);
+    }
+
+    PerformLinkProbe(request_size, response_size);
+  }
+
+  // Each probe stands in for a chunk of a frame.
+  double elapsed_s = (TimeNowUs() - start_us) / 1e6;
+  double downlink_chunks = link_probe_stats_.GetDownlinkDelivered() / elapsed_s;
+  double uplink_chunks = link_probe_stats_.GetUplinkDelivered() / elapsed_s;
+  link_probe_stats_.Log(name);
+  LOGI("%s: %.1f chunks/s downlink (%.1f kbps), %.1f chunks/s uplink "
+       "(%.1f kbps)", name,
+       downlink_chunks, downlink_chunks * max_payload_size_ * 8 / 1000,
+       uplink_chunks, uplink_chunks * max_payload_size_ * 8 / 1000);
+}
+
+void PrimaryRadioInterface::HandleTransactionSuccess() {
+  if (poll_fail_count_ >= failures_before_recovery_) {
+    LOGI("Link recovered after %llu us",
+        static_cast<unsigned long long>(TimeNowUs() - outage_start_us_));
+  }
+
+  // The secondary is using whichever config the radio is set to when it
+  // responds.
+  if (applied_radio_config_ != GetRadioConfig()) {
+    SetRadioConfig(applied_radio_config_);
+  }
+
+  radio_config_in_doubt_ = false;
+  poll_fail_count_ = 0;
+  current_poll_interval_us_ = poll_interval_us_;
+}
+
+bool PrimaryRadioInterface::SaveInterfaceState(std::vector<uint8_t>& state) {
+  return true;
+}
+
+bool PrimaryRadioInterface::RestoreInterfaceState(
+    const std::vector<uint8_t>& state) {
+  if (!state.empty()) {
+    return false;
+  }
+
+  applied_radio_config_ = GetRadioConfig();
+  if (session_token_ != 0) {
+    connection_reset_required_ = false;
+    resume_required_ = true;
+  }
+
+  return true;
+}
+
 void PrimaryRadioInterface::HandleTransactionFailure() {
+  if (poll_fail_count_ == 0) {
+    outage_start_us_ = TimeNowUs();
+  }
+
   poll_fail_count_++;
-  if (poll_fail_count_ > 10) {
-    if (current_poll_interval_us_ < 1000000) {
-      current_poll_interval_us_ *= 2;
+  if (poll_fail_count_ >= failures_before_recovery_) {
+    // Probe with bounded exponential backoff. Queued frames and the session
+    // are kept, so the link resumes where it left off once the secondary
+    // responds again.
+    current_poll_interval_us_ = std::min(
+        std::max(current_poll_interval_us_ * 2, kMinProbeIntervalUs),
+        std::max(max_backoff_us_.load(), poll_interval_us_.load()));
+    if (!connection_reset_required_) {
+      resume_required_ = true;
+    }
+  }
+
+  RadioConfig radio_config = GetRadioConfig();
+  if (radio_config != startup_radio_config_
+      && TimeNowUs() - outage_start_us_ > kRadioConfigRevertUs) {
+    // The secondary also falls back after the same time without requests.
+    // The config in use before the outage is requested again once the link
+    // is back.
+    LOGW("Reverting to the startup radio config");
+    if (!GetPendingRadioConfig().has_value()) {
+      RequestRadioConfig(radio_config);
+    }
+
+    SetRadioConfig(startup_radio_config_);
+    applied_radio_config_ = startup_radio_config_;
+    ApplyRadioConfig(applied_radio_config_);
+    radio_config_in_doubt_ = false;
+  } else if (radio_config_in_doubt_) {
+    // Alternate between the previous and requested configs until the
+    // secondary responds on one of them.
+    auto pending_radio_config = GetPendingRadioConfig();
+    if (applied_radio_config_ == radio_config
+        && pending_radio_config.has_value()) {
+      applied_radio_config_ = pending_radio_config.value();
     } else {
-      connection_reset_required_ = true;
+      applied_radio_config_ = radio_config;
     }
+
+    ApplyRadioConfig(applied_radio_config_);
   }
 }
 
@@ -19,6 +19,7 @@
 
 #include <optional>
 
+#include "nerfnet/net/link_probe_stats.h"
 #include "nerfnet/net/radio_interface.h"
 
 namespace nerfnet {
@@ -27,31 +28,135 @@ namespace nerfnet {
 class PrimaryRadioInterface : public RadioInterface {
  public:
   // Setup the primary radio link.
-  PrimaryRadioInterface(uint16_t ce_pin, int tunnel_fd,
+  PrimaryRadioInterface(Radio& radio, Tunnel& tunnel,
                         uint32_t primary_addr, uint32_t secondary_addr,
                         uint8_t channel, uint64_t poll_interval_us);
 
   // Runs the interface.
-  void Run();
+  void Run() final;
+
+  // Queues a change of the radio config to send to the secondary.
+  bool RequestRadioConfig(const RadioConfig& config) final;
+
+  // Sets the time to wait for a response to a TxRx request. Must be called
+  // before running the interface.
+  void SetReceiveTimeoutUs(uint64_t timeout_us) {
+    receive_timeout_us_ = timeout_us;
+  }
+
+  // Sets the number of consecutive failures before the link is considered
+  // down. Must be called before running the interface.
+  void SetFailuresBeforeRecovery(int failures) {
+    failures_before_recovery_ = failures;
+  }
+
+  // Sets the interval between probes of the link, which are sent in place of
+  // polls, and the interval to log the statistics of the probes over. Zero
+  // disables probing. Must be called before running the interface.
+  void SetLinkProbeIntervalUs(uint64_t interval_us,
+                              uint64_t report_interval_us) {
+    link_probe_interval_us_ = interval_us;
+    link_probe_report_interval_us_ = report_interval_us;
+  }
+
+  // Measures the link instead of running the interface and logs the results.
+  // Latency and loss are measured with small probes sent at the poll
+  // interval, then the throughput of each direction with full sized probes
+  // sent back to back, for a third of the duration each.
+  void MeasureLink(uint64_t duration_us);
 
  private:
-  // The interval between poll operations to the secondary radio.
-  const uint64_t poll_interval_us_;
+  // The default time to wait for a response to a TxRx request.
+  static constexpr uint64_t kDefaultReceiveTimeoutUs = 100000;
+
+  // The time to wait for a response to a reset, resume or link probe
+  // request. The secondary responds to these immediately, so this is kept
+  // short to probe the link quickly while it is down.
+  static constexpr uint64_t kProbeTimeoutUs = 10000;
+
+  // The default number of consecutive failures before the link is
+  // considered down and probing for recovery begins.
+  static constexpr int kDefaultFailuresBeforeRecovery = 3;
+
+  // The lower bound of the interval between probes while the link is down.
+  // The interval doubles after each failed probe up to the maximum backoff.
+  static constexpr uint64_t kMinProbeIntervalUs = 1000;
+
+  // The time to wait for a response to a TxRx request.
+  uint64_t receive_timeout_us_;
+
+  // The number of consecutive failures before probing for recovery begins.
+  int failures_before_recovery_;
 
   // Logic for poll backoff when the secondary radio is not responding.
   int poll_fail_count_;
   uint64_t current_poll_interval_us_;
   bool connection_reset_required_;
+  bool resume_required_;
+
+  // The time of the first failure in the current outage.
+  uint64_t outage_start_us_;
+
+  // The interval between background probes, zero when disabled, and the
+  // time that the next one is due.
+  uint64_t link_probe_interval_us_;
+  uint64_t next_link_probe_us_;
+
+  // The interval to log the statistics of background probes over and the
+  // time that the current interval started.
+  uint64_t link_probe_report_interval_us_;
+  uint64_t link_probe_report_start_us_;
+
+  // The sequence number of the next probe and the statistics of the probes
+  // sent.
+  uint16_t link_probe_sequence_;
+  LinkProbeStats link_probe_stats_;
+
+  // The radio config currently applied to the radio. This differs from the
+  // config in use by both sides while a change is in doubt, which is when a
+  // configure request has been sent without receiving the response.
+  RadioConfig applied_radio_config_;
+  bool radio_config_in_doubt_;
 
   // Requests that a new connection be opened.
   bool ConnectionReset();
 
+  // Requests that the current connection be resumed. Sets
+  // connection_reset_required_ if the secondary rejects the request.
+  bool ConnectionResume();
+
+  // Requests that the secondary switches to the supplied radio config and
+  // switches to it once acknowledged.
+  bool ConnectionConfigure(const RadioConfig& config);
+
   // Sends and receives messages to exchange network packets.
   bool PerformTunnelTransfer();
 
+  // Sends a probe of the supplied size that requests an answer of the
+  // supplied size and records the result in the probe statistics.
+  bool PerformLinkProbe(size_t request_size, size_t response_size);
+
+  // Sends a background probe and logs the probe statistics once the report
+  // interval has elapsed.
+  bool PerformBackgroundLinkProbe();
+
+  // Sends probes for the supplied time, sleeping for the supplied interval
+  // between them, and logs the results.
+  void MeasurePhase(const char* name, uint64_t duration_us,
+                    size_t request_size, size_t response_size,
+                    uint64_t interval_us);
+
+  // Clears the backoff configuration after a successful transaction.
+  void HandleTransactionSuccess();
+
   // Updates the backoff configuration in the light of a failure.
   void HandleTransactionFailure();
 
+  // Handoff implementation. A restored session is resumed, which checks
+  // that the secondary still agrees on the frames in flight.
+  bool SaveInterfaceState(std::vector<uint8_t>& state) final;
+  bool RestoreInterfaceState(const std::vector<uint8_t>& state) final;
+
 };
 
 }  // namespace nerfnet
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_RADIO_H_
+#define NERFNET_NET_RADIO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <RF24/RF24.h>
+
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// The operations used to exchange packets with an NRF24L01 radio. This
+// allows the link logic to run against simulated radios. Radios are
+// configured for dynamic payload lengths, so packets are sent with the size
+// they are written with.
+class Radio : public NonCopyable {
+ public:
+  virtual ~Radio() = default;
+
+  // Configures the radio. The retry delay is in units of 250us.
+  virtual void SetChannel(uint8_t channel) = 0;
+  virtual void SetDataRate(rf24_datarate_e data_rate) = 0;
+  virtual void SetPALevel(rf24_pa_dbm_e pa_level) = 0;
+  virtual void SetRetries(uint8_t delay, uint8_t count) = 0;
+
+  // Sets the addresses to transmit to and receive from.
+  virtual void OpenWritingPipe(const uint8_t* addr) = 0;
+  virtual void OpenReadingPipe(uint8_t pipe, const uint8_t* addr) = 0;
+
+  // Switches between receive and transmit modes.
+  virtual void StartListening() = 0;
+  virtual void StopListening() = 0;
+
+  // Transmits a packet, returning true once it has been acknowledged by the
+  // receiver.
+  virtual bool Write(const uint8_t* data, size_t size) = 0;
+
+  // Transmits a packet without requesting an acknowledgement, so that any
+  // number of receivers can listen to it. Returns true once it has been
+  // sent.
+  virtual bool WriteNoAck(const uint8_t* data, size_t size) = 0;
+
+  // Waits for the transmit FIFO to drain. Returns false if a packet in it
+  // failed to transmit.
+  virtual bool TxStandBy() = 0;
+
+  // Returns true if a signal has been detected on the channel while
+  // listening, which indicates that another radio is transmitting.
+  virtual bool TestCarrier() = 0;
+
+  // Returns true if a received packet is ready to read.
+  virtual bool Available() = 0;
+
+  // Reads the next received packet and returns its size. Packets larger than
+  // the supplied buffer are truncated.
+  virtual size_t Read(uint8_t* data, size_t size) = 0;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_RADIO_H_
@@ -16,55 +16,565 @@
 
 #include "nerfnet/net/radio_interface.h"
 
-#include <unistd.h>
+#include <algorithm>
+#include <sched.h>
 
+#include "nerfnet/net/ack_filter.h"
+#include "nerfnet/net/ip_packet.h"
 #include "nerfnet/util/log.h"
+#include "nerfnet/util/realtime.h"
 #include "nerfnet/util/time.h"
 
 namespace nerfnet {
+namespace {
 
-RadioInterface::RadioInterface(uint16_t ce_pin, int tunnel_fd,
+// Appends a little-endian field to a saved session.
+void AppendStateField(std::vector<uint8_t>& state, uint64_t value,
+                      size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    state.push_back(static_cast<uint8_t>(value >> (i * 8)));
+  }
+}
+
+// Appends a block of bytes prefixed with its size to a saved session.
+void AppendStateBytes(std::vector<uint8_t>& state,
+                      const std::vector<uint8_t>& bytes) {
+  AppendStateField(state, bytes.size(), 4);
+  state.insert(state.end(), bytes.begin(), bytes.end());
+}
+
+// Reads the fields of a saved session in order.
+class StateReader {
+ public:
+  explicit StateReader(const std::vector<uint8_t>& state)
+      : state_(state), offset_(0) {}
+
+  // Reads a little-endian field. Returns false if the state is too short.
+  bool ReadField(size_t size, uint64_t& value) {
+    if (state_.size() - offset_ < size) {
+      return false;
+    }
+
+    value = 0;
+    for (size_t i = 0; i < size; i++) {
+      value |= static_cast<uint64_t>(state_[offset_++]) << (i * 8);
+    }
+
+    return true;
+  }
+
+  // Reads a block of bytes written by AppendStateBytes.
+  bool ReadBytes(std::vector<uint8_t>& bytes) {
+    uint64_t size;
+    if (!ReadField(4, size) || state_.size() - offset_ < size) {
+      return false;
+    }
+
+    bytes.assign(state_.begin() + offset_, state_.begin() + offset_ + size);
+    offset_ += size;
+    return true;
+  }
+
+  // Returns true once all of the state has been read.
+  bool AtEnd() const { return offset_ == state_.size(); }
+
+ private:
+  const std::vector<uint8_t>& state_;
+  size_t offset_;
+};
+
+}  // anonymous namespace
+
+RadioInterface::RadioInterface(Radio& radio, Tunnel& tunnel,
                                uint32_t primary_addr, uint32_t secondary_addr,
-                               uint8_t channel)
-    : radio_(ce_pin, 0),
-      tunnel_fd_(tunnel_fd),
+                               uint8_t channel, bool is_primary)
+    : radio_(radio),
+      tunnel_(tunnel),
       primary_addr_(primary_addr),
       secondary_addr_(secondary_addr),
-      tunnel_thread_(&RadioInterface::TunnelThread, this),
+      is_primary_(is_primary),
+      running_(true),
+      write_queue_(kTunnelWriteQueueSize),
+      write_queue_head_(0),
+      write_queue_size_(0),
+      tunnel_writer_notify_pending_(false),
+      interleave_max_size_(kDefaultInterleaveMaxSize),
+      session_token_(0),
       next_id_(1),
-      tunnel_logs_enabled_(false) {
-  CHECK(channel < 128, "Channel must be between 0 and 127");
-  CHECK(radio_.begin(), "Failed to start NRF24L01");
-  radio_.setChannel(channel);
-  radio_.setPALevel(RF24_PA_MAX);
-  radio_.setDataRate(RF24_2MBPS);
-  radio_.setAddressWidth(3);
-  radio_.setAutoAck(1);
-  radio_.setRetries(0, 15);
-  radio_.setCRCLength(RF24_CRC_8);
-  CHECK(radio_.isChipConnected(), "NRF24L01 is unavailable");
+      tunnel_logs_enabled_(false),
+      poll_interval_us_(0),
+      max_backoff_us_(kDefaultMaxBackoffUs),
+      max_buffered_frames_(kDefaultMaxBufferedFrames),
+      pa_level_(RF24_PA_MAX),
+      pa_level_pending_(false),
+      startup_radio_config_({channel, RF24_2MBPS}),
+      radio_config_(startup_radio_config_),
+      mss_clamp_mtu_(0),
+      ack_filter_enabled_(false),
+      max_payload_size_(kMaxPayloadSize),
+      turnaround_report_interval_us_(0),
+      turnaround_report_start_us_(0) {
+  turnaround_samples_us_.reserve(kMaxTurnaroundSamples);
+  ConfigureRadio(radio_, channel);
+  tunnel_thread_ = StartThread([this]() { TunnelThread(); });
+  tunnel_writer_thread_ = StartThread([this]() { TunnelWriterThread(); });
 }
 
 RadioInterface::~RadioInterface() {
+  StopTunnelThreads();
+}
+
+void RadioInterface::ConfigureRadio(Radio& radio, uint8_t channel) {
+  CHECK(channel < 128, "Channel must be between 0 and 127");
+  radio.SetChannel(channel);
+  radio.SetPALevel(RF24_PA_MAX);
+  radio.SetDataRate(RF24_2MBPS);
+  radio.SetRetries(0, 15);
+}
+
+void RadioInterface::GetAddressBytes(uint32_t addr, uint8_t* bytes) {
+  bytes[0] = static_cast<uint8_t>(addr);
+  bytes[1] = static_cast<uint8_t>(addr >> 8);
+  bytes[2] = static_cast<uint8_t>(addr >> 16);
+  bytes[3] = static_cast<uint8_t>(addr >> 24);
+  bytes[4] = 0;
+}
+
+void RadioInterface::ApplyPendingSettings() {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  if (pa_level_pending_) {
+    radio_.SetPALevel(pa_level_);
+    pa_level_pending_ = false;
+  }
+}
+
+void RadioInterface::ApplyRadioConfig(const RadioConfig& config) {
+  radio_.SetChannel(config.channel);
+  radio_.SetDataRate(config.data_rate);
+}
+
+void RadioInterface::SetRadioConfig(const RadioConfig& config) {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  radio_config_ = config;
+  if (pending_radio_config_.has_value()
+      && pending_radio_config_.value() == config) {
+    pending_radio_config_.reset();
+  }
+}
+
+std::optional<RadioInterface::RadioConfig>
+    RadioInterface::GetPendingRadioConfig() {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  return pending_radio_config_;
+}
+
+void RadioInterface::SetPALevel(rf24_pa_dbm_e pa_level) {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  pa_level_ = pa_level;
+  pa_level_pending_ = true;
+}
+
+rf24_pa_dbm_e RadioInterface::GetPALevel() {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  return pa_level_;
+}
+
+RadioInterface::RadioConfig RadioInterface::GetRadioConfig() {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  return radio_config_;
+}
+
+RadioInterface::RadioConfig RadioInterface::GetRequestedRadioConfig() {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  return pending_radio_config_.value_or(radio_config_);
+}
+
+bool RadioInterface::RequestRadioConfig(const RadioConfig& config) {
+  return false;
+}
+
+void RadioInterface::EnableRealtime(int radio_cpu, int tunnel_cpu,
+                                    int priority) {
+  CHECK(priority > 1 && priority <= sched_get_priority_max(SCHED_FIFO),
+      "Realtime priority must be between 2 and %d",
+      sched_get_priority_max(SCHED_FIFO));
+
+  // The incoming frame buffers are sized for the largest frame so that they
+  // are never grown, and so faulted in, while the link is running.
+  {
+    std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+    for (auto& frame : frame_buffers_) {
+      frame.reserve(UINT16_MAX);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(write_queue_mutex_);
+    for (auto& frame : write_queue_) {
+      frame.reserve(UINT16_MAX);
+    }
+  }
+
+  LockMemory();
+  if (radio_cpu >= 0) {
+    SetThreadAffinity(pthread_self(), radio_cpu);
+  }
+
+  if (tunnel_cpu >= 0) {
+    SetThreadAffinity(tunnel_thread_.thread.native_handle(), tunnel_cpu);
+    SetThreadAffinity(tunnel_writer_thread_.thread.native_handle(), tunnel_cpu);
+  }
+
+  SetThreadRealtimePriority(pthread_self(), priority);
+  SetThreadRealtimePriority(tunnel_thread_.thread.native_handle(),
+      priority - 1);
+  SetThreadRealtimePriority(tunnel_writer_thread_.thread.native_handle(),
+      priority - 1);
+}
+
+void RadioInterface::SetEncryptionKey(const std::vector<uint8_t>& key) {
+  cipher_ = std::make_unique<LinkCipher>(key, is_primary_);
+  max_payload_size_ = kMaxPayloadSize - LinkCipher::kTagSize;
+}
+
+uint16_t RadioInterface::GetChunkAlignedMtu() const {
+  size_t packets = (kIPv6MinMtu + max_payload_size_ - 1) / max_payload_size_;
+  return static_cast<uint16_t>(packets * max_payload_size_);
+}
+
+void RadioInterface::SetTunnelMtu(uint16_t mtu) {
+  mss_clamp_mtu_ = std::min(mtu,
+      static_cast<uint16_t>(kPacketsPerSegment * max_payload_size_));
+}
+
+void RadioInterface::RecordTurnaround(uint64_t start_us) {
+  if (turnaround_report_interval_us_ == 0) {
+    return;
+  }
+
+  uint64_t now_us = TimeNowUs();
+  if (turnaround_samples_us_.size() < kMaxTurnaroundSamples) {
+    turnaround_samples_us_.push_back(static_cast<uint32_t>(
+        std::min(now_us - start_us, static_cast<uint64_t>(UINT32_MAX))));
+  }
+
+  if (turnaround_report_start_us_ == 0) {
+    turnaround_report_start_us_ = now_us;
+  } else if (now_us - turnaround_report_start_us_
+      >= turnaround_report_interval_us_) {
+    auto& samples = turnaround_samples_us_;
+    std::sort(samples.begin(), samples.end());
+    LOGI("Turnaround of %zu exchanges: p50 %u us, p90 %u us, p99 %u us, "
+         "p99.9 %u us, max %u us", samples.size(),
+         samples[samples.size() * 50 / 100],
+         samples[samples.size() * 90 / 100],
+         samples[samples.size() * 99 / 100],
+         samples[samples.size() * 999 / 1000], samples.back());
+    samples.clear();
+    turnaround_report_start_us_ = now_us;
+  }
+}
+
+void RadioInterface::EnableCapture(const std::string& path) {
+  auto capture_tap = std::make_unique<CaptureTap>(path);
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+  capture_tap_ = std::move(capture_tap);
+}
+
+void RadioInterface::EnableSpool(const std::string& path, size_t size) {
+  auto spool = std::make_unique<FrameSpool>(path, size);
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+  std::lock_guard<std::mutex> delivery_lock(delivery_mutex_);
+  CHECK(spool_ == nullptr, "Spool is already enabled");
+  spool_ = std::move(spool);
+}
+
+void RadioInterface::SetDeliveryClassifier(
+    const DeliveryClassifier& classifier) {
+  std::lock_guard<std::mutex> lock(delivery_mutex_);
+  delivery_classifier_ = classifier;
+}
+
+bool RadioInterface::SendDatagram(uint8_t channel, const uint8_t* data,
+                                  size_t size) {
+  if (channel > kMaxDatagramChannel || size > kMaxDatagramSize) {
+    return false;
+  }
+
+  std::vector<uint8_t> frame;
+  frame.reserve(size + 1);
+  frame.push_back(channel);
+  frame.insert(frame.end(), data, data + size);
+  uint64_t deadline_us;
+  FrameSpool* spool = ClassifyFrame(frame, deadline_us);
+  if (spool != nullptr) {
+    return spool->Push(frame);
+  }
+
+  LockMutex(read_buffer_mutex_);
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_, std::adopt_lock);
+  if (read_buffer_.size() >= max_buffered_frames_) {
+    return false;
+  }
+
+  if (capture_tap_ != nullptr) {
+    capture_tap_->RecordFrameQueued(frame);
+  }
+
+  read_buffer_.push_back(std::move(frame));
+  return true;
+}
+
+void RadioInterface::SetDatagramHandler(DatagramHandler handler) {
+  std::lock_guard<std::mutex> lock(datagram_handler_mutex_);
+  datagram_handler_ = std::move(handler);
+}
+
+bool RadioInterface::SaveState(std::vector<uint8_t>& state) {
+  StopTunnelThreads();
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+  state.clear();
+  AppendStateField(state, kStateVersion, 1);
+  AppendStateField(state, is_primary_, 1);
+  AppendStateField(state, session_token_, 4);
+  AppendStateField(state, next_id_, 1);
+  AppendStateField(state, last_ack_id_.value_or(0), 1);
+
+  RadioConfig radio_config = GetRadioConfig();
+  AppendStateField(state, radio_config.channel, 1);
+  AppendStateField(state, radio_config.data_rate, 1);
+
+  // Best-effort frames are not carried over, as they would most likely
+  // expire during the handoff.
+  for (const auto& stream : tx_streams_) {
+    AppendStateField(state, stream.offset, 4);
+    AppendStateField(state, stream.spooled, 1);
+    AppendStateBytes(state, stream.frame);
+  }
+
+  AppendStateField(state, tx_stream_.has_value() ? *tx_stream_ + 1 : 0, 1);
+  AppendStateField(state, tx_payload_populated_, 1);
+  AppendStateField(state, read_buffer_.size(), 4);
+  for (const auto& frame : read_buffer_) {
+    AppendStateBytes(state, frame);
+  }
+
+  for (const auto& frame : frame_buffers_) {
+    AppendStateBytes(state, frame);
+  }
+
+  AppendStateField(state, write_queue_size_, 4);
+  for (size_t i = 0; i < write_queue_size_; i++) {
+    AppendStateBytes(state,
+        write_queue_[(write_queue_head_ + i) % write_queue_.size()]);
+  }
+
+  AppendStateField(state, cipher_ != nullptr, 1);
+  AppendStateBytes(state, cipher_ != nullptr
+      ? cipher_->SaveSession() : std::vector<uint8_t>());
+
+  std::vector<uint8_t> interface_state;
+  if (!SaveInterfaceState(interface_state)) {
+    return false;
+  }
+
+  AppendStateBytes(state, interface_state);
+  return true;
+}
+
+bool RadioInterface::RestoreState(const std::vector<uint8_t>& state) {
+  StateReader reader(state);
+  uint64_t version;
+  uint64_t is_primary;
+  uint64_t session_token;
+  uint64_t next_id;
+  uint64_t last_ack_id;
+  uint64_t channel;
+  uint64_t data_rate;
+  if (!reader.ReadField(1, version) || version != kStateVersion) {
+    LOGE("Unsupported saved session version");
+    return false;
+  } else if (!reader.ReadField(1, is_primary)
+      || !reader.ReadField(4, session_token)
+      || !reader.ReadField(1, next_id)
+      || !reader.ReadField(1, last_ack_id)
+      || !reader.ReadField(1, channel)
+      || !reader.ReadField(1, data_rate)) {
+    LOGE("Saved session is truncated");
+    return false;
+  } else if (channel >= 128 || data_rate > RF24_250KBPS) {
+    LOGE("Saved session has an invalid radio config");
+    return false;
+  } else if (is_primary != is_primary_) {
+    LOGE("Saved session is for the other side of the link");
+    return false;
+  }
+
+  std::array<TxStream, kNumStreams> tx_streams;
+  for (auto& stream : tx_streams) {
+    uint64_t offset;
+    uint64_t spooled;
+    if (!reader.ReadField(4, offset) || !reader.ReadField(1, spooled)
+        || !reader.ReadBytes(stream.frame)) {
+      LOGE("Saved session is truncated");
+      return false;
+    } else if (offset >= std::max<size_t>(stream.frame.size(), 1)) {
+      LOGE("Saved session has an invalid frame offset");
+      return false;
+    }
+
+    // The spool is shared with the saving process, so a spooled frame in
+    // flight is still at the head of the spool.
+    stream.offset = offset;
+    stream.spooled = spooled != 0;
+  }
+
+  uint64_t tx_stream;
+  uint64_t tx_payload_populated;
+  uint64_t read_buffer_size;
+  if (!reader.ReadField(1, tx_stream)
+      || !reader.ReadField(1, tx_payload_populated)
+      || !reader.ReadField(4, read_buffer_size)
+      || read_buffer_size > state.size()) {
+    LOGE("Saved session is truncated");
+    return false;
+  } else if (tx_stream > kNumStreams
+      || (tx_stream != 0 && tx_streams[tx_stream - 1].frame.empty())) {
+    LOGE("Saved session has an invalid stream");
+    return false;
+  }
+
+  std::deque<std::vector<uint8_t>> read_buffer(read_buffer_size);
+  for (auto& frame : read_buffer) {
+    if (!reader.ReadBytes(frame)) {
+      LOGE("Saved session is truncated");
+      return false;
+    }
+  }
+
+  std::array<std::vector<uint8_t>, kNumStreams> frame_buffers;
+  for (auto& frame : frame_buffers) {
+    if (!reader.ReadBytes(frame)) {
+      LOGE("Saved session is truncated");
+      return false;
+    }
+  }
+
+  uint64_t write_queue_size;
+  if (!reader.ReadField(4, write_queue_size)
+      || write_queue_size > state.size()) {
+    LOGE("Saved session is truncated");
+    return false;
+  }
+
+  std::vector<std::vector<uint8_t>> write_queue(write_queue_size);
+  for (auto& frame : write_queue) {
+    if (!reader.ReadBytes(frame)) {
+      LOGE("Saved session is truncated");
+      return false;
+    }
+  }
+
+  uint64_t encrypted;
+  std::vector<uint8_t> cipher_session;
+  std::vector<uint8_t> interface_state;
+  if (!reader.ReadField(1, encrypted)
+      || !reader.ReadBytes(cipher_session)
+      || !reader.ReadBytes(interface_state)
+      || !reader.AtEnd()) {
+    LOGE("Saved session is malformed");
+    return false;
+  } else if (encrypted != (cipher_ != nullptr)) {
+    LOGE("Saved session encryption does not match");
+    return false;
+  } else if (cipher_ != nullptr && !cipher_->RestoreSession(cipher_session)) {
+    LOGE("Failed to restore cipher session");
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+  session_token_ = session_token;
+  next_id_ = next_id;
+  if (last_ack_id != 0) {
+    last_ack_id_ = last_ack_id;
+  } else {
+    last_ack_id_.reset();
+  }
+
+  RadioConfig radio_config = {static_cast<uint8_t>(channel),
+      static_cast<rf24_datarate_e>(data_rate)};
+  if (radio_config != startup_radio_config_) {
+    ApplyRadioConfig(radio_config);
+  }
+
+  SetRadioConfig(radio_config);
+  read_buffer.insert(read_buffer.end(),
+      std::make_move_iterator(read_buffer_.begin()),
+      std::make_move_iterator(read_buffer_.end()));
+  read_buffer_ = std::move(read_buffer);
+  tx_streams_ = std::move(tx_streams);
+  if (tx_stream != 0) {
+    tx_stream_ = tx_stream - 1;
+  } else {
+    tx_stream_.reset();
+  }
+
+  tx_payload_populated_ = tx_payload_populated != 0;
+  frame_buffers_ = std::move(frame_buffers);
+  for (auto& frame : write_queue) {
+    WriteTunnel(frame);
+  }
+
+  NotifyTunnelWriter();
+  if (!RestoreInterfaceState(interface_state)) {
+    LOGE("Failed to restore interface state");
+    return false;
+  }
+
+  LOGI("Restored session with %zu queued frames", read_buffer_.size());
+  return true;
+}
+
+bool RadioInterface::SaveInterfaceState(std::vector<uint8_t>& state) {
+  return false;
+}
+
+bool RadioInterface::RestoreInterfaceState(const std::vector<uint8_t>& state) {
+  return false;
+}
+
+void RadioInterface::StopTunnelThreads() {
   running_ = false;
-  tunnel_thread_.join();
+  NotifyOne(write_queue_cv_);
+  if (tunnel_thread_.Joinable()) {
+    JoinThread(tunnel_thread_);
+  }
+
+  if (tunnel_writer_thread_.Joinable()) {
+    JoinThread(tunnel_writer_thread_);
+  }
 }
 
 RadioInterface::RequestResult RadioInterface::Send(
     const std::vector<uint8_t>& request) {
-  radio_.stopListening();
+  radio_.StopListening();
 
   if (request.size() > kMaxPacketSize) {
     LOGE("Request is too large (%zu vs %zu)", request.size(), kMaxPacketSize);
     return RequestResult::Malformed;
   }
 
-  if (!radio_.write(request.data(), request.size())) {
+  bool success = radio_.Write(request.data(), request.size());
+  if (capture_tap_ != nullptr) {
+    capture_tap_->RecordPacketSent(request, success);
+  }
+
+  if (!success) {
     LOGE("Failed to write request");
     return RequestResult::TransmitError;
   }
 
-  while (!radio_.txStandBy()) {
+  while (!radio_.TxStandBy()) {
     LOGI("Waiting for transmit standby");
   }
 
@@ -73,35 +583,214 @@ RadioInterface::RequestResult RadioInterface::Send(
 
 RadioInterface::RequestResult RadioInterface::Receive(
     std::vector<uint8_t>& response, uint64_t timeout_us) {
-  radio_.startListening();
+  radio_.StartListening();
   uint64_t start_us = TimeNowUs();
-  while (!radio_.available()) {
+  while (!radio_.Available()) {
     if (timeout_us != 0 && (start_us + timeout_us) < TimeNowUs()) {
-      LOGE("Timeout receiving response");
       return RequestResult::Timeout;
     }
   }
 
-  radio_.read(response.data(), response.size());
+  response.resize(radio_.Read(response.data(), response.size()));
+  if (capture_tap_ != nullptr) {
+    capture_tap_->RecordPacketReceived(response);
+  }
+
   return RequestResult::Success;
 }
 
 size_t RadioInterface::GetReadBufferSize() {
-  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+  LockMutex(read_buffer_mutex_);
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_, std::adopt_lock);
   return read_buffer_.size();
 }
 
-size_t RadioInterface::GetTransferSize(const std::vector<uint8_t>& frame) {
-  return std::min(frame.size(), static_cast<size_t>(kMaxPayloadSize));
+size_t RadioInterface::GetTransferSize(const TxStream& stream) {
+  return std::min(stream.frame.size() - stream.offset, max_payload_size_);
 }
 
-void RadioInterface::AdvanceID() {
-  next_id_++;
-  if (next_id_ > kIDMask) {
-    next_id_ = 1;
+std::optional<uint8_t> RadioInterface::SelectTxStream() {
+  size_t interleave_max_size = interleave_max_size_;
+  std::optional<uint8_t> free_stream;
+  std::optional<uint8_t> selected_stream;
+  size_t selected_bytes_left = SIZE_MAX;
+  bool small_frame_open = false;
+  for (uint8_t i = 0; i < kNumStreams; i++) {
+    const auto& stream = tx_streams_[i];
+    if (stream.frame.empty()) {
+      if (!free_stream.has_value()) {
+        free_stream = i;
+      }
+
+      continue;
+    }
+
+    size_t bytes_left = stream.frame.size() - stream.offset;
+    if (bytes_left < selected_bytes_left) {
+      selected_stream = i;
+      selected_bytes_left = bytes_left;
+    }
+
+    if (stream.frame.size() <= interleave_max_size) {
+      small_frame_open = true;
+    }
+  }
+
+  if (!free_stream.has_value() || small_frame_open) {
+    return selected_stream;
+  }
+
+  // A best-effort frame is only opened once it is sent next, so that it is
+  // dropped rather than sent late if its deadline passes while it waits.
+  DropExpiredBestEffortFrames();
+  if (!best_effort_buffer_.empty()) {
+    size_t frame_size = best_effort_buffer_.front().frame.size();
+    if (selected_stream.has_value() && (frame_size > interleave_max_size
+        || frame_size >= selected_bytes_left)) {
+      return selected_stream;
+    }
+
+    auto& stream = tx_streams_[free_stream.value()];
+    stream.frame = std::move(best_effort_buffer_.front().frame);
+    stream.offset = 0;
+    stream.spooled = false;
+    best_effort_buffer_.pop_front();
+    return free_stream;
+  } else if (read_buffer_.empty()) {
+    auto& stream = tx_streams_[free_stream.value()];
+    if (selected_stream.has_value() || spool_ == nullptr
+        || !spool_->Peek(stream.frame)) {
+      return selected_stream;
+    }
+
+    stream.offset = 0;
+    stream.spooled = true;
+    return free_stream;
+  }
+
+  // Small frames keep their order, as do large frames, so that frames of the
+  // same flow are only reordered when they differ in size.
+  auto frame = std::find_if(read_buffer_.begin(), read_buffer_.end(),
+      [interleave_max_size](const std::vector<uint8_t>& frame) {
+        return frame.size() <= interleave_max_size;
+      });
+  if (frame == read_buffer_.end()) {
+    if (selected_stream.has_value()) {
+      return selected_stream;
+    }
+
+    frame = read_buffer_.begin();
+  }
+
+  auto& stream = tx_streams_[free_stream.value()];
+  stream.frame = std::move(*frame);
+  stream.offset = 0;
+  stream.spooled = false;
+  read_buffer_.erase(frame);
+  if (stream.frame.size() < selected_bytes_left) {
+    selected_stream = free_stream;
+  }
+
+  return selected_stream;
+}
+
+void RadioInterface::PopulateTxPayload(TunnelTxRxPacket& tunnel) {
+  tunnel.stream = 0;
+  tunnel.bytes_left = 0;
+  tunnel.payload.clear();
+  if (!tx_payload_populated_) {
+    tx_stream_ = SelectTxStream();
+    tx_payload_populated_ = true;
+  }
+
+  if (!tx_stream_.has_value()) {
+    return;
+  }
+
+  const auto& stream = tx_streams_[tx_stream_.value()];
+  auto payload_start = stream.frame.begin() + stream.offset;
+  tunnel.payload.assign(payload_start,
+      payload_start + GetTransferSize(stream));
+  tunnel.stream = tx_stream_.value();
+  tunnel.bytes_left = std::min(stream.frame.size() - stream.offset,
+      static_cast<size_t>(kMaxBytesLeft));
+}
+
+void RadioInterface::AdvanceTxPayload() {
+  tx_payload_populated_ = false;
+  if (!tx_stream_.has_value()) {
+    return;
+  }
+
+  auto& stream = tx_streams_[tx_stream_.value()];
+  stream.offset += GetTransferSize(stream);
+  if (stream.offset >= stream.frame.size()) {
+    if (capture_tap_ != nullptr) {
+      capture_tap_->RecordFrameSent(stream.frame);
+    }
+
+    if (stream.spooled && spool_ != nullptr) {
+      spool_->Pop();
+    }
+
+    stream.frame.clear();
+    stream.offset = 0;
+    stream.spooled = false;
+  }
+
+  tx_stream_.reset();
+}
+
+FrameSpool* RadioInterface::ClassifyFrame(const std::vector<uint8_t>& frame,
+                                         uint64_t& deadline_us) {
+  std::lock_guard<std::mutex> lock(delivery_mutex_);
+  deadline_us = 0;
+  if (spool_ != nullptr && delivery_classifier_.IsSpooled(frame)) {
+    return spool_.get();
+  }
+
+  deadline_us = delivery_classifier_.GetDeadlineUs(frame);
+  return nullptr;
+}
+
+void RadioInterface::DropExpiredBestEffortFrames() {
+  if (best_effort_buffer_.empty()) {
+    return;
+  }
+
+  uint64_t now_us = TimeNowUs();
+  while (!best_effort_buffer_.empty()
+      && now_us >= best_effort_buffer_.front().deadline_us) {
+    if (tunnel_logs_enabled_) {
+      LOGI("Dropping %zu byte best-effort frame past its deadline",
+          best_effort_buffer_.front().frame.size());
+    }
+
+    best_effort_buffer_.pop_front();
   }
 }
 
+void RadioInterface::PromoteBestEffortFrame() {
+  DropExpiredBestEffortFrames();
+  if (!best_effort_buffer_.empty()) {
+    read_buffer_.push_front(std::move(best_effort_buffer_.front().frame));
+    best_effort_buffer_.pop_front();
+  }
+}
+
+uint8_t RadioInterface::NextID(uint8_t id) {
+  id++;
+  if (id > kIDMask) {
+    id = 1;
+  }
+
+  return id;
+}
+
+void RadioInterface::AdvanceID() {
+  next_id_ = NextID(next_id_);
+}
+
 bool RadioInterface::ValidateID(uint8_t id) {
   if (!last_ack_id_.has_value()
       || (last_ack_id_.value() == kIDMask && id == 1)
@@ -114,57 +803,160 @@ bool RadioInterface::ValidateID(uint8_t id) {
 }
 
 void RadioInterface::TunnelThread() {
-  // The maximum number of network frames to buffer here.
-  constexpr size_t kMaxBufferedFrames = 1024;
-
-  running_ = true;
-  uint8_t buffer[3200];
+  std::vector<uint8_t> frame;
   while (running_) {
-    int bytes_read = read(tunnel_fd_, buffer, sizeof(buffer));
-    if (bytes_read < 0) {
-      LOGE("Failed to read: %s (%d)", strerror(errno), errno);
+    if (!tunnel_.Read(frame)) {
+      continue;
+    }
+
+    uint16_t mss_clamp_mtu = mss_clamp_mtu_;
+    if (mss_clamp_mtu != 0) {
+      ClampTcpMss(frame, mss_clamp_mtu);
+    }
+
+    // The spool is written without the read buffer lock, since writing it
+    // may wait on the disk.
+    uint64_t deadline_us;
+    FrameSpool* spool = ClassifyFrame(frame, deadline_us);
+    if (spool != nullptr) {
+      if (!spool->Push(frame)) {
+        LOGW("Spool is full, dropping %zu byte frame", frame.size());
+      } else if (tunnel_logs_enabled_) {
+        LOGI("Spooled %zu bytes from the tunnel, %llu frames spooled",
+            frame.size(),
+            static_cast<unsigned long long>(spool->GetFrameCount()));
+      }
+
       continue;
     }
 
     {
-      std::lock_guard<std::mutex> lock(read_buffer_mutex_);
-      read_buffer_.emplace_back(&buffer[0], &buffer[bytes_read]);
+      // The radio thread holds the lock while it waits on the radio.
+      LockMutex(read_buffer_mutex_);
+      std::lock_guard<std::mutex> lock(read_buffer_mutex_, std::adopt_lock);
+      if (deadline_us != 0) {
+        if (capture_tap_ != nullptr) {
+          capture_tap_->RecordFrameQueued(frame);
+        }
+
+        // Best-effort frames are bounded by their deadline, but the queue is
+        // also limited in case the link stops being serviced.
+        if (best_effort_buffer_.size() >= max_buffered_frames_) {
+          best_effort_buffer_.pop_front();
+        }
+
+        best_effort_buffer_.push_back({std::move(frame),
+            TimeNowUs() + deadline_us});
+        continue;
+      }
+
+      if (ack_filter_enabled_) {
+        // Frames are taken out of the buffer once they start being sent.
+        size_t filtered = FilterTcpAcks(read_buffer_, /*start_index=*/0, frame);
+        if (filtered > 0 && tunnel_logs_enabled_) {
+          LOGI("Filtered %zu redundant TCP acks", filtered);
+        }
+      }
+
+      if (capture_tap_ != nullptr) {
+        capture_tap_->RecordFrameQueued(frame);
+      }
+
+      read_buffer_.push_back(std::move(frame));
       if (tunnel_logs_enabled_) {
         LOGI("Read %zu bytes from the tunnel", read_buffer_.back().size());
       }
     }
 
-    while (GetReadBufferSize() > kMaxBufferedFrames && running_) {
+    while (GetReadBufferSize() > max_buffered_frames_ && running_) {
       SleepUs(1000);
     }
   }
 }
 
+void RadioInterface::TunnelWriterThread() {
+  std::unique_lock<std::mutex> lock(write_queue_mutex_);
+  while (running_) {
+    if (write_queue_size_ == 0) {
+      WaitUs(write_queue_cv_, lock, kTunnelWriterWaitUs);
+      continue;
+    }
+
+    // The radio thread does not touch queued frames, so the lock is released
+    // while writing.
+    std::vector<uint8_t>& frame = write_queue_[write_queue_head_];
+    lock.unlock();
+
+    // Frames without an IP version are datagrams.
+    if (!frame.empty() && (frame[0] >> 4) == 0) {
+      std::lock_guard<std::mutex> handler_lock(datagram_handler_mutex_);
+      if (datagram_handler_) {
+        datagram_handler_(frame[0], frame.data() + 1, frame.size() - 1);
+      }
+    } else {
+      uint16_t mss_clamp_mtu = mss_clamp_mtu_;
+      if (mss_clamp_mtu != 0) {
+        ClampTcpMss(frame, mss_clamp_mtu);
+      }
+
+      tunnel_.Write(frame);
+      if (tunnel_logs_enabled_) {
+        LOGI("Writing %zu bytes to the tunnel", frame.size());
+      }
+    }
+
+    frame.clear();
+    lock.lock();
+    write_queue_head_ = (write_queue_head_ + 1) % write_queue_.size();
+    write_queue_size_--;
+  }
+}
+
 bool RadioInterface::DecodeTunnelTxRxPacket(
-    const std::vector<uint8_t>& request, TunnelTxRxPacket& tunnel) {
-  if (request.size() != kMaxPacketSize) {
+    const std::vector<uint8_t>& packet, TunnelTxRxPacket& tunnel) {
+  size_t tag_size = (cipher_ != nullptr) ? LinkCipher::kTagSize : 0;
+  if (packet.size() < kHeaderSize + tag_size) {
     LOGE("Received short TxRx packet");
     return false;
   }
 
+  const std::vector<uint8_t>* request = &packet;
+  std::vector<uint8_t> decrypted;
+  if (cipher_ != nullptr) {
+    decrypted = packet;
+    if (!cipher_->Open(decrypted, kHeaderSize)) {
+      LOGE("Failed to authenticate TxRx packet");
+      return false;
+    }
+
+    request = &decrypted;
+  }
+
   tunnel.id.reset();
-  uint8_t id_value = request[0] & kIDMask;
+  uint8_t id_value = (*request)[0] & kIDMask;
   if (id_value != 0) {
     tunnel.id = id_value;
   }
 
   tunnel.ack_id.reset();
-  uint8_t ack_id_value = (request[0] >> 4) & kIDMask;
+  uint8_t ack_id_value = ((*request)[0] >> 4) & kIDMask;
   if (ack_id_value != 0) {
     tunnel.ack_id = ack_id_value;
   }
 
   tunnel.payload.clear();
-  uint8_t size_value = request[1];
+  tunnel.stream = (*request)[1] >> kStreamShift;
+  uint8_t size_value = (*request)[1] & kMaxBytesLeft;
   tunnel.bytes_left = size_value;
   if (size_value > 0) {
-    size_value = std::min(size_value, static_cast<uint8_t>(kMaxPayloadSize));
-    tunnel.payload = {request.begin() + 2, request.begin() + 2 + size_value};
+    size_value = std::min(size_value, static_cast<uint8_t>(max_payload_size_));
+    if (request->size() - kHeaderSize - tag_size < size_value) {
+      LOGE("Received truncated TxRx packet");
+      return false;
+    }
+
+    tunnel.payload = {request->begin() + kHeaderSize,
+                      request->begin() + kHeaderSize + size_value};
   }
 
   return true;
@@ -172,7 +964,14 @@ bool RadioInterface::DecodeTunnelTxRxPacket(
 
 bool RadioInterface::EncodeTunnelTxRxPacket(
     const TunnelTxRxPacket& tunnel, std::vector<uint8_t>& request) {
-  request.resize(kMaxPacketSize, 0x00);
+  if (tunnel.payload.size() > max_payload_size_) {
+    LOGE("TxRx packet payload is too large");
+    return false;
+  }
+
+  // Only the header, payload and tag are sent.
+  size_t tag_size = (cipher_ != nullptr) ? LinkCipher::kTagSize : 0;
+  request.assign(kHeaderSize + tunnel.payload.size() + tag_size, 0x00);
   if (tunnel.id.has_value()) {
     request[0] = tunnel.id.value();
   }
@@ -181,30 +980,234 @@ bool RadioInterface::EncodeTunnelTxRxPacket(
     request[0] |= (tunnel.ack_id.value() << 4);
   }
 
-   if (tunnel.payload.size() > kMaxPayloadSize) {
-    LOGE("TxRx packet payload is too large");
+  request[1] = (tunnel.stream << kStreamShift) | tunnel.bytes_left;
+  for (size_t i = 0; i < tunnel.payload.size(); i++) {
+    request[kHeaderSize + i] = tunnel.payload[i];
+  }
+
+  if (cipher_ != nullptr) {
+    cipher_->Seal(request, kHeaderSize);
+  }
+
+  return true;
+}
+
+bool RadioInterface::CanReceivePayload(const TunnelTxRxPacket& tunnel) {
+  if (tunnel.payload.empty() || tunnel.bytes_left > max_payload_size_) {
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(write_queue_mutex_);
+  return write_queue_size_ < write_queue_.size();
+}
+
+void RadioInterface::ReceivePayload(const TunnelTxRxPacket& tunnel) {
+  auto& frame = frame_buffers_[tunnel.stream];
+  frame.insert(frame.end(), tunnel.payload.begin(), tunnel.payload.end());
+  if (tunnel.bytes_left <= max_payload_size_) {
+    WriteTunnel(frame);
+  }
+}
+
+void RadioInterface::WriteTunnel(std::vector<uint8_t>& frame) {
+  if (capture_tap_ != nullptr) {
+    capture_tap_->RecordFrameReceived(frame);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(write_queue_mutex_);
+    if (write_queue_size_ == write_queue_.size()) {
+      LOGW("Tunnel write queue is full, dropping %zu byte frame",
+          frame.size());
+    } else {
+      size_t index = (write_queue_head_ + write_queue_size_)
+          % write_queue_.size();
+      std::swap(write_queue_[index], frame);
+      write_queue_size_++;
+      tunnel_writer_notify_pending_ = true;
+    }
+  }
+
+  frame.clear();
+}
+
+void RadioInterface::NotifyTunnelWriter() {
+  if (tunnel_writer_notify_pending_) {
+    tunnel_writer_notify_pending_ = false;
+    NotifyOne(write_queue_cv_);
+  }
+}
+
+void RadioInterface::ResetSession(uint32_t session_token) {
+  session_token_ = session_token;
+  next_id_ = 1;
+  last_ack_id_.reset();
+  for (auto& frame : frame_buffers_) {
+    frame.clear();
+  }
+
+  for (auto& stream : tx_streams_) {
+    stream.offset = 0;
+  }
+
+  tx_stream_.reset();
+  tx_payload_populated_ = false;
+}
+
+std::vector<uint8_t> RadioInterface::BuildControlPacket(ControlType type,
+    const std::vector<uint8_t>& peer_salt, const RadioConfig& config) {
+  std::vector<uint8_t> packet(GetControlPacketSize(type), 0x00);
+  packet[kControlTypeOffset] = static_cast<uint8_t>(type);
+  for (size_t i = 0; i < 4; i++) {
+    packet[kSessionTokenOffset + i] =
+        static_cast<uint8_t>(session_token_ >> (i * 8));
+  }
+
+  if (type == ControlType::Resume) {
+    packet[kResumeIDsOffset] = next_id_;
+    if (last_ack_id_.has_value()) {
+      packet[kResumeIDsOffset] |= (last_ack_id_.value() << 4);
+    }
+
+    uint64_t tx_counter = (cipher_ != nullptr) ? cipher_->GetTxCounter() : 0;
+    for (size_t i = 0; i < kResumeCounterSize; i++) {
+      packet[kResumeCounterOffset + i] =
+          static_cast<uint8_t>(tx_counter >> (i * 8));
+    }
+  } else if (type == ControlType::Configure) {
+    packet[kConfigChannelOffset] = config.channel;
+    packet[kConfigDataRateOffset] = static_cast<uint8_t>(config.data_rate);
+  }
+
+  if (cipher_ != nullptr) {
+    cipher_->SealHandshake(packet, peer_salt);
+  }
+
+  return packet;
+}
+
+size_t RadioInterface::GetControlPacketSize(ControlType type) const {
+  size_t size = kSessionTokenOffset + 4;
+  if (type == ControlType::Resume) {
+    size = kResumeCounterOffset + kResumeCounterSize;
+  } else if (type == ControlType::Configure) {
+    size = kConfigDataRateOffset + 1;
+  }
+
+  return size + ((cipher_ != nullptr) ? LinkCipher::kTagSize : 0);
+}
+
+bool RadioInterface::OpenControlPacket(const std::vector<uint8_t>& packet,
+    const std::vector<uint8_t>& peer_salt) {
+  if (packet.size() < kHeaderSize || packet[0] != 0x00
+      || packet.size() != GetControlPacketSize(
+          static_cast<ControlType>(packet[kControlTypeOffset]))) {
     return false;
   }
 
-  request[1] = tunnel.bytes_left;
-  for (size_t i = 0; i < tunnel.payload.size(); i++) {
-    request[2 + i] = tunnel.payload[i];
+  return cipher_ == nullptr || cipher_->OpenHandshake(packet, peer_salt);
+}
+
+size_t RadioInterface::GetMinProbePacketSize() const {
+  return kMinProbeSize + ((cipher_ != nullptr) ? LinkCipher::kTagSize : 0);
+}
+
+void RadioInterface::SetProbeField(std::vector<uint8_t>& packet,
+    size_t offset, uint32_t value, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    packet[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+  }
+}
+
+uint32_t RadioInterface::GetProbeField(const std::vector<uint8_t>& packet,
+    size_t offset, size_t size) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < size; i++) {
+    value |= static_cast<uint32_t>(packet[offset + i]) << (i * 8);
+  }
+
+  return value;
+}
+
+void RadioInterface::SealProbePacket(std::vector<uint8_t>& packet) {
+  packet[0] = 0x00;
+  packet[kControlTypeOffset] = static_cast<uint8_t>(ControlType::Probe);
+  if (cipher_ != nullptr) {
+    cipher_->Seal(packet, kHeaderSize);
+  }
+}
+
+bool RadioInterface::OpenProbePacket(std::vector<uint8_t>& packet) {
+  if (packet.size() < GetMinProbePacketSize() || packet[0] != 0x00
+      || packet[kControlTypeOffset]
+          != static_cast<uint8_t>(ControlType::Probe)) {
+    return false;
   }
 
+  return cipher_ == nullptr || cipher_->Open(packet, kHeaderSize);
+}
+
+uint32_t RadioInterface::GetSessionToken(const std::vector<uint8_t>& packet) {
+  uint32_t session_token = 0;
+  for (size_t i = 0; i < 4; i++) {
+    session_token |= static_cast<uint32_t>(packet[kSessionTokenOffset + i])
+        << (i * 8);
+  }
+
+  return session_token;
+}
+
+bool RadioInterface::GetConfigurePacketConfig(
+    const std::vector<uint8_t>& packet, RadioConfig& config) {
+  uint8_t data_rate = packet[kConfigDataRateOffset];
+  if (packet[kConfigChannelOffset] >= 128 || data_rate > RF24_250KBPS) {
+    return false;
+  }
+
+  config.channel = packet[kConfigChannelOffset];
+  config.data_rate = static_cast<rf24_datarate_e>(data_rate);
   return true;
 }
 
-void RadioInterface::WriteTunnel() {
-  int bytes_written = write(tunnel_fd_,
-      frame_buffer_.data(), frame_buffer_.size());
-  if (tunnel_logs_enabled_) {
-    LOGI("Writing %d bytes to the tunnel", frame_buffer_.size());
+bool RadioInterface::ValidateResumeState(const std::vector<uint8_t>& packet) {
+  if (session_token_ == 0 || GetSessionToken(packet) != session_token_
+      || (cipher_ != nullptr && !cipher_->HasSession())) {
+    return false;
+  }
+
+  // The next ID of the peer must be the last ID received from it, if the
+  // acknowledgement was lost, or the one after it.
+  uint8_t peer_next_id = packet[kResumeIDsOffset] & kIDMask;
+  if (last_ack_id_.has_value()) {
+    if (peer_next_id != last_ack_id_.value()
+        && peer_next_id != NextID(last_ack_id_.value())) {
+      return false;
+    }
+  } else if (peer_next_id != 1) {
+    return false;
   }
 
-  frame_buffer_.clear();
-  if (bytes_written < 0) {
-    LOGE("Failed to write to tunnel %s (%d)", strerror(errno), errno);
+  // Likewise for the local next ID and the last ID the peer received.
+  uint8_t peer_last_ack_id = (packet[kResumeIDsOffset] >> 4) & kIDMask;
+  if (peer_last_ack_id != 0) {
+    if (next_id_ != peer_last_ack_id && next_id_ != NextID(peer_last_ack_id)) {
+      return false;
+    }
+  } else if (next_id_ != 1) {
+    return false;
   }
+
+  if (cipher_ != nullptr) {
+    uint64_t peer_tx_counter = 0;
+    for (size_t i = 0; i < kResumeCounterSize; i++) {
+      peer_tx_counter |= static_cast<uint64_t>(
+          packet[kResumeCounterOffset + i]) << (i * 8);
+    }
+
+    cipher_->ResumeSession(peer_tx_counter);
+  }
+
+  return true;
 }
 
 }  // namespace nerfnet
@@ -17,15 +17,25 @@
 #ifndef NERFNET_NET_RADIO_INTERFACE_H_
 #define NERFNET_NET_RADIO_INTERFACE_H_
 
+#include <array>
 #include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <RF24/RF24.h>
-#include <thread>
+#include <string>
 #include <vector>
 
+#include "nerfnet/net/capture_tap.h"
+#include "nerfnet/net/delivery_classifier.h"
+#include "nerfnet/net/frame_spool.h"
+#include "nerfnet/net/link_cipher.h"
+#include "nerfnet/net/radio.h"
+#include "nerfnet/net/tunnel.h"
 #include "nerfnet/util/non_copyable.h"
+#include "nerfnet/util/time.h"
 
 namespace nerfnet {
 
@@ -33,10 +43,30 @@ namespace nerfnet {
 class RadioInterface : public NonCopyable {
  public:
   // Setup the radio interface.
-  RadioInterface(uint16_t ce_pin, int tunnel_fd,
+  RadioInterface(Radio& radio, Tunnel& tunnel,
                  uint32_t primary_addr, uint32_t secondary_addr,
-                 uint8_t channel);
-  ~RadioInterface();
+                 uint8_t channel, bool is_primary);
+  virtual ~RadioInterface();
+
+  // Datagrams are carried over the link as frames that start with their
+  // channel ID. IP packets start with a version of 4 or 6 in the upper
+  // nibble of the first byte, so channels are limited to the lower nibble.
+  static constexpr uint8_t kMaxDatagramChannel = 0x0f;
+  static constexpr size_t kMaxDatagramSize = 512;
+
+  // The default size up to which frames are sent ahead of larger frames,
+  // which covers TCP acks, DNS queries and interactive sessions.
+  static constexpr size_t kDefaultInterleaveMaxSize = 128;
+
+  // Called with the channel and payload of datagrams received from the peer.
+  using DatagramHandler =
+      std::function<void(uint8_t channel, const uint8_t* data, size_t size)>;
+
+  // Runs the interface until stopped.
+  virtual void Run() = 0;
+
+  // Stops the interface, causing Run to return.
+  void Stop() { running_ = false; }
 
   // The possible results of a request operation.
   enum class RequestResult {
@@ -53,52 +83,342 @@ class RadioInterface : public NonCopyable {
     TransmitError,
   };
 
+  // The radio parameters that must match on both sides of the link.
+  struct RadioConfig {
+    uint8_t channel;
+    rf24_datarate_e data_rate;
+
+    bool operator==(const RadioConfig& other) const {
+      return channel == other.channel && data_rate == other.data_rate;
+    }
+
+    bool operator!=(const RadioConfig& other) const {
+      return !(*this == other);
+    }
+  };
+
   void SetTunnelLogsEnabled(bool enabled) { tunnel_logs_enabled_ = enabled; }
+  bool GetTunnelLogsEnabled() const { return tunnel_logs_enabled_; }
+
+  // Enables authenticated encryption of all packets with the supplied
+  // pre-shared key. Must be called before running the interface.
+  void SetEncryptionKey(const std::vector<uint8_t>& key);
+
+  // Returns an MTU for the tunnel that splits into a whole number of packets
+  // so that full sized frames do not waste the end of their final packet. It
+  // is at least the minimum MTU of IPv6.
+  uint16_t GetChunkAlignedMtu() const;
+
+  // Sets the MTU of the tunnel interface. The MSS of TCP SYN packets crossing
+  // the link in either direction is clamped so that segments fit the MTU and
+  // kPacketsPerSegment packets. Hosts routed over the link then do not send
+  // segments that must be fragmented, and a full sized segment does not hold
+  // the link for too long ahead of interactive traffic.
+  void SetTunnelMtu(uint16_t mtu);
+
+  // Enables removing queued TCP acknowledgements that are made redundant by
+  // a newer acknowledgement for the same flow.
+  void SetAckFilterEnabled(bool enabled) { ack_filter_enabled_ = enabled; }
+  bool GetAckFilterEnabled() const { return ack_filter_enabled_; }
+
+  // Sets the size up to which frames are sent ahead of larger frames. Their
+  // chunks are interleaved with those of a larger frame in flight, so that
+  // they do not wait for it to complete. Zero sends frames in order.
+  void SetInterleaveMaxSize(size_t size) { interleave_max_size_ = size; }
+  size_t GetInterleaveMaxSize() const { return interleave_max_size_; }
+
+  // Sets the interval between polls of the secondary, or the time to sleep
+  // while idle in full-duplex mode. Unused by the secondary.
+  void SetPollIntervalUs(uint64_t interval_us) {
+    poll_interval_us_ = interval_us;
+  }
+  uint64_t GetPollIntervalUs() const { return poll_interval_us_; }
+
+  // Sets the upper bound of the backoff applied while the link is failing.
+  void SetMaxBackoffUs(uint64_t backoff_us) { max_backoff_us_ = backoff_us; }
+  uint64_t GetMaxBackoffUs() const { return max_backoff_us_; }
+
+  // Sets the automatic retransmission delay, in units of 250us, and count
+  // used by the radio. Must be called before running the interface.
+  void SetRetries(uint8_t delay, uint8_t count) {
+    radio_.SetRetries(delay, count);
+  }
+
+  // Sets the maximum number of frames queued for the link. Reading from the
+  // tunnel pauses while the queue is full.
+  void SetMaxBufferedFrames(size_t frames) { max_buffered_frames_ = frames; }
+  size_t GetMaxBufferedFrames() const { return max_buffered_frames_; }
+
+  // Sets the transmit power of the radio. The change is applied by the thread
+  // running the interface.
+  void SetPALevel(rf24_pa_dbm_e pa_level);
+  rf24_pa_dbm_e GetPALevel();
+
+  // Returns the radio config in use by both sides of the link.
+  RadioConfig GetRadioConfig();
+
+  // Returns the most recently requested radio config, which is the config in
+  // use if there is no change pending.
+  RadioConfig GetRequestedRadioConfig();
+
+  // Requests a change of the radio config. The change is coordinated with
+  // the peer in-band and takes effect once acknowledged. Returns false if the
+  // interface does not support changing the radio config at runtime.
+  virtual bool RequestRadioConfig(const RadioConfig& config);
+
+  // Runs the interface with real-time scheduling. The calling thread, which
+  // must be the one to call Run, and the tunnel thread are given SCHED_FIFO
+  // priority and pinned to the supplied CPUs, or left unpinned if negative.
+  // The tunnel threads run one priority level below the radio. Memory is
+  // locked and buffers are prefaulted so that page faults do not stall the
+  // radio. Requires root.
+  void EnableRealtime(int radio_cpu, int tunnel_cpu, int priority);
+
+  // Sets the interval to log the distribution of turnaround times over, or
+  // zero to disable. The primary measures from sending a request until the
+  // response arrives and the secondary from receiving a request until the
+  // response is sent. Must be called before running the interface.
+  void SetTurnaroundReportIntervalUs(uint64_t interval_us) {
+    turnaround_report_interval_us_ = interval_us;
+  }
+
+  // Captures frames and radio packets to a pcapng file at the supplied path,
+  // with the IDs, acknowledgement outcome and queueing time of each. Must be
+  // called before running the interface.
+  void EnableCapture(const std::string& path);
+
+  // Stores frames and datagrams matching the spool rules of the delivery
+  // classifier in a file at the supplied path, holding at most the supplied
+  // number of bytes. Spooled frames are sent while the link is otherwise
+  // idle, and wait out outages without filling the queue of frames for the
+  // link. Must be called before running the interface.
+  void EnableSpool(const std::string& path, size_t size);
+
+  // Queues a datagram for the peer on the supplied channel, bypassing the
+  // tunnel. Returns false if the channel or size is invalid or the queue of
+  // frames for the link, or the spool for spooled channels, is full.
+  bool SendDatagram(uint8_t channel, const uint8_t* data, size_t size);
+
+  // Sets the function to call with datagrams received from the peer, or
+  // null to drop them. The function is called from the thread that writes
+  // to the tunnel.
+  void SetDatagramHandler(DatagramHandler handler);
+
+  // Sets the classifier that selects frames read from the tunnel for
+  // best-effort delivery. Best-effort frames are sent ahead of reliable
+  // frames, but are dropped if they have not started crossing the link by
+  // their deadline. Frames matching its spool rules are spooled when a
+  // spool is enabled.
+  void SetDeliveryClassifier(const DeliveryClassifier& classifier);
+
+  // Saves the session so that a replacement process can continue it without
+  // resetting the link, including the sequence state, queued frames and
+  // received frames not yet written to the tunnel. The tunnel threads are
+  // stopped first so that no frames are lost. Must be called after Run has
+  // returned. Returns false if the interface does not support this.
+  bool SaveState(std::vector<uint8_t>& state);
+
+  // Restores a session saved by SaveState. Must be called before running the
+  // interface, after enabling encryption if it was enabled when saving.
+  // Returns false if the state does not match this interface.
+  bool RestoreState(const std::vector<uint8_t>& state);
 
  protected:
+  // The number of packets that make up a full sized TCP segment. This
+  // balances the overhead of IP and TCP headers against the time that a
+  // full sized segment occupies the link ahead of interactive traffic.
+  static constexpr size_t kPacketsPerSegment = 10;
+
   // The number of microseconds to poll over.
   static constexpr uint32_t kPollIntervalUs = 1000;
 
+  // The maximum number of turnaround times kept between reports. Storage is
+  // allocated up front so that recording does not allocate.
+  static constexpr size_t kMaxTurnaroundSamples = 65536;
+
+  // The default upper bound of the backoff applied while the link is failing.
+  static constexpr uint64_t kDefaultMaxBackoffUs = 50000;
+
+  // The default maximum number of network frames to buffer for the link.
+  static constexpr size_t kDefaultMaxBufferedFrames = 1024;
+
+  // The number of received frames that can wait to be written to the
+  // tunnel, and the longest time the writer waits before checking whether
+  // the interface is stopping.
+  static constexpr size_t kTunnelWriteQueueSize = 8;
+  static constexpr uint64_t kTunnelWriterWaitUs = 100000;
+
+  // The time without hearing from the peer after which a side that has
+  // changed its radio config falls back to the one it was started with. This
+  // recovers the link if the peer has restarted or missed the change.
+  static constexpr uint64_t kRadioConfigRevertUs = 2000000;
+
   // The maximum size of a packet.
   static constexpr size_t kMaxPacketSize = 32;
-  static constexpr size_t kMaxPayloadSize = kMaxPacketSize - 2;
+  static constexpr size_t kHeaderSize = 2;
+  static constexpr size_t kMaxPayloadSize = kMaxPacketSize - kHeaderSize;
+
+  // The second byte of the TxRx header carries the stream of the payload in
+  // the upper bits and the number of bytes left in its frame in the lower
+  // bits. The count saturates, which only needs to distinguish the final
+  // chunk of a frame. Each stream is reassembled separately so that chunks of
+  // frames on different streams can be interleaved.
+  static constexpr uint8_t kStreamShift = 5;
+  static constexpr size_t kNumStreams = 8;
+  static constexpr uint8_t kMaxBytesLeft = 0x1f;
+  static_assert(kMaxPayloadSize < kMaxBytesLeft,
+      "The bytes left must identify the final chunk");
 
   // The default pipe to use for sending data.
   static constexpr uint8_t kPipeId = 1;
 
+  // The version of the format written by SaveState.
+  static constexpr uint8_t kStateVersion = 4;
+
   // The mask for IDs.
   static constexpr uint8_t kIDMask = 0x0f;
 
+  // The types of control packets. Control packets are identified by a zero
+  // first byte, which is never a valid TxRx header as it lacks an ID.
+  enum class ControlType : uint8_t {
+    // Discards all sequence state and starts a new session.
+    Reset = 0x00,
+
+    // Continues the current session after an outage.
+    Resume = 0x01,
+
+    // Sent in response to a resume that does not match the current session.
+    ResumeReject = 0x02,
+
+    // Changes the radio config of the link. The secondary echoes the request
+    // and then switches to the new config.
+    Configure = 0x03,
+
+    // Measures the link. The secondary answers with a probe of the requested
+    // size carrying its timestamps. Probes are protected by the session
+    // cipher like TxRx packets rather than with the pre-shared key.
+    Probe = 0x04,
+  };
+
+  // The layout of control packets. The salt used by the cipher is carried
+  // between the type and the session token.
+  static constexpr size_t kControlTypeOffset = 1;
+  static constexpr size_t kSessionTokenOffset =
+      LinkCipher::kSaltOffset + LinkCipher::kSaltSize;
+  static constexpr size_t kResumeIDsOffset = kSessionTokenOffset + 4;
+  static constexpr size_t kResumeCounterOffset = kResumeIDsOffset + 1;
+  static constexpr size_t kResumeCounterSize = 5;
+  static constexpr size_t kConfigChannelOffset = kSessionTokenOffset + 4;
+  static constexpr size_t kConfigDataRateOffset = kConfigChannelOffset + 1;
+
+  // The layout of probe packets. The times are truncated to 32 bits and the
+  // received count is the number of probes the secondary has received.
+  static constexpr size_t kProbeSequenceOffset = 2;
+  static constexpr size_t kProbePrimarySentOffset = 4;
+  static constexpr size_t kProbeSecondaryReceivedOffset = 8;
+  static constexpr size_t kProbeSecondarySentOffset = 12;
+  static constexpr size_t kProbeReceivedCountOffset = 16;
+  static constexpr size_t kProbeResponseSizeOffset = 18;
+  static constexpr size_t kMinProbeSize = kProbeResponseSizeOffset + 1;
+
   // A tunnel Tx/Rx request exchanged between systems.
   struct TunnelTxRxPacket {
     std::optional<uint8_t> id;
     std::optional<uint8_t> ack_id;
 
+    uint8_t stream = 0;
     uint8_t bytes_left = 0;
     std::vector<uint8_t> payload;
   };
 
   // The underlying radio.
-  RF24 radio_;
+  Radio& radio_;
 
-  // The file descriptor for the network tunnel.
-  const int tunnel_fd_;
+  // The network tunnel to exchange frames with.
+  Tunnel& tunnel_;
 
   // The addresses to use for this radio pair.
   const uint32_t primary_addr_;
   const uint32_t secondary_addr_;
 
+  // Whether this is the primary side of the link.
+  const bool is_primary_;
+
   // The thread to read from the tunnel interface on.
-  std::thread tunnel_thread_;
+  ClockThread tunnel_thread_;
   std::atomic<bool> running_;
 
+  // The thread to write received frames to the tunnel interface on, so that
+  // the radio never waits on the tunnel, and the queue of frames for it to
+  // write. Frames are swapped into the slots of the queue so that buffers
+  // are reused instead of allocated.
+  ClockThread tunnel_writer_thread_;
+  std::mutex write_queue_mutex_;
+  std::condition_variable write_queue_cv_;
+  std::vector<std::vector<uint8_t>> write_queue_;
+  size_t write_queue_head_;
+  size_t write_queue_size_;
+
+  // The function to deliver received datagrams to and its lock, which is
+  // held while delivering.
+  std::mutex datagram_handler_mutex_;
+  DatagramHandler datagram_handler_;
+
+  // Set when frames have been queued since the writer was last woken. Only
+  // used by the thread running the interface.
+  bool tunnel_writer_notify_pending_;
+
   // The buffer of data read and lock.
   std::mutex read_buffer_mutex_;
   std::deque<std::vector<uint8_t>> read_buffer_;
 
-  // The frame buffer for the currently incoming frame. Written out to
-  // the tunnel interface when completely received.
-  std::vector<uint8_t> frame_buffer_;
+  // A frame taken from the read buffer to be sent on a stream and the number
+  // of its bytes that have been acknowledged by the peer. The stream is free
+  // while the frame is empty.
+  // Spooled frames stay in the spool until they have been sent.
+  struct TxStream {
+    std::vector<uint8_t> frame;
+    size_t offset = 0;
+    bool spooled = false;
+  };
+
+  // The frames being sent, indexed by stream, and the stream of the payload
+  // last populated, which is sent again until it is acknowledged. An empty
+  // payload is also kept until it is acknowledged, as the peer drops the
+  // payload of a retransmitted ID.
+  std::array<TxStream, kNumStreams> tx_streams_;
+  std::optional<uint8_t> tx_stream_;
+  bool tx_payload_populated_ = false;
+
+  // The size up to which frames are sent ahead of larger frames.
+  std::atomic<size_t> interleave_max_size_;
+
+  // A best-effort frame and the time by which it must start being sent.
+  struct BestEffortFrame {
+    std::vector<uint8_t> frame;
+    uint64_t deadline_us;
+  };
+
+  // The classifier for frames read from the tunnel and its lock. Frames are
+  // classified before the read buffer lock is taken. The lock also guards
+  // the spool pointer for the tunnel thread.
+  std::mutex delivery_mutex_;
+  DeliveryClassifier delivery_classifier_;
+
+  // The best-effort frames waiting to be moved to the head of the read
+  // buffer. Guarded by the read buffer lock.
+  std::deque<BestEffortFrame> best_effort_buffer_;
+
+  // The spool of delay tolerant frames, null when spooling is disabled. It
+  // is set once, with both the read buffer lock and the delivery lock held.
+  std::unique_ptr<FrameSpool> spool_;
+
+  // The incoming frame on each stream. Written out to the tunnel interface
+  // when completely received.
+  std::array<std::vector<uint8_t>, kNumStreams> frame_buffers_;
+
+  // The token identifying the current session, zero when there is none.
+  uint32_t session_token_;
 
   // The next ID for packet ID generation.
   uint8_t next_id_;
@@ -107,7 +427,84 @@ class RadioInterface : public NonCopyable {
   std::optional<uint8_t> last_ack_id_;
 
   // Whether to log successful tunnel read/write operations.
-  bool tunnel_logs_enabled_;
+  std::atomic<bool> tunnel_logs_enabled_;
+
+  // The poll interval, backoff bound and queue limit, which can be changed
+  // while running.
+  std::atomic<uint64_t> poll_interval_us_;
+  std::atomic<uint64_t> max_backoff_us_;
+  std::atomic<size_t> max_buffered_frames_;
+
+  // Guards the radio settings that are changed from other threads.
+  std::mutex settings_mutex_;
+
+  // The transmit power and a change that is yet to be applied.
+  rf24_pa_dbm_e pa_level_;
+  bool pa_level_pending_;
+
+  // The radio config the interface was started with, the config in use by
+  // both sides of the link and a requested change that is yet to be applied.
+  const RadioConfig startup_radio_config_;
+  RadioConfig radio_config_;
+  std::optional<RadioConfig> pending_radio_config_;
+
+  // The MTU that the MSS of TCP SYN packets is clamped to, zero to disable
+  // MSS clamping.
+  std::atomic<uint16_t> mss_clamp_mtu_;
+
+  // Whether to filter redundant TCP acknowledgements from the read buffer.
+  std::atomic<bool> ack_filter_enabled_;
+
+  // The cipher used to protect packets, null when encryption is disabled.
+  std::unique_ptr<LinkCipher> cipher_;
+
+  // The maximum number of payload bytes carried by each packet. This is
+  // reduced by the size of the authentication tag when encryption is enabled.
+  size_t max_payload_size_;
+
+  // The turnaround times recorded since the last report, the interval to
+  // report over and the time that the current interval started.
+  std::vector<uint32_t> turnaround_samples_us_;
+  uint64_t turnaround_report_interval_us_;
+  uint64_t turnaround_report_start_us_;
+
+  // The tap capturing frames and packets, null when capture is disabled. Set
+  // with the read buffer lock held.
+  std::unique_ptr<CaptureTap> capture_tap_;
+
+  // Applies the common configuration to a radio.
+  static void ConfigureRadio(Radio& radio, uint8_t channel);
+
+  // Saves and restores the state specific to the kind of interface, which is
+  // carried at the end of the saved session. Interfaces that can not hand
+  // over their session return false.
+  virtual bool SaveInterfaceState(std::vector<uint8_t>& state);
+  virtual bool RestoreInterfaceState(const std::vector<uint8_t>& state);
+
+  // Stops and joins the tunnel threads.
+  void StopTunnelThreads();
+
+  // Converts an address to the 5 byte form used to open radio pipes.
+  static void GetAddressBytes(uint32_t addr, uint8_t* bytes);
+
+  // Applies settings changed from other threads to the radio. Must be called
+  // periodically by the thread running the interface.
+  void ApplyPendingSettings();
+
+  // Switches the radio to the supplied config. This does not change the
+  // config recorded as in use by both sides.
+  void ApplyRadioConfig(const RadioConfig& config);
+
+  // Records the config in use by both sides of the link, clearing the
+  // pending change if it has been reached.
+  void SetRadioConfig(const RadioConfig& config);
+
+  // Returns the requested change of the radio config, if any.
+  std::optional<RadioConfig> GetPendingRadioConfig();
+
+  // Records the turnaround time of an exchange that started at the supplied
+  // time, logging the distribution once the report interval has elapsed.
+  void RecordTurnaround(uint64_t start_us);
 
   // Sends a message over the radio.
   RequestResult Send(const std::vector<uint8_t>& request);
@@ -119,8 +516,43 @@ class RadioInterface : public NonCopyable {
   // Returns the size of the read buffer.
   size_t GetReadBufferSize();
 
-  // Returns the size of the next payload to send.
-  size_t GetTransferSize(const std::vector<uint8_t>& frame);
+  // Returns the size of the next payload to send from a stream.
+  size_t GetTransferSize(const TxStream& stream);
+
+  // Opens the next frame to send on a free stream, if any, and returns the
+  // stream of the frame with the fewest bytes left to send. A large frame is
+  // only opened once no frame is in flight. Frames up to the interleave size
+  // are opened ahead of it, one at a time, to be sent between its chunks.
+  // Best-effort frames are opened ahead of the read buffer and the oldest
+  // spooled frame is opened once the link is otherwise idle. The read buffer
+  // lock must be held.
+  std::optional<uint8_t> SelectTxStream();
+
+  // Populates the payload of a TxRx packet from the frames being sent. The
+  // same payload is populated until it is acknowledged. The read buffer lock
+  // must be held.
+  void PopulateTxPayload(TunnelTxRxPacket& tunnel);
+
+  // Moves past the payload last populated once it has been acknowledged. The
+  // read buffer lock must be held.
+  void AdvanceTxPayload();
+
+  // Returns the spool to store a frame in, or null if it is not spooled.
+  // Otherwise supplies the deadline of a best-effort frame, or zero if it is
+  // to be delivered reliably.
+  FrameSpool* ClassifyFrame(const std::vector<uint8_t>& frame,
+                            uint64_t& deadline_us);
+
+  // Drops best-effort frames past their deadline. The read buffer lock must
+  // be held.
+  void DropExpiredBestEffortFrames();
+
+  // Drops best-effort frames past their deadline and moves the next one to
+  // the head of the read buffer. The read buffer lock must be held.
+  void PromoteBestEffortFrame();
+
+  // Returns the ID that follows the supplied ID.
+  static uint8_t NextID(uint8_t id);
 
   // Advances the packet ID counter.
   void AdvanceID();
@@ -131,14 +563,87 @@ class RadioInterface : public NonCopyable {
   // Reads from the tunnel and buffers data read.
   void TunnelThread();
 
+  // Writes queued frames to the tunnel.
+  void TunnelWriterThread();
+
   // Encode/decode functions for TunnelTxRxPackets.
-  bool DecodeTunnelTxRxPacket(const std::vector<uint8_t>& request,
+  bool DecodeTunnelTxRxPacket(const std::vector<uint8_t>& packet,
       TunnelTxRxPacket& tunnel);
   bool EncodeTunnelTxRxPacket(const TunnelTxRxPacket& tunnel,
       std::vector<uint8_t>& request);
 
-  // Writes the current frame buffer to the tunnel.
-  void WriteTunnel();
+  // Returns false if a received payload completes a frame while the tunnel
+  // write queue is full. The chunk is then not acknowledged, so that the peer
+  // retransmits it once the tunnel writer catches up.
+  bool CanReceivePayload(const TunnelTxRxPacket& tunnel);
+
+  // Appends a received payload to the frame buffer of its stream, writing
+  // the frame to the tunnel once complete.
+  void ReceivePayload(const TunnelTxRxPacket& tunnel);
+
+  // Queues a frame to be written to the tunnel and clears it. The frame is
+  // dropped if the queue is full, which only happens in the broadcast mode
+  // since the other modes check CanReceivePayload first. The writer is not
+  // woken until NotifyTunnelWriter is called.
+  void WriteTunnel(std::vector<uint8_t>& frame);
+
+  // Wakes the tunnel writer if frames have been queued. Waking the writer
+  // takes a system call, so this is called once the radio has responded.
+  void NotifyTunnelWriter();
+
+  // Discards the sequence state and starts a new session. Partially sent
+  // frames are restarted and partially received frames are discarded since
+  // the peer no longer has them. Queued frames are kept.
+  void ResetSession(uint32_t session_token);
+
+  // Builds a control packet carrying the session token. Resume packets also
+  // carry the sequence state and configure packets carry the radio config.
+  // The packet is sealed when encryption is enabled, binding the salt of the
+  // peer when supplied.
+  std::vector<uint8_t> BuildControlPacket(ControlType type,
+      const std::vector<uint8_t>& peer_salt = {},
+      const RadioConfig& config = {});
+
+  // Returns the size of a control packet of the supplied type, including the
+  // tag when encryption is enabled.
+  size_t GetControlPacketSize(ControlType type) const;
+
+  // Verifies the size of a control packet from the peer and authenticates it
+  // when encryption is enabled.
+  bool OpenControlPacket(const std::vector<uint8_t>& packet,
+      const std::vector<uint8_t>& peer_salt = {});
+
+  // Returns the session token carried in a control packet.
+  static uint32_t GetSessionToken(const std::vector<uint8_t>& packet);
+
+  // Returns the radio config carried in a configure packet. Returns false if
+  // the config is invalid.
+  static bool GetConfigurePacketConfig(const std::vector<uint8_t>& packet,
+      RadioConfig& config);
+
+  // Returns the smallest size of a probe packet, including the tag when
+  // encryption is enabled.
+  size_t GetMinProbePacketSize() const;
+
+  // Sets and returns a little-endian field of a probe packet.
+  static void SetProbeField(std::vector<uint8_t>& packet, size_t offset,
+      uint32_t value, size_t size);
+  static uint32_t GetProbeField(const std::vector<uint8_t>& packet,
+      size_t offset, size_t size);
+
+  // Seals a probe packet when encryption is enabled. The tag is written over
+  // the final bytes of the packet.
+  void SealProbePacket(std::vector<uint8_t>& packet);
+
+  // Verifies the size of a probe packet from the peer and decrypts it in
+  // place when encryption is enabled.
+  bool OpenProbePacket(std::vector<uint8_t>& packet);
+
+  // Checks that the sequence state in a resume packet from the peer is
+  // consistent with the local state, in which case any chunk in flight on
+  // either side is resolved by the normal TxRx exchange. The cipher is
+  // resynchronized with the counter of the peer on success.
+  bool ValidateResumeState(const std::vector<uint8_t>& packet);
 };
 
 }  // namespace nerfnet
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/rf24_radio.h"
+
+#include <algorithm>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+
+RF24Radio::RF24Radio(uint16_t ce_pin, uint8_t cs_pin)
+    : radio_(ce_pin, cs_pin) {
+  CHECK(radio_.begin(), "Failed to start NRF24L01");
+  radio_.setAddressWidth(3);
+  radio_.setAutoAck(1);
+  radio_.setCRCLength(RF24_CRC_8);
+  radio_.enableDynamicPayloads();
+  radio_.enableDynamicAck();
+  CHECK(radio_.isChipConnected(), "NRF24L01 is unavailable");
+}
+
+void RF24Radio::SetChannel(uint8_t channel) {
+  radio_.setChannel(channel);
+}
+
+void RF24Radio::SetDataRate(rf24_datarate_e data_rate) {
+  radio_.setDataRate(data_rate);
+}
+
+void RF24Radio::SetPALevel(rf24_pa_dbm_e pa_level) {
+  radio_.setPALevel(pa_level);
+}
+
+void RF24Radio::SetRetries(uint8_t delay, uint8_t count) {
+  radio_.setRetries(delay, count);
+}
+
+void RF24Radio::OpenWritingPipe(const uint8_t* addr) {
+  radio_.openWritingPipe(addr);
+}
+
+void RF24Radio::OpenReadingPipe(uint8_t pipe, const uint8_t* addr) {
+  radio_.openReadingPipe(pipe, addr);
+}
+
+void RF24Radio::StartListening() {
+  radio_.startListening();
+}
+
+void RF24Radio::StopListening() {
+  radio_.stopListening();
+}
+
+bool RF24Radio::Write(const uint8_t* data, size_t size) {
+  return radio_.write(data, size);
+}
+
+bool RF24Radio::WriteNoAck(const uint8_t* data, size_t size) {
+  return radio_.write(data, size, /*multicast=*/true);
+}
+
+bool RF24Radio::TxStandBy() {
+  return radio_.txStandBy();
+}
+
+bool RF24Radio::TestCarrier() {
+  return radio_.testRPD();
+}
+
+bool RF24Radio::Available() {
+  return radio_.available();
+}
+
+size_t RF24Radio::Read(uint8_t* data, size_t size) {
+  // A corrupt payload length reads as zero after the FIFO is flushed.
+  size = std::min(size, static_cast<size_t>(radio_.getDynamicPayloadSize()));
+  radio_.read(data, size);
+  return size;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_RF24_RADIO_H_
+#define NERFNET_NET_RF24_RADIO_H_
+
+#include "nerfnet/net/radio.h"
+
+namespace nerfnet {
+
+// A radio driven by the RF24 library.
+class RF24Radio : public Radio {
+ public:
+  // Starts the radio attached to the supplied chip-enable pin and SPI
+  // chip-select. Quits and logs the error if the radio is unavailable.
+  RF24Radio(uint16_t ce_pin, uint8_t cs_pin);
+
+  // Radio implementation.
+  void SetChannel(uint8_t channel) final;
+  void SetDataRate(rf24_datarate_e data_rate) final;
+  void SetPALevel(rf24_pa_dbm_e pa_level) final;
+  void SetRetries(uint8_t delay, uint8_t count) final;
+  void OpenWritingPipe(const uint8_t* addr) final;
+  void OpenReadingPipe(uint8_t pipe, const uint8_t* addr) final;
+  void StartListening() final;
+  void StopListening() final;
+  bool Write(const uint8_t* data, size_t size) final;
+  bool WriteNoAck(const uint8_t* data, size_t size) final;
+  bool TxStandBy() final;
+  bool TestCarrier() final;
+  bool Available() final;
+  size_t Read(uint8_t* data, size_t size) final;
+
+ private:
+  // The underlying radio.
+  RF24 radio_;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_RF24_RADIO_H_
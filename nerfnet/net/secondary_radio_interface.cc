@@ -16,6 +16,7 @@
 
 #include "nerfnet/net/secondary_radio_interface.h"
 
+#include <algorithm>
 #include <unistd.h>
 #include <vector>
 
@@ -25,69 +26,120 @@
 namespace nerfnet {
 
 SecondaryRadioInterface::SecondaryRadioInterface(
-    uint16_t ce_pin, int tunnel_fd,
+    Radio& radio, Tunnel& tunnel,
     uint32_t primary_addr, uint32_t secondary_addr, uint8_t channel)
-    : RadioInterface(ce_pin, tunnel_fd, primary_addr, secondary_addr, channel),
-      payload_in_flight_(false) {
-  uint8_t writing_addr[5] = {
-    static_cast<uint8_t>(secondary_addr),
-    static_cast<uint8_t>(secondary_addr >> 8),
-    static_cast<uint8_t>(secondary_addr >> 16),
-    static_cast<uint8_t>(secondary_addr >> 24),
-    0,
-  };
-
-  uint8_t reading_addr[5] = {
-    static_cast<uint8_t>(primary_addr),
-    static_cast<uint8_t>(primary_addr >> 8),
-    static_cast<uint8_t>(primary_addr >> 16),
-    static_cast<uint8_t>(primary_addr >> 24),
-    0,
-  };
-
-  radio_.openWritingPipe(writing_addr);
-  radio_.openReadingPipe(kPipeId, reading_addr);
+    : RadioInterface(radio, tunnel, primary_addr, secondary_addr, channel,
+                     /*is_primary=*/false),
+      payload_in_flight_(false),
+      probes_received_(0),
+      pending_session_token_(0) {
+  uint8_t writing_addr[5];
+  GetAddressBytes(secondary_addr, writing_addr);
+  uint8_t reading_addr[5];
+  GetAddressBytes(primary_addr, reading_addr);
+
+  radio_.OpenWritingPipe(writing_addr);
+  radio_.OpenReadingPipe(kPipeId, reading_addr);
 }
 
 void SecondaryRadioInterface::Run() {
   uint8_t packet[kMaxPacketSize];
 
-  while (1) {
+  uint64_t last_request_us = TimeNowUs();
+  while (running_) {
+    ApplyPendingSettings();
     std::vector<uint8_t> request(kMaxPacketSize, 0x00);
-    auto result = Receive(request);
+    auto result = Receive(request, kSettingsPollIntervalUs);
     if (result == RequestResult::Success) {
-      HandleRequest(request);
+      last_request_us = TimeNowUs();
+      HandleRequest(request, last_request_us);
+      NotifyTunnelWriter();
+    } else if (TimeNowUs() - last_request_us > kRadioConfigRevertUs
+        && GetRadioConfig() != startup_radio_config_) {
+      LOGW("No requests received, reverting to the startup radio config");
+      ApplyRadioConfig(startup_radio_config_);
+      SetRadioConfig(startup_radio_config_);
     }
   }
 }
 
 void SecondaryRadioInterface::HandleRequest(
-    const std::vector<uint8_t>& request) {
-  if (request.size() != kMaxPacketSize) {
+    const std::vector<uint8_t>& request, uint64_t received_us) {
+  if (request.size() < kHeaderSize) {
     LOGE("Received short packet");
   } else if (request[0] == 0x00) {
-    HandleNetworkTunnelReset();
+    if (request[kControlTypeOffset]
+        == static_cast<uint8_t>(ControlType::Resume)) {
+      HandleNetworkTunnelResume(request);
+    } else if (request[kControlTypeOffset]
+        == static_cast<uint8_t>(ControlType::Configure)) {
+      HandleRadioConfigure(request);
+    } else if (request[kControlTypeOffset]
+        == static_cast<uint8_t>(ControlType::Probe)) {
+      HandleProbe(request, received_us);
+    } else {
+      HandleNetworkTunnelReset(request);
+    }
   } else {
-    HandleNetworkTunnelTxRx(request);
+    HandleNetworkTunnelTxRx(request, received_us);
   }
 }
 
-void SecondaryRadioInterface::HandleNetworkTunnelReset() {
-  next_id_ = 1;
-  last_ack_id_.reset();
-  frame_buffer_.clear();
-  payload_in_flight_ = false;
+void SecondaryRadioInterface::HandleNetworkTunnelReset(
+    const std::vector<uint8_t>& request) {
+  if (!OpenControlPacket(request)) {
+    LOGE("Failed to authenticate tunnel reset request");
+    return;
+  }
 
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
   LOGI("Responding to tunnel reset request");
-  std::vector<uint8_t> response(kMaxPacketSize, 0x00);
+  auto primary_salt = LinkCipher::GetSalt(request);
+  auto response = BuildControlPacket(ControlType::Reset, primary_salt);
+  if (cipher_ != nullptr) {
+    // The request may have been recorded and replayed, so the session is
+    // only reset once the primary proves that it received the response.
+    pending_session_token_ = GetSessionToken(request);
+    cipher_->SetPendingSession(primary_salt, LinkCipher::GetSalt(response));
+  } else {
+    ResetSession(GetSessionToken(request));
+    payload_in_flight_ = false;
+  }
+
   auto status = Send(response);
   if (status != RequestResult::Success) {
     LOGE("Failed to send tunnel reset response");
   }
 }
 
-void SecondaryRadioInterface::HandleNetworkTunnelTxRx(
+void SecondaryRadioInterface::HandleNetworkTunnelResume(
     const std::vector<uint8_t>& request) {
+  if (!OpenControlPacket(request)) {
+    LOGE("Failed to authenticate tunnel resume request");
+    return;
+  }
+
+  // The session is kept as-is, including the frame in flight in each
+  // direction, so that the link continues without losing frames.
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+  auto type = ControlType::Resume;
+  if (ValidateResumeState(request)) {
+    LOGI("Responding to tunnel resume request");
+  } else {
+    LOGW("Rejecting tunnel resume request");
+    type = ControlType::ResumeReject;
+  }
+
+  auto response = BuildControlPacket(type, LinkCipher::GetSalt(request));
+  auto status = Send(response);
+  if (status != RequestResult::Success) {
+    LOGE("Failed to send tunnel resume response");
+  }
+}
+
+void SecondaryRadioInterface::HandleNetworkTunnelTxRx(
+    const std::vector<uint8_t>& request, uint64_t received_us) {
+  ConfirmPendingReset(request);
   TunnelTxRxPacket tunnel;
   if (!DecodeTunnelTxRxPacket(request, tunnel)) {
     return;
@@ -100,15 +152,13 @@ void SecondaryRadioInterface::HandleNetworkTunnelTxRx(
     return;
   }
 
-  if (!ValidateID(tunnel.id.value())) {
+  if (!CanReceivePayload(tunnel)) {
+    // The tunnel writer is behind, so the chunk is left unacknowledged.
+  } else if (!ValidateID(tunnel.id.value())) {
     LOGE("Received non-sequential packet: %u vs %u",
         last_ack_id_.value(), tunnel.id.value());
   } else if (!tunnel.payload.empty()) {
-    frame_buffer_.insert(frame_buffer_.end(),
-        tunnel.payload.begin(), tunnel.payload.end());
-    if (tunnel.bytes_left <= kMaxPayloadSize) {
-      WriteTunnel();
-    }
+    ReceivePayload(tunnel);
   }
 
   if (tunnel.ack_id.has_value()) {
@@ -117,15 +167,7 @@ void SecondaryRadioInterface::HandleNetworkTunnelTxRx(
     } else {
       AdvanceID();
       if (payload_in_flight_) {
-        if (!read_buffer_.empty()) {
-          auto& frame = read_buffer_.front();
-          size_t transfer_size = GetTransferSize(frame);
-          frame.erase(frame.begin(), frame.begin() + transfer_size);
-          if (frame.empty()) {
-            read_buffer_.pop_front();
-          }
-        }
-
+        AdvanceTxPayload();
         payload_in_flight_ = false;
       }
     }
@@ -133,14 +175,8 @@ void SecondaryRadioInterface::HandleNetworkTunnelTxRx(
 
   tunnel.id = next_id_;
   tunnel.ack_id = last_ack_id_.value();
-  tunnel.bytes_left = 0;
-  if (!read_buffer_.empty()) {
-    auto& frame = read_buffer_.front();
-    size_t transfer_size = GetTransferSize(frame);
-    tunnel.payload = {frame.begin(), frame.begin() + transfer_size};
-    tunnel.bytes_left = std::min(frame.size(), static_cast<size_t>(UINT8_MAX));
-    payload_in_flight_ = true;
-  }
+  PopulateTxPayload(tunnel);
+  payload_in_flight_ = true;
 
   std::vector<uint8_t> response;
   if (!EncodeTunnelTxRxPacket(tunnel, response)) {
@@ -150,7 +186,101 @@ void SecondaryRadioInterface::HandleNetworkTunnelTxRx(
   auto status = Send(response);
   if (status != RequestResult::Success) {
     LOGE("Failed to send network tunnel txrx response");
+  } else {
+    RecordTurnaround(received_us);
   }
 }
 
+void SecondaryRadioInterface::HandleRadioConfigure(
+    const std::vector<uint8_t>& request) {
+  RadioConfig config;
+  if (!OpenControlPacket(request)) {
+    LOGE("Failed to authenticate radio configure request");
+    return;
+  } else if (!GetConfigurePacketConfig(request, config)) {
+    LOGE("Invalid radio configure request");
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+  if (session_token_ == 0 || GetSessionToken(request) != session_token_) {
+    LOGW("Ignoring radio configure request for another session");
+    return;
+  }
+
+  auto response = BuildControlPacket(ControlType::Configure,
+      LinkCipher::GetSalt(request), config);
+  auto status = Send(response);
+  if (status != RequestResult::Success) {
+    LOGE("Failed to send radio configure response");
+  }
+
+  // Switch even if the response was lost. The primary probes both configs
+  // until it finds this side again.
+  LOGI("Switching to channel %u at data rate %u", config.channel,
+      config.data_rate);
+  ApplyRadioConfig(config);
+  SetRadioConfig(config);
+}
+
+void SecondaryRadioInterface::HandleProbe(
+    const std::vector<uint8_t>& request, uint64_t received_us) {
+  ConfirmPendingReset(request);
+  std::vector<uint8_t> probe = request;
+  if (session_token_ == 0 || !OpenProbePacket(probe)) {
+    LOGE("Failed to open probe");
+    return;
+  }
+
+  probes_received_++;
+  size_t response_size = std::clamp(
+      static_cast<size_t>(probe[kProbeResponseSizeOffset]),
+      GetMinProbePacketSize(), kMaxPacketSize);
+  std::vector<uint8_t> response(response_size, 0x00);
+  SetProbeField(response, kProbeSequenceOffset,
+      GetProbeField(probe, kProbeSequenceOffset, 2), 2);
+  SetProbeField(response, kProbePrimarySentOffset,
+      GetProbeField(probe, kProbePrimarySentOffset, 4), 4);
+  SetProbeField(response, kProbeSecondaryReceivedOffset,
+      static_cast<uint32_t>(received_us), 4);
+  SetProbeField(response, kProbeReceivedCountOffset, probes_received_, 2);
+  SetProbeField(response, kProbeSecondarySentOffset,
+      static_cast<uint32_t>(TimeNowUs()), 4);
+  SealProbePacket(response);
+  auto status = Send(response);
+  if (status != RequestResult::Success) {
+    LOGE("Failed to send probe response");
+  }
+}
+
+void SecondaryRadioInterface::ConfirmPendingReset(
+    const std::vector<uint8_t>& request) {
+  if (pending_session_token_ == 0
+      || !cipher_->StartPendingSession(request, kHeaderSize)) {
+    return;
+  }
+
+  LOGI("Tunnel reset confirmed by the primary");
+  std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+  ResetSession(pending_session_token_);
+  payload_in_flight_ = false;
+  pending_session_token_ = 0;
+}
+
+bool SecondaryRadioInterface::SaveInterfaceState(
+    std::vector<uint8_t>& state) {
+  state.push_back(payload_in_flight_);
+  return true;
+}
+
+bool SecondaryRadioInterface::RestoreInterfaceState(
+    const std::vector<uint8_t>& state) {
+  if (state.size() != 1) {
+    return false;
+  }
+
+  payload_in_flight_ = state[0] != 0;
+  return true;
+}
+
 }  // namespace nerfnet
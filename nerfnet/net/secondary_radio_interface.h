@@ -25,23 +25,47 @@ namespace nerfnet {
 class SecondaryRadioInterface : public RadioInterface {
  public:
   // Setup the secondary radio link.
-  SecondaryRadioInterface(uint16_t ce_pin, int tunnel_fd,
+  SecondaryRadioInterface(Radio& radio, Tunnel& tunnel,
                           uint32_t primary_addr, uint32_t secondary_addr,
                           uint8_t channel);
 
   // Runs the interface listening for commands and responding.
-  void Run();
+  void Run() final;
 
  protected:
-  // Set to true while a payload is in flight.
+  // The time to wait for a request before checking for settings changes.
+  static constexpr uint64_t kSettingsPollIntervalUs = 100000;
+
+  // Set to true while a response is in flight, including one without a
+  // payload, which is sent without a payload until it is acknowledged.
   bool payload_in_flight_;
 
-  // Handles a request from the primary radio.
-  void HandleRequest(const std::vector<uint8_t>& request);
+  // The number of probes received, which wraps around.
+  uint16_t probes_received_;
+
+  // The session token of a reset that is waiting for the primary to use the
+  // new session key, or zero if there is none.
+  uint32_t pending_session_token_;
+
+  // Handles a request from the primary radio received at the supplied time.
+  void HandleRequest(const std::vector<uint8_t>& request,
+                     uint64_t received_us);
 
   // Request handlers.
-  void HandleNetworkTunnelReset();
-  void HandleNetworkTunnelTxRx(const std::vector<uint8_t>& request);
+  void HandleNetworkTunnelReset(const std::vector<uint8_t>& request);
+  void HandleNetworkTunnelResume(const std::vector<uint8_t>& request);
+  void HandleNetworkTunnelTxRx(const std::vector<uint8_t>& request,
+                               uint64_t received_us);
+  void HandleRadioConfigure(const std::vector<uint8_t>& request);
+  void HandleProbe(const std::vector<uint8_t>& request, uint64_t received_us);
+
+  // Resets the session if the request is sealed with the key of a pending
+  // reset.
+  void ConfirmPendingReset(const std::vector<uint8_t>& request);
+
+  // Handoff implementation.
+  bool SaveInterfaceState(std::vector<uint8_t>& state) final;
+  bool RestoreInterfaceState(const std::vector<uint8_t>& state) final;
 };
 
 }  // namespace nerfnet
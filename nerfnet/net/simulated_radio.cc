@@ -0,0 +1,293 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/simulated_radio.h"
+
+#include <algorithm>
+
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+namespace {
+
+// Returns the 3 byte address used by the radios from the pipe address.
+uint32_t GetAddress(const uint8_t* addr) {
+  return addr[0] | (addr[1] << 8) | (addr[2] << 16);
+}
+
+}  // anonymous namespace
+
+SimulatedMedium::SimulatedMedium(const Profile& profile, uint32_t seed)
+    : profile_(profile),
+      random_(seed),
+      fading_(false) {}
+
+bool SimulatedMedium::SampleLoss() {
+  uint64_t now_us = TimeNowUs();
+  if (now_us >= profile_.outage_start_us
+      && now_us - profile_.outage_start_us < profile_.outage_length_us) {
+    return true;
+  }
+
+  std::uniform_real_distribution<double> distribution(0.0, 1.0);
+  if (fading_) {
+    fading_ = distribution(random_) >= 1.0 / profile_.fade_length;
+  } else {
+    fading_ = distribution(random_) < profile_.fade_probability;
+  }
+
+  return fading_ || distribution(random_) < profile_.loss;
+}
+
+SimulatedRadio::SimulatedRadio(SimulatedMedium& medium)
+    : medium_(medium),
+      channel_(0),
+      data_rate_(RF24_1MBPS),
+      retry_delay_(0),
+      retry_count_(0),
+      writing_addr_(0),
+      reading_addr_(0),
+      listening_(false),
+      tx_start_us_(0),
+      tx_end_us_(0) {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  medium_.radios_.push_back(this);
+}
+
+SimulatedRadio::~SimulatedRadio() {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  auto& radios = medium_.radios_;
+  radios.erase(std::remove(radios.begin(), radios.end(), this), radios.end());
+}
+
+void SimulatedRadio::SetChannel(uint8_t channel) {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  channel_ = channel;
+}
+
+void SimulatedRadio::SetDataRate(rf24_datarate_e data_rate) {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  data_rate_ = data_rate;
+}
+
+void SimulatedRadio::SetPALevel(rf24_pa_dbm_e pa_level) {}
+
+void SimulatedRadio::SetRetries(uint8_t delay, uint8_t count) {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  retry_delay_ = delay;
+  retry_count_ = count;
+}
+
+void SimulatedRadio::OpenWritingPipe(const uint8_t* addr) {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  writing_addr_ = GetAddress(addr);
+}
+
+void SimulatedRadio::OpenReadingPipe(uint8_t pipe, const uint8_t* addr) {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  reading_addr_ = GetAddress(addr);
+}
+
+void SimulatedRadio::StartListening() {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  listening_ = true;
+}
+
+void SimulatedRadio::StopListening() {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  listening_ = false;
+}
+
+bool SimulatedRadio::Write(const uint8_t* data, size_t size) {
+  uint8_t retry_delay;
+  uint8_t retry_count;
+  {
+    std::lock_guard<std::mutex> lock(medium_.mutex_);
+    retry_delay = retry_delay_;
+    retry_count = retry_count_;
+  }
+
+  // Each attempt is resolved once it has been on the air, which gives the
+  // receiver time to switch to receive mode as a real radio would.
+  bool delivered = false;
+  uint64_t airtime_us = GetAirtimeUs(size + kPacketOverhead);
+  for (int attempt = 0; attempt <= retry_count; attempt++) {
+    if (attempt > 0) {
+      SleepUs(250 * (retry_delay + 1));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(medium_.mutex_);
+      tx_start_us_ = TimeNowUs() + kSettleTimeUs;
+      tx_end_us_ = tx_start_us_ + airtime_us;
+    }
+
+    SleepUs(kSettleTimeUs + airtime_us);
+    std::lock_guard<std::mutex> lock(medium_.mutex_);
+    SimulatedRadio* receiver = FindReceiver();
+    if (receiver == nullptr || IsChannelBusy(tx_start_us_, tx_end_us_)
+        || medium_.SampleLoss()) {
+      continue;
+    }
+
+    // Retransmissions of a packet that was already received are
+    // acknowledged but discarded, as the receiver sees the same packet ID.
+    if (!delivered) {
+      if (receiver->rx_fifo_.size() >= kRxFifoSize) {
+        continue;
+      }
+
+      delivered = true;
+      receiver->rx_fifo_.push_back({
+          TimeNowUs() + medium_.profile_.latency_us,
+          std::vector<uint8_t>(data, data + size)});
+    }
+
+    if (!medium_.SampleLoss()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool SimulatedRadio::WriteNoAck(const uint8_t* data, size_t size) {
+  uint64_t airtime_us = GetAirtimeUs(size + kPacketOverhead);
+  {
+    std::lock_guard<std::mutex> lock(medium_.mutex_);
+    tx_start_us_ = TimeNowUs() + kSettleTimeUs;
+    tx_end_us_ = tx_start_us_ + airtime_us;
+  }
+
+  // Each receiver samples the loss model separately, and the packet is sent
+  // once whether or not anyone receives it.
+  SleepUs(kSettleTimeUs + airtime_us);
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  if (IsChannelBusy(tx_start_us_, tx_end_us_)) {
+    return true;
+  }
+
+  for (SimulatedRadio* radio : medium_.radios_) {
+    if (IsReceiver(radio) && !medium_.SampleLoss()
+        && radio->rx_fifo_.size() < kRxFifoSize) {
+      radio->rx_fifo_.push_back({
+          TimeNowUs() + medium_.profile_.latency_us,
+          std::vector<uint8_t>(data, data + size)});
+    }
+  }
+
+  return true;
+}
+
+bool SimulatedRadio::TxStandBy() {
+  return true;
+}
+
+bool SimulatedRadio::TestCarrier() {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  uint64_t now_us = TimeNowUs();
+  return listening_ && IsChannelBusy(now_us, now_us + 1);
+}
+
+bool SimulatedRadio::Available() {
+  uint64_t delay_us = kPollTimeUs;
+  {
+    std::lock_guard<std::mutex> lock(medium_.mutex_);
+    uint64_t now_us = TimeNowUs();
+    if (listening_ && !rx_fifo_.empty()
+        && rx_fifo_.front().arrival_us <= now_us) {
+      return true;
+    } else if (listening_) {
+      delay_us = std::max(delay_us, GetEarliestArrivalUs(now_us) - now_us);
+    }
+  }
+
+  // Polling a real radio takes an SPI transfer. Skipping ahead to the next
+  // possible arrival also keeps callers that spin on this from taking many
+  // turns when running on a virtual clock.
+  SleepUs(delay_us);
+  return false;
+}
+
+size_t SimulatedRadio::Read(uint8_t* data, size_t size) {
+  std::lock_guard<std::mutex> lock(medium_.mutex_);
+  if (rx_fifo_.empty()) {
+    return 0;
+  }
+
+  const auto& packet = rx_fifo_.front().data;
+  size = std::min(size, packet.size());
+  std::copy(packet.begin(), packet.begin() + size, data);
+  rx_fifo_.pop_front();
+  return size;
+}
+
+uint64_t SimulatedRadio::GetAirtimeUs(size_t size) const {
+  uint64_t bits = size * 8;
+  switch (data_rate_) {
+    case RF24_250KBPS:
+      return bits * 4;
+    case RF24_2MBPS:
+      return bits / 2;
+    default:
+      return bits;
+  }
+}
+
+SimulatedRadio* SimulatedRadio::FindReceiver() {
+  for (SimulatedRadio* radio : medium_.radios_) {
+    if (IsReceiver(radio)) {
+      return radio;
+    }
+  }
+
+  return nullptr;
+}
+
+bool SimulatedRadio::IsReceiver(const SimulatedRadio* radio) const {
+  return radio != this && radio->listening_ && radio->channel_ == channel_
+      && radio->data_rate_ == data_rate_
+      && radio->reading_addr_ == writing_addr_;
+}
+
+bool SimulatedRadio::IsChannelBusy(uint64_t start_us, uint64_t end_us) {
+  for (SimulatedRadio* radio : medium_.radios_) {
+    if (radio != this && radio->channel_ == channel_
+        && radio->tx_start_us_ < end_us && radio->tx_end_us_ > start_us) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint64_t SimulatedRadio::GetEarliestArrivalUs(uint64_t now_us) {
+  // A transmission that has not started yet takes at least the settle time.
+  uint64_t arrival_us = now_us + kSettleTimeUs;
+  if (!rx_fifo_.empty()) {
+    arrival_us = std::min(arrival_us, rx_fifo_.front().arrival_us);
+  }
+
+  for (SimulatedRadio* radio : medium_.radios_) {
+    if (radio != this && radio->tx_end_us_ > now_us) {
+      arrival_us = std::min(arrival_us, radio->tx_end_us_);
+    }
+  }
+
+  return arrival_us;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_SIMULATED_RADIO_H_
+#define NERFNET_NET_SIMULATED_RADIO_H_
+
+#include <deque>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "nerfnet/net/radio.h"
+
+namespace nerfnet {
+
+class SimulatedRadio;
+
+// The air shared by a set of simulated radios. Packets are delivered between
+// radios on the same channel and data rate, subject to a loss profile.
+class SimulatedMedium : public NonCopyable {
+ public:
+  // The conditions of the simulated link.
+  struct Profile {
+    // The probability that a packet is lost while the link is good.
+    double loss = 0.0;
+
+    // The probability that the link fades for each packet sent while it is
+    // good, and the mean length of a fade in packets. All packets are lost
+    // during a fade.
+    double fade_probability = 0.0;
+    double fade_length = 1.0;
+
+    // The time added to the delivery of each packet, modeling the time for
+    // the receiver to notice it.
+    uint64_t latency_us = 0;
+
+    // The time that an outage starts and its length. All packets are lost
+    // during the outage. A length of zero disables it.
+    uint64_t outage_start_us = 0;
+    uint64_t outage_length_us = 0;
+  };
+
+  // Setup the medium with a link profile and a seed for the loss model.
+  SimulatedMedium(const Profile& profile, uint32_t seed);
+
+ private:
+  friend class SimulatedRadio;
+
+  // Guards all state of the medium and the radios attached to it.
+  std::mutex mutex_;
+
+  // The conditions of the link.
+  const Profile profile_;
+
+  // The source of randomness for the loss model.
+  std::mt19937 random_;
+
+  // Whether the link is currently in a fade.
+  bool fading_;
+
+  // The radios attached to the medium.
+  std::vector<SimulatedRadio*> radios_;
+
+  // Returns true if a packet sent now is lost. Must be called with the lock
+  // held.
+  bool SampleLoss();
+};
+
+// A radio that exchanges packets through a simulated medium, modeling the
+// automatic acknowledgement and retransmission of the NRF24L01. Packets that
+// overlap on the air with another transmission on the same channel are lost.
+class SimulatedRadio : public Radio {
+ public:
+  // Attaches the radio to a medium, which must outlive it.
+  explicit SimulatedRadio(SimulatedMedium& medium);
+  ~SimulatedRadio();
+
+  // Radio implementation.
+  void SetChannel(uint8_t channel) final;
+  void SetDataRate(rf24_datarate_e data_rate) final;
+  void SetPALevel(rf24_pa_dbm_e pa_level) final;
+  void SetRetries(uint8_t delay, uint8_t count) final;
+  void OpenWritingPipe(const uint8_t* addr) final;
+  void OpenReadingPipe(uint8_t pipe, const uint8_t* addr) final;
+  void StartListening() final;
+  void StopListening() final;
+  bool Write(const uint8_t* data, size_t size) final;
+  bool WriteNoAck(const uint8_t* data, size_t size) final;
+  bool TxStandBy() final;
+  bool TestCarrier() final;
+  bool Available() final;
+  size_t Read(uint8_t* data, size_t size) final;
+
+ private:
+  // The number of packets held by the receive FIFO.
+  static constexpr size_t kRxFifoSize = 3;
+
+  // The time taken to switch to transmit mode before each transmission.
+  static constexpr uint64_t kSettleTimeUs = 130;
+
+  // The time taken to poll the radio for a received packet.
+  static constexpr uint64_t kPollTimeUs = 10;
+
+  // The size of the preamble, address, control field and CRC of a packet.
+  static constexpr size_t kPacketOverhead = 1 + 3 + 2 + 1;
+
+  // A packet waiting in the receive FIFO.
+  struct RxPacket {
+    uint64_t arrival_us;
+    std::vector<uint8_t> data;
+  };
+
+  // The medium that the radio is attached to.
+  SimulatedMedium& medium_;
+
+  // The radio configuration.
+  uint8_t channel_;
+  rf24_datarate_e data_rate_;
+  uint8_t retry_delay_;
+  uint8_t retry_count_;
+  uint32_t writing_addr_;
+  uint32_t reading_addr_;
+  bool listening_;
+
+  // The time on the air of the current or most recent transmission.
+  uint64_t tx_start_us_;
+  uint64_t tx_end_us_;
+
+  // The received packets.
+  std::deque<RxPacket> rx_fifo_;
+
+  // Returns the time to send a number of bytes at the current data rate.
+  uint64_t GetAirtimeUs(size_t size) const;
+
+  // Returns the radio that receives packets written by this radio, or null.
+  // Must be called with the lock of the medium held.
+  SimulatedRadio* FindReceiver();
+
+  // Returns true if the supplied radio receives packets written by this
+  // radio. Must be called with the lock of the medium held.
+  bool IsReceiver(const SimulatedRadio* radio) const;
+
+  // Returns true if another radio on the same channel is transmitting
+  // between the supplied times. Must be called with the lock of the medium
+  // held.
+  bool IsChannelBusy(uint64_t start_us, uint64_t end_us);
+
+  // Returns the earliest time after the supplied time that a packet may be
+  // available to read. Must be called with the lock of the medium held.
+  uint64_t GetEarliestArrivalUs(uint64_t now_us);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_SIMULATED_RADIO_H_
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_SPI_DEVICE_H_
+#define NERFNET_NET_SPI_DEVICE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// The connection to an NRF24L01: the SPI bus and the chip-enable pin.
+class SpiDevice : public NonCopyable {
+ public:
+  // The largest transfer, a command byte followed by a full payload.
+  static constexpr size_t kMaxTransferSize = 33;
+
+  // A transfer framed by the chip select. The bytes received replace the
+  // bytes sent.
+  struct Transfer {
+    uint8_t data[kMaxTransferSize];
+    size_t size;
+  };
+
+  virtual ~SpiDevice() = default;
+
+  // Performs a batch of transfers as a single operation. Returns false and
+  // logs the error on failure.
+  virtual bool TransferBatch(Transfer* transfers, size_t count) = 0;
+
+  // Sets the level of the chip-enable pin.
+  virtual void SetChipEnable(bool enabled) = 0;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_SPI_DEVICE_H_
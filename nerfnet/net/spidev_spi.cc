@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/spidev_spi.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+
+SpidevSpi::SpidevSpi(const std::string& spi_path, uint32_t speed_hz,
+                     const std::string& gpio_chip_path, uint16_t ce_line)
+    : speed_hz_(speed_hz),
+      ce_enabled_(false) {
+  spi_fd_ = open(spi_path.c_str(), O_RDWR);
+  CHECK(spi_fd_ >= 0, "Failed to open SPI device '%s': %s (%d)",
+      spi_path.c_str(), strerror(errno), errno);
+
+  uint8_t mode = SPI_MODE_0;
+  uint8_t bits_per_word = 8;
+  CHECK(ioctl(spi_fd_, SPI_IOC_WR_MODE, &mode) >= 0
+      && ioctl(spi_fd_, SPI_IOC_WR_BITS_PER_WORD, &bits_per_word) >= 0
+      && ioctl(spi_fd_, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) >= 0,
+      "Failed to configure SPI device: %s (%d)", strerror(errno), errno);
+
+  int chip_fd = open(gpio_chip_path.c_str(), O_RDWR);
+  CHECK(chip_fd >= 0, "Failed to open GPIO chip '%s': %s (%d)",
+      gpio_chip_path.c_str(), strerror(errno), errno);
+
+  struct gpiohandle_request request = {};
+  request.lineoffsets[0] = ce_line;
+  request.flags = GPIOHANDLE_REQUEST_OUTPUT;
+  request.default_values[0] = 0;
+  request.lines = 1;
+  strncpy(request.consumer_label, "nerfnet",
+      sizeof(request.consumer_label) - 1);
+  int status = ioctl(chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &request);
+  CHECK(status >= 0, "Failed to request chip-enable line %u: %s (%d)",
+      ce_line, strerror(errno), errno);
+  close(chip_fd);
+  ce_fd_ = request.fd;
+}
+
+SpidevSpi::~SpidevSpi() {
+  close(ce_fd_);
+  close(spi_fd_);
+}
+
+bool SpidevSpi::TransferBatch(Transfer* transfers, size_t count) {
+  CHECK(count <= kMaxBatchSize, "SPI batch is too large");
+  struct spi_ioc_transfer messages[kMaxBatchSize] = {};
+  for (size_t i = 0; i < count; i++) {
+    messages[i].tx_buf = reinterpret_cast<uintptr_t>(transfers[i].data);
+    messages[i].rx_buf = reinterpret_cast<uintptr_t>(transfers[i].data);
+    messages[i].len = transfers[i].size;
+    messages[i].speed_hz = speed_hz_;
+    messages[i].bits_per_word = 8;
+
+    // Release the chip select between transfers so that each one is framed
+    // as a separate command.
+    messages[i].cs_change = (i + 1 < count);
+  }
+
+  if (ioctl(spi_fd_, SPI_IOC_MESSAGE(count), messages) < 0) {
+    LOGE("Failed to transfer SPI batch: %s (%d)", strerror(errno), errno);
+    return false;
+  }
+
+  return true;
+}
+
+void SpidevSpi::SetChipEnable(bool enabled) {
+  if (enabled == ce_enabled_) {
+    return;
+  }
+
+  struct gpiohandle_data data = {};
+  data.values[0] = enabled;
+  CHECK(ioctl(ce_fd_, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) >= 0,
+      "Failed to set chip-enable line: %s (%d)", strerror(errno), errno);
+  ce_enabled_ = enabled;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_SPIDEV_SPI_H_
+#define NERFNET_NET_SPIDEV_SPI_H_
+
+#include <string>
+
+#include "nerfnet/net/spi_device.h"
+
+namespace nerfnet {
+
+// An SPI device using the Linux spidev driver, with the chip-enable pin
+// driven through the GPIO character device.
+class SpidevSpi : public SpiDevice {
+ public:
+  // Opens the SPI device and requests the chip-enable line from the GPIO
+  // chip. Quits and logs the error on failure.
+  SpidevSpi(const std::string& spi_path, uint32_t speed_hz,
+            const std::string& gpio_chip_path, uint16_t ce_line);
+  ~SpidevSpi();
+
+  // SpiDevice implementation.
+  bool TransferBatch(Transfer* transfers, size_t count) final;
+  void SetChipEnable(bool enabled) final;
+
+ private:
+  // The largest number of transfers in a batch.
+  static constexpr size_t kMaxBatchSize = 8;
+
+  // The clock speed of the bus.
+  const uint32_t speed_hz_;
+
+  // The file descriptors of the SPI device and the chip-enable line.
+  int spi_fd_;
+  int ce_fd_;
+
+  // The current level of the chip-enable line.
+  bool ce_enabled_;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_SPIDEV_SPI_H_
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/symmetric_radio_interface.h"
+
+#include <algorithm>
+#include <sys/random.h>
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+
+SymmetricRadioInterface::SymmetricRadioInterface(
+    Radio& radio, Tunnel& tunnel,
+    uint32_t primary_addr, uint32_t secondary_addr, uint8_t channel,
+    bool is_primary, uint64_t idle_interval_us)
+    : DuplexRadioInterface(radio, tunnel, primary_addr, secondary_addr,
+                           channel, is_primary, idle_interval_us),
+      contention_window_us_(kMinContentionWindowUs),
+      next_transmit_us_(0) {
+  uint32_t seed;
+  CHECK(getrandom(&seed, sizeof(seed), 0) == sizeof(seed),
+      "Failed to generate backoff seed");
+  random_.seed(seed);
+
+  // Different retransmission delays keep the two sides from colliding again
+  // on every retry.
+  radio_.SetRetries(is_primary ? 1 : 2, kRetryCount);
+}
+
+void SymmetricRadioInterface::SetBackoffSeed(uint32_t seed) {
+  random_.seed(seed);
+}
+
+void SymmetricRadioInterface::Run() {
+  std::vector<uint8_t> packet(kMaxPacketSize);
+  while (running_) {
+    ApplyPendingSettings();
+    bool active = false;
+    {
+      std::lock_guard<std::mutex> lock(read_buffer_mutex_);
+      while (radio_.Available()) {
+        packet.resize(kMaxPacketSize);
+        packet.resize(radio_.Read(packet.data(), packet.size()));
+        if (capture_tap_ != nullptr) {
+          capture_tap_->RecordPacketReceived(packet);
+        }
+
+        HandlePacket(packet);
+        active = true;
+      }
+
+      uint64_t now_us = TimeNowUs();
+      if (active) {
+        next_transmit_us_ = std::max(next_transmit_us_,
+            now_us + kReceiveHoldoffUs);
+      }
+
+      if (now_us >= next_transmit_us_ && TransmitNext()) {
+        active = true;
+      }
+    }
+
+    NotifyTunnelWriter();
+    if (!active) {
+      SleepUs(poll_interval_us_);
+    }
+  }
+}
+
+bool SymmetricRadioInterface::Transmit(const std::vector<uint8_t>& packet) {
+  radio_.StopListening();
+  bool success = radio_.Write(packet.data(), packet.size());
+  radio_.StartListening();
+  if (capture_tap_ != nullptr) {
+    capture_tap_->RecordPacketSent(packet, success);
+  }
+
+  if (!success) {
+    Backoff();
+    return false;
+  }
+
+  contention_window_us_ = kMinContentionWindowUs;
+  return true;
+}
+
+bool SymmetricRadioInterface::ClearToTransmit() {
+  if (radio_.TestCarrier()) {
+    Backoff();
+    return false;
+  }
+
+  return true;
+}
+
+void SymmetricRadioInterface::Backoff() {
+  std::uniform_int_distribution<uint64_t> distribution(0,
+      contention_window_us_);
+  next_transmit_us_ = TimeNowUs() + distribution(random_);
+  contention_window_us_ = std::min(contention_window_us_ * 2,
+      std::max(max_backoff_us_.load(), kMinContentionWindowUs));
+}
+
+}  // namespace nerfnet
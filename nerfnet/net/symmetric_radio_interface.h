@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_SYMMETRIC_RADIO_INTERFACE_H_
+#define NERFNET_NET_SYMMETRIC_RADIO_INTERFACE_H_
+
+#include <random>
+
+#include "nerfnet/net/duplex_radio_interface.h"
+
+namespace nerfnet {
+
+// A radio interface where either side transmits whenever it has data, using
+// a single radio and channel. Chunks are streamed and acknowledged in the
+// same way as in full-duplex mode, but each side listens before it transmits
+// and backs off for a random time when the channel is busy or a transmission
+// fails. Nothing is sent while the link is idle.
+//
+// The primary still establishes the session, but otherwise the sides behave
+// the same.
+class SymmetricRadioInterface : public DuplexRadioInterface {
+ public:
+  // Setup the symmetric radio link.
+  SymmetricRadioInterface(Radio& radio, Tunnel& tunnel,
+                          uint32_t primary_addr, uint32_t secondary_addr,
+                          uint8_t channel, bool is_primary,
+                          uint64_t idle_interval_us);
+
+  // Seeds the random backoff, which is otherwise seeded randomly. This is
+  // used to make simulations repeatable.
+  void SetBackoffSeed(uint32_t seed);
+
+  // Runs the interface.
+  void Run() final;
+
+ private:
+  // The initial upper bound of the random backoff. This doubles with each
+  // busy channel or failed transmission, up to the maximum backoff.
+  static constexpr uint64_t kMinContentionWindowUs = 500;
+
+  // The time to hold off transmitting after receiving a packet, which leaves
+  // a gap for the peer to continue a burst.
+  static constexpr uint64_t kReceiveHoldoffUs = 500;
+
+  // The number of automatic retransmissions. This is kept low so that
+  // collisions are resolved by the random backoff instead.
+  static constexpr uint8_t kRetryCount = 3;
+
+  // The source of randomness for the backoff.
+  std::mt19937 random_;
+
+  // The current upper bound of the random backoff.
+  uint64_t contention_window_us_;
+
+  // The earliest time to transmit the next packet.
+  uint64_t next_transmit_us_;
+
+  // Sends a packet, backing off if the radio fails to deliver it.
+  bool Transmit(const std::vector<uint8_t>& packet) final;
+
+  // Returns true if the channel is clear, otherwise backs off.
+  bool ClearToTransmit() final;
+
+  // Defers the next transmission by a random time and widens the contention
+  // window.
+  void Backoff();
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_SYMMETRIC_RADIO_INTERFACE_H_
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/net/tun_tunnel.h"
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+
+TunTunnel::TunTunnel(int tunnel_fd)
+    : tunnel_fd_(tunnel_fd) {}
+
+bool TunTunnel::Read(std::vector<uint8_t>& frame) {
+  struct pollfd pfd = {tunnel_fd_, POLLIN, 0};
+  int status = poll(&pfd, 1, kReadTimeoutMs);
+  if (status < 0 && errno != EINTR) {
+    LOGE("Failed to poll tunnel: %s (%d)", strerror(errno), errno);
+    return false;
+  } else if (status <= 0) {
+    return false;
+  }
+
+  uint8_t buffer[3200];
+  int bytes_read = read(tunnel_fd_, buffer, sizeof(buffer));
+  if (bytes_read < 0) {
+    LOGE("Failed to read: %s (%d)", strerror(errno), errno);
+    return false;
+  }
+
+  frame.assign(&buffer[0], &buffer[bytes_read]);
+  return true;
+}
+
+bool TunTunnel::Write(const std::vector<uint8_t>& frame) {
+  int bytes_written = write(tunnel_fd_, frame.data(), frame.size());
+  if (bytes_written < 0) {
+    LOGE("Failed to write to tunnel %s (%d)", strerror(errno), errno);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_TUN_TUNNEL_H_
+#define NERFNET_NET_TUN_TUNNEL_H_
+
+#include "nerfnet/net/tunnel.h"
+
+namespace nerfnet {
+
+// A tunnel backed by a virtual network device.
+class TunTunnel : public Tunnel {
+ public:
+  // Setup the tunnel with the file descriptor of an opened tunnel device.
+  explicit TunTunnel(int tunnel_fd);
+
+  // Tunnel implementation. Reads wait at most kReadTimeoutMs for a frame so
+  // that the reading thread can be stopped.
+  bool Read(std::vector<uint8_t>& frame) final;
+  bool Write(const std::vector<uint8_t>& frame) final;
+
+ private:
+  // The longest time to wait for a frame to read.
+  static constexpr int kReadTimeoutMs = 100;
+
+  // The file descriptor for the network tunnel.
+  const int tunnel_fd_;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_TUN_TUNNEL_H_
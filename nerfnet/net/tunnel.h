@@ -0,0 +1,44 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_NET_TUNNEL_H_
+#define NERFNET_NET_TUNNEL_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// The source and sink of network frames carried over the radio link.
+class Tunnel : public NonCopyable {
+ public:
+  virtual ~Tunnel() = default;
+
+  // Reads the next frame to send over the link. Returns false if no frame is
+  // read, either on failure or once a bounded wait for one times out, so that
+  // the caller can check whether to keep reading. Failures are logged.
+  virtual bool Read(std::vector<uint8_t>& frame) = 0;
+
+  // Writes a frame received over the link. Returns false and logs the error
+  // on failure.
+  virtual bool Write(const std::vector<uint8_t>& frame) = 0;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_NET_TUNNEL_H_
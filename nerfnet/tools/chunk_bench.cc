@@ -0,0 +1,407 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <netinet/in.h>
+#include <new>
+#include <sstream>
+#include <sys/socket.h>
+#include <tclap/CmdLine.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "nerfnet/net/radio_interface.h"
+#include "nerfnet/net/simulated_radio.h"
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/time.h"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "A tool for measuring the CPU time and allocations of each step that the "
+    "nerfnet radio loop runs for each chunk of a frame.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// The allocations made by the benchmark thread while a benchmark is timed.
+thread_local bool counting_allocations = false;
+thread_local uint64_t allocation_count = 0;
+
+void* operator new(size_t size) {
+  if (counting_allocations) {
+    allocation_count++;
+  }
+
+  void* ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+  free(ptr);
+}
+
+// A tunnel that never offers frames and sends delivered frames to a
+// loopback UDP socket. This passes each frame through the network stack in a
+// system call, as a write to a real tunnel does.
+class NullTunnel : public nerfnet::Tunnel {
+ public:
+  NullTunnel() : fd_(socket(AF_INET, SOCK_DGRAM, 0)) {
+    CHECK(fd_ >= 0, "Failed to open socket");
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0,
+        "Failed to bind socket");
+    socklen_t addr_len = sizeof(addr);
+    CHECK(getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len) == 0
+        && connect(fd_, reinterpret_cast<sockaddr*>(&addr), addr_len) == 0,
+        "Failed to connect socket");
+  }
+
+  ~NullTunnel() {
+    close(fd_);
+  }
+
+  bool Read(std::vector<uint8_t>& frame) final {
+    nerfnet::SleepUs(10000);
+    return false;
+  }
+
+  // Frames are sent to the socket itself and dropped once its receive
+  // buffer is full.
+  bool Write(const std::vector<uint8_t>& frame) final {
+    return send(fd_, frame.data(), frame.size(), MSG_DONTWAIT)
+        == static_cast<ssize_t>(frame.size());
+  }
+
+ private:
+  const int fd_;
+};
+
+// Exposes the per-chunk steps of the radio interface to the benchmarks.
+class BenchInterface : public nerfnet::RadioInterface {
+ public:
+  BenchInterface(nerfnet::Radio& radio, nerfnet::Tunnel& tunnel,
+                 bool is_primary)
+      : RadioInterface(radio, tunnel, 0x90019001, 0x90009000,
+                       /*channel=*/1, is_primary) {}
+
+  void Run() final {}
+
+  // Starts a new session, with a fixed cipher session when encryption is
+  // enabled so that both sides agree.
+  void StartSession() {
+    ResetSession(1);
+    if (cipher_ != nullptr) {
+      std::vector<uint8_t> salt(nerfnet::LinkCipher::kSaltSize, 0x5a);
+      cipher_->StartSession(salt, salt);
+    }
+  }
+
+  // Wakes the tunnel writer and waits until the queued frames have been
+  // written.
+  void WaitForTunnelWrites() {
+    NotifyTunnelWriter();
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(write_queue_mutex_);
+        if (write_queue_size_ == 0) {
+          return;
+        }
+      }
+
+      std::this_thread::yield();
+    }
+  }
+
+  using RadioInterface::TunnelTxRxPacket;
+  using RadioInterface::read_buffer_;
+  using RadioInterface::frame_buffers_;
+  using RadioInterface::next_id_;
+  using RadioInterface::max_payload_size_;
+  using RadioInterface::PopulateTxPayload;
+  using RadioInterface::AdvanceTxPayload;
+  using RadioInterface::AdvanceID;
+  using RadioInterface::ValidateID;
+  using RadioInterface::EncodeTunnelTxRxPacket;
+  using RadioInterface::DecodeTunnelTxRxPacket;
+  using RadioInterface::WriteTunnel;
+};
+
+// Times a benchmark, excluding the setup done while paused, and counts the
+// allocations made while timed.
+class BenchmarkTimer {
+ public:
+  BenchmarkTimer() : elapsed_ns_(0), allocations_(0) {}
+
+  void Resume() {
+    allocation_count = 0;
+    counting_allocations = true;
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  void Pause() {
+    auto end = std::chrono::steady_clock::now();
+    counting_allocations = false;
+    allocations_ += allocation_count;
+    elapsed_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start_).count();
+  }
+
+  uint64_t GetElapsedNs() const { return elapsed_ns_; }
+  uint64_t GetAllocations() const { return allocations_; }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+  uint64_t elapsed_ns_;
+  uint64_t allocations_;
+};
+
+// The state shared by the benchmarks for a frame size: a link of two
+// interfaces and the chunks that a frame is split into.
+class BenchFixture {
+ public:
+  BenchFixture(size_t frame_size, bool encrypted)
+      : medium_({}, /*seed=*/1),
+        sender_radio_(medium_),
+        receiver_radio_(medium_),
+        sender_(sender_radio_, sender_tunnel_, /*is_primary=*/true),
+        receiver_(receiver_radio_, receiver_tunnel_, /*is_primary=*/false),
+        frame_(frame_size) {
+    if (encrypted) {
+      std::vector<uint8_t> key(nerfnet::LinkCipher::kKeySize, 0xa5);
+      sender_.SetEncryptionKey(key);
+      receiver_.SetEncryptionKey(key);
+    }
+
+    for (size_t i = 0; i < frame_.size(); i++) {
+      frame_[i] = static_cast<uint8_t>(i);
+    }
+
+    Reset();
+    sender_.read_buffer_.push_back(frame_);
+    while (true) {
+      BenchInterface::TunnelTxRxPacket tunnel;
+      tunnel.id = sender_.next_id_;
+      sender_.PopulateTxPayload(tunnel);
+      if (tunnel.payload.empty()) {
+        break;
+      }
+
+      sender_.AdvanceTxPayload();
+      sender_.AdvanceID();
+      chunks_.push_back(tunnel);
+    }
+
+    EncodeFrame();
+  }
+
+  // Restarts the session on both sides.
+  void Reset() {
+    sender_.StartSession();
+    receiver_.StartSession();
+  }
+
+  // Encodes the chunks of a frame with a new session.
+  void EncodeFrame() {
+    Reset();
+    packets_.resize(chunks_.size());
+    for (size_t i = 0; i < chunks_.size(); i++) {
+      sender_.EncodeTunnelTxRxPacket(chunks_[i], packets_[i]);
+    }
+  }
+
+  nerfnet::SimulatedMedium medium_;
+  nerfnet::SimulatedRadio sender_radio_;
+  nerfnet::SimulatedRadio receiver_radio_;
+  NullTunnel sender_tunnel_;
+  NullTunnel receiver_tunnel_;
+  BenchInterface sender_;
+  BenchInterface receiver_;
+
+  // The frame, the chunks it is sent as and their encoded packets.
+  std::vector<uint8_t> frame_;
+  std::vector<BenchInterface::TunnelTxRxPacket> chunks_;
+  std::vector<std::vector<uint8_t>> packets_;
+};
+
+// A benchmark that processes each chunk of one frame per call.
+struct Benchmark {
+  const char* name;
+  std::function<void(BenchFixture&, BenchmarkTimer&)> function;
+};
+
+// Encodes each chunk into a packet, as sent by the radio loop.
+void BenchmarkEncode(BenchFixture& fixture, BenchmarkTimer& timer) {
+  std::vector<uint8_t>& request = fixture.packets_[0];
+  for (const auto& chunk : fixture.chunks_) {
+    fixture.sender_.EncodeTunnelTxRxPacket(chunk, request);
+  }
+}
+
+// Decodes the packet of each chunk.
+void BenchmarkDecode(BenchFixture& fixture, BenchmarkTimer& timer) {
+  timer.Pause();
+  fixture.EncodeFrame();
+  BenchInterface::TunnelTxRxPacket tunnel;
+  timer.Resume();
+
+  for (const auto& packet : fixture.packets_) {
+    fixture.receiver_.DecodeTunnelTxRxPacket(packet, tunnel);
+  }
+}
+
+// Takes the frame from the read buffer, slices each chunk from it and frees
+// its stream once it is sent.
+void BenchmarkSlice(BenchFixture& fixture, BenchmarkTimer& timer) {
+  timer.Pause();
+  fixture.sender_.read_buffer_.push_back(fixture.frame_);
+  BenchInterface::TunnelTxRxPacket tunnel;
+  timer.Resume();
+
+  while (true) {
+    fixture.sender_.PopulateTxPayload(tunnel);
+    if (tunnel.payload.empty()) {
+      break;
+    }
+
+    fixture.sender_.AdvanceTxPayload();
+  }
+}
+
+// Validates the ID of each chunk received and advances the ID to send.
+void BenchmarkIds(BenchFixture& fixture, BenchmarkTimer& timer) {
+  for (size_t i = 0; i < fixture.chunks_.size(); i++) {
+    fixture.receiver_.ValidateID(fixture.sender_.next_id_);
+    fixture.sender_.AdvanceID();
+  }
+}
+
+// Appends each chunk received to the frame buffer and hands the frame to
+// the tunnel writer once complete. This is the cost on the radio thread
+// before it responds. The writer is woken afterwards.
+void BenchmarkReassemble(BenchFixture& fixture, BenchmarkTimer& timer) {
+  auto& frame_buffer = fixture.receiver_.frame_buffers_[0];
+  for (const auto& chunk : fixture.chunks_) {
+    frame_buffer.insert(frame_buffer.end(),
+        chunk.payload.begin(), chunk.payload.end());
+  }
+
+  fixture.receiver_.WriteTunnel(frame_buffer);
+
+  // Let the writer catch up so that the queue never fills.
+  timer.Pause();
+  fixture.receiver_.WaitForTunnelWrites();
+  timer.Resume();
+}
+
+// Copies a frame read from the tunnel into the read buffer.
+void BenchmarkTunnelRead(BenchFixture& fixture, BenchmarkTimer& timer) {
+  std::vector<uint8_t> frame;
+  frame.assign(fixture.frame_.begin(), fixture.frame_.end());
+  fixture.sender_.read_buffer_.push_back(std::move(frame));
+
+  timer.Pause();
+  fixture.sender_.read_buffer_.clear();
+  timer.Resume();
+}
+
+// Parses a comma separated list of sizes.
+std::vector<size_t> ParseSizes(const std::string& str) {
+  std::vector<size_t> sizes;
+  std::stringstream stream(str);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    sizes.push_back(std::max<size_t>(std::stoull(item), 1));
+  }
+
+  CHECK(!sizes.empty(), "Empty frame size list '%s'", str.c_str());
+  return sizes;
+}
+
+// Runs a benchmark until it has been timed for at least the supplied time
+// and logs the time and allocations per chunk.
+void RunBenchmark(const Benchmark& benchmark, BenchFixture& fixture,
+                  const std::string& name, uint64_t min_time_ns) {
+  BenchmarkTimer timer;
+  uint64_t frames = 0;
+  while (timer.GetElapsedNs() < min_time_ns) {
+    timer.Resume();
+    benchmark.function(fixture, timer);
+    timer.Pause();
+    frames++;
+  }
+
+  uint64_t chunks = frames * fixture.chunks_.size();
+  LOGI("%-28s %10.1f %12.2f %12llu", name.c_str(),
+      static_cast<double>(timer.GetElapsedNs()) / chunks,
+      static_cast<double>(timer.GetAllocations()) / chunks,
+      static_cast<unsigned long long>(chunks));
+}
+
+int main(int argc, char** argv) {
+  // Parse command-line arguments.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<std::string> frame_sizes_arg("", "frame_sizes",
+      "The frame sizes to measure.", false, "64,300,1500", "list", cmd);
+  TCLAP::ValueArg<double> min_time_arg("", "min_time",
+      "The minimum time to run each benchmark for.", false, 0.2, "seconds",
+      cmd);
+  TCLAP::ValueArg<std::string> filter_arg("", "filter",
+      "Only run benchmarks with names containing this string.", false, "",
+      "string", cmd);
+  cmd.parse(argc, argv);
+
+  const std::vector<Benchmark> benchmarks = {
+    {"Encode", BenchmarkEncode},
+    {"Decode", BenchmarkDecode},
+    {"Slice", BenchmarkSlice},
+    {"Ids", BenchmarkIds},
+    {"Reassemble", BenchmarkReassemble},
+    {"TunnelRead", BenchmarkTunnelRead},
+  };
+
+  uint64_t min_time_ns = static_cast<uint64_t>(min_time_arg.getValue() * 1e9);
+  LOGI("%-28s %10s %12s %12s", "benchmark", "ns/chunk", "allocs/chunk",
+      "chunks");
+  for (bool encrypted : {false, true}) {
+    for (size_t frame_size : ParseSizes(frame_sizes_arg.getValue())) {
+      BenchFixture fixture(frame_size, encrypted);
+      for (const auto& benchmark : benchmarks) {
+        std::string name = std::string(benchmark.name)
+            + (encrypted ? "/aead/" : "/plain/") + std::to_string(frame_size);
+        if (name.find(filter_arg.getValue()) != std::string::npos) {
+          RunBenchmark(benchmark, fixture, name, min_time_ns);
+        }
+      }
+    }
+  }
+
+  return 0;
+}
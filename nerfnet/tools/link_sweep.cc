@@ -0,0 +1,488 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <tclap/CmdLine.h>
+#include <thread>
+#include <vector>
+
+#include "nerfnet/net/primary_radio_interface.h"
+#include "nerfnet/net/secondary_radio_interface.h"
+#include "nerfnet/net/simulated_radio.h"
+#include "nerfnet/net/symmetric_radio_interface.h"
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/stats.h"
+#include "nerfnet/util/time.h"
+#include "nerfnet/util/virtual_clock.h"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "A tool for sweeping nerfnet link parameters against a simulated radio "
+    "link.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// The size of the sequence number and timestamp at the start of each frame.
+constexpr size_t kFrameHeaderSize = 12;
+
+// A tunnel that offers frames at a fixed rate and measures the frames
+// delivered to it.
+class SweepTunnel : public nerfnet::Tunnel {
+ public:
+  // Setup the tunnel to offer frames of the supplied size. A rate of zero
+  // offers frames as fast as the link accepts them and a frame size of zero
+  // offers no frames.
+  SweepTunnel(size_t frame_size, uint64_t offered_bps)
+      : frame_size_(frame_size),
+        frame_interval_us_(offered_bps == 0
+            ? 0 : (frame_size * 8 * 1000000) / offered_bps),
+        next_frame_us_(nerfnet::TimeNowUs()),
+        sequence_(0),
+        delivered_bytes_(0) {}
+
+  bool Read(std::vector<uint8_t>& frame) final {
+    // Return periodically so that the tunnel thread can be stopped.
+    constexpr uint64_t kMaxWaitUs = 10000;
+
+    uint64_t now_us = nerfnet::TimeNowUs();
+    if (frame_size_ == 0) {
+      nerfnet::SleepUs(kMaxWaitUs);
+      return false;
+    } else if (next_frame_us_ > now_us + kMaxWaitUs) {
+      nerfnet::SleepUs(kMaxWaitUs);
+      return false;
+    } else if (next_frame_us_ > now_us) {
+      nerfnet::SleepUs(next_frame_us_ - now_us);
+    }
+
+    next_frame_us_ += frame_interval_us_;
+    frame.assign(std::max(frame_size_, kFrameHeaderSize), 0xa5);
+    uint64_t timestamp_us = nerfnet::TimeNowUs();
+    for (size_t i = 0; i < 4; i++) {
+      frame[i] = static_cast<uint8_t>(sequence_ >> (i * 8));
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+      frame[4 + i] = static_cast<uint8_t>(timestamp_us >> (i * 8));
+    }
+
+    sequence_++;
+    return true;
+  }
+
+  bool Write(const std::vector<uint8_t>& frame) final {
+    if (frame.size() < kFrameHeaderSize) {
+      return false;
+    }
+
+    uint64_t timestamp_us = 0;
+    for (size_t i = 0; i < 8; i++) {
+      timestamp_us |= static_cast<uint64_t>(frame[4 + i]) << (i * 8);
+    }
+
+    uint64_t now_us = nerfnet::TimeNowUs();
+    std::lock_guard<std::mutex> lock(mutex_);
+    delivered_bytes_ += frame.size();
+    latencies_us_.push_back(now_us - timestamp_us);
+    delivery_times_us_.push_back(now_us);
+    return true;
+  }
+
+  // Returns true if the tunnel offers frames.
+  bool IsOffering() const {
+    return frame_size_ != 0;
+  }
+
+  // Returns the number of bytes and latencies of the delivered frames.
+  uint64_t GetDeliveredBytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return delivered_bytes_;
+  }
+
+  std::vector<uint64_t> GetLatencies() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return latencies_us_;
+  }
+
+  // Supplies the time of the first frame delivered at or after the supplied
+  // time. Returns false if there is none.
+  bool GetFirstDeliveryUs(uint64_t after_us, uint64_t& delivery_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto delivery = std::lower_bound(delivery_times_us_.begin(),
+        delivery_times_us_.end(), after_us);
+    if (delivery == delivery_times_us_.end()) {
+      return false;
+    }
+
+    delivery_us = *delivery;
+    return true;
+  }
+
+ private:
+  // The traffic to offer.
+  const size_t frame_size_;
+  const uint64_t frame_interval_us_;
+  uint64_t next_frame_us_;
+  uint32_t sequence_;
+
+  // The frames delivered to the tunnel.
+  std::mutex mutex_;
+  uint64_t delivered_bytes_;
+  std::vector<uint64_t> latencies_us_;
+  std::vector<uint64_t> delivery_times_us_;
+};
+
+// A point in the parameter space.
+struct SweepPoint {
+  uint64_t poll_interval_us;
+  uint8_t retry_delay;
+  uint8_t retry_count;
+  uint64_t receive_timeout_us;
+  int failures_before_recovery;
+  uint64_t max_backoff_us;
+};
+
+// The measurements taken at a point.
+struct SweepResult {
+  SweepPoint point;
+  double goodput_kbps;
+  uint64_t frames;
+  uint64_t p50_us;
+  uint64_t p90_us;
+  uint64_t p99_us;
+
+  // The time from the end of the outage until frames are delivered again in
+  // each direction that offers them, if they are.
+  bool recovered;
+  uint64_t recovery_us;
+};
+
+// The traffic and link conditions to measure each point with.
+struct SweepConfig {
+  nerfnet::SimulatedMedium::Profile profile;
+  uint32_t seed;
+  size_t downlink_frame_size;
+  size_t uplink_frame_size;
+  uint64_t offered_bps;
+  size_t max_buffered_frames;
+  uint64_t duration_us;
+  bool symmetric;
+
+  // The longest time allowed to recover from the outage, zero if unchecked.
+  uint64_t max_recovery_us;
+};
+
+// Parses a comma separated list of values.
+template<typename T>
+std::vector<T> ParseList(const std::string& str) {
+  std::vector<T> values;
+  std::stringstream stream(str);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(static_cast<T>(std::stoull(item)));
+  }
+
+  CHECK(!values.empty(), "Empty parameter list '%s'", str.c_str());
+  return values;
+}
+
+// Runs the primary and secondary logic over a simulated link with the
+// parameters of a point and measures the traffic delivered in both
+// directions. The link runs in virtual time, so the results only depend on
+// the configuration and the point.
+SweepResult MeasurePoint(const SweepConfig& config, const SweepPoint& point) {
+  constexpr uint32_t kPrimaryAddr = 0x90019001;
+  constexpr uint32_t kSecondaryAddr = 0x90009000;
+  constexpr uint8_t kChannel = 1;
+
+  nerfnet::VirtualClock clock;
+  nerfnet::SetClock(&clock);
+  nerfnet::SimulatedMedium medium(config.profile, config.seed);
+  nerfnet::SimulatedRadio primary_radio(medium);
+  nerfnet::SimulatedRadio secondary_radio(medium);
+  SweepTunnel primary_tunnel(config.downlink_frame_size, config.offered_bps);
+  SweepTunnel secondary_tunnel(config.uplink_frame_size, config.offered_bps);
+
+  uint64_t delivered_bytes = 0;
+  std::vector<uint64_t> latencies_us;
+  {
+    std::unique_ptr<nerfnet::RadioInterface> primary;
+    std::unique_ptr<nerfnet::RadioInterface> secondary;
+    if (config.symmetric) {
+      // The symmetric interface chooses its own retries.
+      auto symmetric_primary =
+          std::make_unique<nerfnet::SymmetricRadioInterface>(
+              primary_radio, primary_tunnel, kPrimaryAddr, kSecondaryAddr,
+              kChannel, /*is_primary=*/true, point.poll_interval_us);
+      auto symmetric_secondary =
+          std::make_unique<nerfnet::SymmetricRadioInterface>(
+              secondary_radio, secondary_tunnel, kPrimaryAddr, kSecondaryAddr,
+              kChannel, /*is_primary=*/false, point.poll_interval_us);
+      symmetric_primary->SetBackoffSeed(config.seed);
+      symmetric_secondary->SetBackoffSeed(config.seed + 1);
+      primary = std::move(symmetric_primary);
+      secondary = std::move(symmetric_secondary);
+    } else {
+      auto polled_primary = std::make_unique<nerfnet::PrimaryRadioInterface>(
+          primary_radio, primary_tunnel, kPrimaryAddr, kSecondaryAddr,
+          kChannel, point.poll_interval_us);
+      polled_primary->SetReceiveTimeoutUs(point.receive_timeout_us);
+      polled_primary->SetFailuresBeforeRecovery(
+          point.failures_before_recovery);
+      primary = std::move(polled_primary);
+      secondary = std::make_unique<nerfnet::SecondaryRadioInterface>(
+          secondary_radio, secondary_tunnel, kPrimaryAddr, kSecondaryAddr,
+          kChannel);
+      for (auto* radio_interface : {primary.get(), secondary.get()}) {
+        radio_interface->SetRetries(point.retry_delay, point.retry_count);
+      }
+    }
+
+    for (auto* radio_interface : {primary.get(), secondary.get()}) {
+      radio_interface->SetMaxBackoffUs(point.max_backoff_us);
+      radio_interface->SetMaxBufferedFrames(config.max_buffered_frames);
+    }
+
+    auto primary_thread = nerfnet::StartThread([&]() { primary->Run(); });
+    auto secondary_thread =
+        nerfnet::StartThread([&]() { secondary->Run(); });
+    nerfnet::SleepUs(config.duration_us);
+    primary->Stop();
+    secondary->Stop();
+    nerfnet::JoinThread(primary_thread);
+    nerfnet::JoinThread(secondary_thread);
+  }
+
+  nerfnet::SetClock(nullptr);
+
+  uint64_t outage_end_us =
+      config.profile.outage_start_us + config.profile.outage_length_us;
+  bool recovered = true;
+  uint64_t recovery_us = 0;
+  for (SweepTunnel* tunnel : {&primary_tunnel, &secondary_tunnel}) {
+    uint64_t delivery_us;
+    if (config.profile.outage_length_us == 0 || !tunnel->IsOffering()) {
+      continue;
+    } else if (tunnel->GetFirstDeliveryUs(outage_end_us, delivery_us)) {
+      recovery_us = std::max(recovery_us, delivery_us - outage_end_us);
+    } else {
+      recovered = false;
+    }
+  }
+
+  for (SweepTunnel* tunnel : {&primary_tunnel, &secondary_tunnel}) {
+    delivered_bytes += tunnel->GetDeliveredBytes();
+    auto tunnel_latencies_us = tunnel->GetLatencies();
+    latencies_us.insert(latencies_us.end(),
+        tunnel_latencies_us.begin(), tunnel_latencies_us.end());
+  }
+
+  std::sort(latencies_us.begin(), latencies_us.end());
+  SweepResult result;
+  result.point = point;
+  result.goodput_kbps = (delivered_bytes * 8.0 * 1000.0) / config.duration_us;
+  result.frames = latencies_us.size();
+  result.p50_us = nerfnet::Percentile(latencies_us, 0.50);
+  result.p90_us = nerfnet::Percentile(latencies_us, 0.90);
+  result.p99_us = nerfnet::Percentile(latencies_us, 0.99);
+  result.recovered = recovered;
+  result.recovery_us = recovery_us;
+  return result;
+}
+
+// Returns true if the first result is at least as good as the second in
+// goodput and tail latency, and better in one of them.
+bool Dominates(const SweepResult& a, const SweepResult& b) {
+  return a.goodput_kbps >= b.goodput_kbps && a.p99_us <= b.p99_us
+      && (a.goodput_kbps > b.goodput_kbps || a.p99_us < b.p99_us);
+}
+
+// Logs a result as a row of the report.
+void LogResult(const SweepResult& result) {
+  const SweepPoint& point = result.point;
+  std::string recovery = result.recovered
+      ? std::to_string(result.recovery_us) : "never";
+  LOGI("%8llu %5u %5u %9llu %5d %9llu | %9.1f %7llu %9llu %9llu %9llu %9s",
+      static_cast<unsigned long long>(point.poll_interval_us),
+      point.retry_delay, point.retry_count,
+      static_cast<unsigned long long>(point.receive_timeout_us),
+      point.failures_before_recovery,
+      static_cast<unsigned long long>(point.max_backoff_us),
+      result.goodput_kbps, static_cast<unsigned long long>(result.frames),
+      static_cast<unsigned long long>(result.p50_us),
+      static_cast<unsigned long long>(result.p90_us),
+      static_cast<unsigned long long>(result.p99_us), recovery.c_str());
+}
+
+// Logs the header of the report.
+void LogHeader() {
+  LOGI("%8s %5s %5s %9s %5s %9s | %9s %7s %9s %9s %9s %9s",
+      "poll_us", "delay", "count", "rx_to_us", "fails", "backoff",
+      "kbps", "frames", "p50_us", "p90_us", "p99_us", "recov_us");
+}
+
+int main(int argc, char** argv) {
+  // Parse command-line arguments.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<std::string> poll_interval_us_arg("", "poll_interval_us",
+      "The poll intervals to sweep.", false, "100,1000", "list", cmd);
+  TCLAP::ValueArg<std::string> retry_delay_arg("", "retry_delay",
+      "The radio retransmission delays to sweep, in units of 250us.",
+      false, "0", "list", cmd);
+  TCLAP::ValueArg<std::string> retry_count_arg("", "retry_count",
+      "The radio retransmission counts to sweep.", false, "5,15", "list", cmd);
+  TCLAP::ValueArg<std::string> receive_timeout_us_arg("",
+      "receive_timeout_us", "The primary receive timeouts to sweep.",
+      false, "10000,100000", "list", cmd);
+  TCLAP::ValueArg<std::string> failures_before_recovery_arg("",
+      "failures_before_recovery", "The failure counts before recovery "
+      "probing to sweep.", false, "3", "list", cmd);
+  TCLAP::ValueArg<std::string> max_backoff_us_arg("", "max_backoff_us",
+      "The backoff bounds to sweep.", false, "50000", "list", cmd);
+  TCLAP::ValueArg<double> loss_arg("", "loss",
+      "The probability that each packet is lost.", false, 0.05,
+      "probability", cmd);
+  TCLAP::ValueArg<double> fade_probability_arg("", "fade_probability",
+      "The probability that the link fades for each packet sent.", false, 0.0,
+      "probability", cmd);
+  TCLAP::ValueArg<double> fade_length_arg("", "fade_length",
+      "The mean length of a fade in packets.", false, 100.0, "packets", cmd);
+  TCLAP::ValueArg<uint64_t> latency_us_arg("", "latency_us",
+      "The time added to the delivery of each packet.", false, 0,
+      "microseconds", cmd);
+  TCLAP::ValueArg<double> outage_start_arg("", "outage_start",
+      "The simulated time at which all packets start being lost.", false,
+      0.0, "seconds", cmd);
+  TCLAP::ValueArg<double> outage_length_arg("", "outage_length",
+      "The length of the outage, zero for none.", false, 0.0, "seconds", cmd);
+  TCLAP::ValueArg<uint64_t> max_recovery_us_arg("", "max_recovery_us",
+      "Fail if the link takes longer than this to deliver frames in each "
+      "direction after the outage, zero to not check.", false, 0,
+      "microseconds", cmd);
+  TCLAP::ValueArg<uint32_t> seed_arg("", "seed",
+      "The seed for the loss model.", false, 1, "seed", cmd);
+  TCLAP::ValueArg<size_t> downlink_frame_size_arg("", "downlink_frame_size",
+      "The size of frames offered by the primary, zero for none.", false, 256,
+      "bytes", cmd);
+  TCLAP::ValueArg<size_t> uplink_frame_size_arg("", "uplink_frame_size",
+      "The size of frames offered by the secondary, zero for none.", false,
+      64, "bytes", cmd);
+  TCLAP::ValueArg<uint64_t> offered_kbps_arg("", "offered_kbps",
+      "The rate offered in each direction, zero to saturate the link.", false,
+      0, "kbps", cmd);
+  TCLAP::ValueArg<size_t> max_buffered_frames_arg("", "max_buffered_frames",
+      "The maximum number of frames queued for the link on each side.",
+      false, 16, "frames", cmd);
+  TCLAP::ValueArg<double> duration_arg("", "duration",
+      "The simulated time to measure each point for.", false, 60.0,
+      "seconds", cmd);
+  TCLAP::SwitchArg symmetric_arg("", "symmetric",
+      "Set to measure the symmetric mode instead of primary polling. The "
+      "retry, receive timeout and recovery parameters are unused.", cmd);
+  cmd.parse(argc, argv);
+
+  SweepConfig config;
+  config.profile.loss = loss_arg.getValue();
+  config.profile.fade_probability = fade_probability_arg.getValue();
+  config.profile.fade_length = std::max(fade_length_arg.getValue(), 1.0);
+  config.profile.latency_us = latency_us_arg.getValue();
+  config.profile.outage_start_us =
+      static_cast<uint64_t>(outage_start_arg.getValue() * 1e6);
+  config.profile.outage_length_us =
+      static_cast<uint64_t>(outage_length_arg.getValue() * 1e6);
+  config.seed = seed_arg.getValue();
+  config.downlink_frame_size = downlink_frame_size_arg.getValue();
+  config.uplink_frame_size = uplink_frame_size_arg.getValue();
+  config.offered_bps = offered_kbps_arg.getValue() * 1000;
+  config.max_buffered_frames = max_buffered_frames_arg.getValue();
+  config.duration_us = static_cast<uint64_t>(duration_arg.getValue() * 1e6);
+  config.symmetric = symmetric_arg.getValue();
+  config.max_recovery_us = max_recovery_us_arg.getValue();
+
+  std::vector<SweepPoint> points;
+  for (auto poll_interval_us
+      : ParseList<uint64_t>(poll_interval_us_arg.getValue())) {
+    for (auto retry_delay : ParseList<uint8_t>(retry_delay_arg.getValue())) {
+      for (auto retry_count
+          : ParseList<uint8_t>(retry_count_arg.getValue())) {
+        for (auto receive_timeout_us
+            : ParseList<uint64_t>(receive_timeout_us_arg.getValue())) {
+          for (auto failures_before_recovery
+              : ParseList<int>(failures_before_recovery_arg.getValue())) {
+            for (auto max_backoff_us
+                : ParseList<uint64_t>(max_backoff_us_arg.getValue())) {
+              points.push_back({poll_interval_us,
+                  std::min<uint8_t>(retry_delay, 15),
+                  std::min<uint8_t>(retry_count, 15), receive_timeout_us,
+                  failures_before_recovery, max_backoff_us});
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // The report is logged once all points are measured, since the interfaces
+  // log each failed exchange while running.
+  LOGI("Sweeping %zu points for %.1f simulated seconds each", points.size(),
+      duration_arg.getValue());
+  std::vector<SweepResult> results;
+  for (const auto& point : points) {
+    results.push_back(MeasurePoint(config, point));
+  }
+
+  LogHeader();
+  for (const auto& result : results) {
+    LogResult(result);
+  }
+
+  bool delivered = std::any_of(results.begin(), results.end(),
+      [](const SweepResult& result) { return result.frames > 0; });
+  if (!delivered) {
+    LOGE("No point delivered any frames");
+    return 1;
+  }
+
+  if (config.max_recovery_us != 0 && config.profile.outage_length_us != 0) {
+    bool slow = std::any_of(results.begin(), results.end(),
+        [&](const SweepResult& result) {
+          return !result.recovered
+              || result.recovery_us > config.max_recovery_us;
+        });
+    if (slow) {
+      LOGE("A point took longer than %llu us to recover from the outage",
+          static_cast<unsigned long long>(config.max_recovery_us));
+      return 1;
+    }
+  }
+
+  LOGI("Pareto-optimal settings for goodput and p99 latency:");
+  LogHeader();
+  for (const auto& result : results) {
+    bool dominated = std::any_of(results.begin(), results.end(),
+        [&](const SweepResult& other) { return Dominates(other, result); });
+    if (!dominated && result.frames > 0) {
+      LogResult(result);
+    }
+  }
+
+  return 0;
+}
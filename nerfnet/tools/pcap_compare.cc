@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <tclap/CmdLine.h>
+#include <vector>
+
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/pcap.h"
+#include "nerfnet/util/stats.h"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "A tool for comparing packets offered to a nerfnet link with packets "
+    "delivered by it.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// Returns the throughput in bits per second for a number of bytes
+// transferred over a duration.
+double ThroughputBps(uint64_t bytes, uint64_t duration_us) {
+  if (duration_us == 0) {
+    return 0.0;
+  }
+
+  return (bytes * 8.0 * 1000000.0) / duration_us;
+}
+
+int main(int argc, char** argv) {
+  // Parse command-line arguments.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<std::string> offered_arg("", "offered",
+      "The pcap recorded with --offered_pcap on the sending side.",
+      true, "", "path", cmd);
+  TCLAP::ValueArg<std::string> delivered_arg("", "delivered",
+      "The pcap recorded with --record_pcap on the receiving side.",
+      true, "", "path", cmd);
+  cmd.parse(argc, argv);
+
+  // Index offered packets by content. Identical packets are matched in the
+  // order that they were offered.
+  std::map<std::vector<uint8_t>, std::deque<uint64_t>> offered_times;
+  uint64_t offered_frames = 0;
+  uint64_t offered_bytes = 0;
+  uint64_t offered_start_us = 0;
+  uint64_t offered_end_us = 0;
+  nerfnet::PcapReader offered(offered_arg.getValue());
+  nerfnet::PcapPacket packet;
+  while (offered.ReadPacket(packet)) {
+    if (offered_frames == 0) {
+      offered_start_us = packet.timestamp_us;
+    }
+
+    offered_end_us = packet.timestamp_us;
+    offered_frames++;
+    offered_bytes += packet.data.size();
+    offered_times[packet.data].push_back(packet.timestamp_us);
+  }
+
+  uint64_t delivered_frames = 0;
+  uint64_t delivered_bytes = 0;
+  uint64_t delivered_end_us = 0;
+  uint64_t unmatched_frames = 0;
+  std::vector<int64_t> latencies_us;
+  nerfnet::PcapReader delivered(delivered_arg.getValue());
+  while (delivered.ReadPacket(packet)) {
+    delivered_end_us = packet.timestamp_us;
+    delivered_frames++;
+    delivered_bytes += packet.data.size();
+
+    auto it = offered_times.find(packet.data);
+    if (it == offered_times.end() || it->second.empty()) {
+      unmatched_frames++;
+      continue;
+    }
+
+    latencies_us.push_back(static_cast<int64_t>(packet.timestamp_us)
+        - static_cast<int64_t>(it->second.front()));
+    it->second.pop_front();
+  }
+
+  CHECK(offered_frames > 0, "No packets were offered");
+  LOGI("offered: %llu frames, %llu bytes, %.1f kbps",
+      static_cast<unsigned long long>(offered_frames),
+      static_cast<unsigned long long>(offered_bytes),
+      ThroughputBps(offered_bytes, offered_end_us - offered_start_us) / 1000.0);
+  uint64_t delivered_duration_us = (delivered_end_us > offered_start_us)
+      ? delivered_end_us - offered_start_us : 0;
+  LOGI("delivered: %llu frames, %llu bytes, %.1f kbps, %.1f%% of frames",
+      static_cast<unsigned long long>(delivered_frames),
+      static_cast<unsigned long long>(delivered_bytes),
+      ThroughputBps(delivered_bytes, delivered_duration_us) / 1000.0,
+      (latencies_us.size() * 100.0) / offered_frames);
+  if (unmatched_frames > 0) {
+    LOGW("%llu delivered frames did not match an offered frame",
+        static_cast<unsigned long long>(unmatched_frames));
+  }
+
+  if (!latencies_us.empty()) {
+    std::sort(latencies_us.begin(), latencies_us.end());
+    LOGI("latency us: p50=%lld p90=%lld p99=%lld max=%lld",
+        static_cast<long long>(nerfnet::Percentile(latencies_us, 0.50)),
+        static_cast<long long>(nerfnet::Percentile(latencies_us, 0.90)),
+        static_cast<long long>(nerfnet::Percentile(latencies_us, 0.99)),
+        static_cast<long long>(latencies_us.back()));
+  }
+
+  return 0;
+}
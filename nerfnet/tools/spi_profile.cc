@@ -0,0 +1,149 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <tclap/CmdLine.h>
+#include <thread>
+
+#include "nerfnet/net/mock_spi.h"
+#include "nerfnet/net/nrf24_radio.h"
+#include "nerfnet/net/primary_radio_interface.h"
+#include "nerfnet/net/secondary_radio_interface.h"
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/time.h"
+
+// A description of the program.
+constexpr char kDescription[] =
+    "A tool for counting the SPI traffic used by the nerfnet radio driver "
+    "for each packet exchanged over the link.";
+
+// The version of the program.
+constexpr char kVersion[] = "0.0.1";
+
+// A tunnel that offers frames of a fixed size as fast as the link accepts
+// them and discards delivered frames.
+class ProfileTunnel : public nerfnet::Tunnel {
+ public:
+  explicit ProfileTunnel(size_t frame_size) : frame_size_(frame_size) {}
+
+  bool Read(std::vector<uint8_t>& frame) final {
+    if (frame_size_ == 0) {
+      nerfnet::SleepUs(10000);
+      return false;
+    }
+
+    frame.assign(frame_size_, 0xa5);
+    return true;
+  }
+
+  bool Write(const std::vector<uint8_t>& frame) final {
+    return true;
+  }
+
+ private:
+  // The size of frames to offer, zero to offer none.
+  const size_t frame_size_;
+};
+
+// Logs the traffic used by one side of the link.
+void LogCounters(const char* name, const nerfnet::MockSpi::Counters& counters) {
+  uint64_t packets = counters.packets_sent + counters.packets_received;
+  LOGI("%s: %llu packets sent, %llu received", name,
+      static_cast<unsigned long long>(counters.packets_sent),
+      static_cast<unsigned long long>(counters.packets_received));
+  if (packets == 0) {
+    return;
+  }
+
+  LOGI("%s: per packet: %.2f operations (%.2f excluding status polls), "
+      "%.2f transfers, %.1f bytes, %.2f chip-enable changes", name,
+      static_cast<double>(counters.operations) / packets,
+      static_cast<double>(counters.operations - counters.status_polls)
+          / packets,
+      static_cast<double>(counters.transfers) / packets,
+      static_cast<double>(counters.bytes) / packets,
+      static_cast<double>(counters.chip_enable_changes) / packets);
+}
+
+int main(int argc, char** argv) {
+  // Parse command-line arguments.
+  TCLAP::CmdLine cmd(kDescription, ' ', kVersion);
+  TCLAP::ValueArg<size_t> downlink_frame_size_arg("", "downlink_frame_size",
+      "The size of frames offered by the primary, zero for none.", false, 256,
+      "bytes", cmd);
+  TCLAP::ValueArg<size_t> uplink_frame_size_arg("", "uplink_frame_size",
+      "The size of frames offered by the secondary, zero for none.", false, 0,
+      "bytes", cmd);
+  TCLAP::ValueArg<uint64_t> poll_interval_us_arg("", "poll_interval_us",
+      "The poll interval of the primary.", false, 100, "microseconds", cmd);
+  TCLAP::ValueArg<double> duration_arg("", "duration",
+      "The time to run the link for.", false, 1.0, "seconds", cmd);
+  cmd.parse(argc, argv);
+
+  constexpr uint32_t kPrimaryAddr = 0x90019001;
+  constexpr uint32_t kSecondaryAddr = 0x90009000;
+  constexpr uint8_t kChannel = 1;
+
+  nerfnet::MockSpi primary_spi;
+  nerfnet::MockSpi secondary_spi;
+  nerfnet::MockSpi::Connect(primary_spi, secondary_spi);
+  nerfnet::Nrf24Radio primary_radio(primary_spi);
+  nerfnet::Nrf24Radio secondary_radio(secondary_spi);
+  ProfileTunnel primary_tunnel(downlink_frame_size_arg.getValue());
+  ProfileTunnel secondary_tunnel(uplink_frame_size_arg.getValue());
+
+  // Count only the traffic of the running link, not the radio setup.
+  nerfnet::MockSpi::Counters primary_start;
+  nerfnet::MockSpi::Counters secondary_start;
+  nerfnet::MockSpi::Counters primary_end;
+  nerfnet::MockSpi::Counters secondary_end;
+  {
+    nerfnet::PrimaryRadioInterface primary(primary_radio, primary_tunnel,
+        kPrimaryAddr, kSecondaryAddr, kChannel,
+        poll_interval_us_arg.getValue());
+    nerfnet::SecondaryRadioInterface secondary(secondary_radio,
+        secondary_tunnel, kPrimaryAddr, kSecondaryAddr, kChannel);
+    primary.SetMaxBufferedFrames(16);
+    secondary.SetMaxBufferedFrames(16);
+
+    primary_start = primary_spi.GetCounters();
+    secondary_start = secondary_spi.GetCounters();
+    std::thread primary_thread([&]() { primary.Run(); });
+    std::thread secondary_thread([&]() { secondary.Run(); });
+    nerfnet::SleepUs(static_cast<uint64_t>(duration_arg.getValue() * 1e6));
+    primary.Stop();
+    secondary.Stop();
+    primary_thread.join();
+    secondary_thread.join();
+    primary_end = primary_spi.GetCounters();
+    secondary_end = secondary_spi.GetCounters();
+  }
+
+  for (auto* counters : {&primary_end, &secondary_end}) {
+    const auto& start = (counters == &primary_end)
+        ? primary_start : secondary_start;
+    counters->operations -= start.operations;
+    counters->status_polls -= start.status_polls;
+    counters->transfers -= start.transfers;
+    counters->bytes -= start.bytes;
+    counters->chip_enable_changes -= start.chip_enable_changes;
+    counters->packets_sent -= start.packets_sent;
+    counters->packets_received -= start.packets_received;
+  }
+
+  LogCounters("primary", primary_end);
+  LogCounters("secondary", secondary_end);
+  return 0;
+}
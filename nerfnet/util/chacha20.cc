@@ -0,0 +1,241 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/util/chacha20.h"
+
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace nerfnet {
+namespace {
+
+// The ChaCha20 state is processed one row of four words at a time. Each
+// backend supplies the row type and the handful of operations needed by the
+// round function below.
+#if defined(__ARM_NEON)
+
+using Row = uint32x4_t;
+
+inline Row RowLoad(const uint32_t* words) { return vld1q_u32(words); }
+inline void RowStore(uint32_t* words, Row row) { vst1q_u32(words, row); }
+inline Row RowAdd(Row a, Row b) { return vaddq_u32(a, b); }
+inline Row RowXor(Row a, Row b) { return veorq_u32(a, b); }
+
+template<int kBits>
+inline Row RowRotl(Row row) {
+  return vsriq_n_u32(vshlq_n_u32(row, kBits), row, 32 - kBits);
+}
+
+template<>
+inline Row RowRotl<16>(Row row) {
+  return vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(row)));
+}
+
+// Rotates the lanes of a row left by the supplied number of words.
+template<int kWords>
+inline Row RowShuffle(Row row) { return vextq_u32(row, row, kWords); }
+
+#elif defined(__SSE2__)
+
+using Row = __m128i;
+
+inline Row RowLoad(const uint32_t* words) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(words));
+}
+
+inline void RowStore(uint32_t* words, Row row) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(words), row);
+}
+
+inline Row RowAdd(Row a, Row b) { return _mm_add_epi32(a, b); }
+inline Row RowXor(Row a, Row b) { return _mm_xor_si128(a, b); }
+
+template<int kBits>
+inline Row RowRotl(Row row) {
+  return _mm_or_si128(_mm_slli_epi32(row, kBits),
+                      _mm_srli_epi32(row, 32 - kBits));
+}
+
+template<int kWords>
+inline Row RowShuffle(Row row) {
+  return _mm_shuffle_epi32(row, _MM_SHUFFLE((kWords + 3) % 4,
+      (kWords + 2) % 4, (kWords + 1) % 4, kWords % 4));
+}
+
+#else
+
+struct Row {
+  uint32_t w[4];
+};
+
+inline Row RowLoad(const uint32_t* words) {
+  return {{words[0], words[1], words[2], words[3]}};
+}
+
+inline void RowStore(uint32_t* words, Row row) {
+  std::copy(row.w, row.w + 4, words);
+}
+
+inline Row RowAdd(Row a, Row b) {
+  return {{a.w[0] + b.w[0], a.w[1] + b.w[1],
+           a.w[2] + b.w[2], a.w[3] + b.w[3]}};
+}
+
+inline Row RowXor(Row a, Row b) {
+  return {{a.w[0] ^ b.w[0], a.w[1] ^ b.w[1],
+           a.w[2] ^ b.w[2], a.w[3] ^ b.w[3]}};
+}
+
+template<int kBits>
+inline Row RowRotl(Row row) {
+  for (auto& word : row.w) {
+    word = (word << kBits) | (word >> (32 - kBits));
+  }
+
+  return row;
+}
+
+template<int kWords>
+inline Row RowShuffle(Row row) {
+  return {{row.w[kWords % 4], row.w[(kWords + 1) % 4],
+           row.w[(kWords + 2) % 4], row.w[(kWords + 3) % 4]}};
+}
+
+#endif
+
+// Applies the quarter round to all four columns of the state at once.
+inline void QuarterRounds(Row& a, Row& b, Row& c, Row& d) {
+  a = RowAdd(a, b); d = RowRotl<16>(RowXor(d, a));
+  c = RowAdd(c, d); b = RowRotl<12>(RowXor(b, c));
+  a = RowAdd(a, b); d = RowRotl<8>(RowXor(d, a));
+  c = RowAdd(c, d); b = RowRotl<7>(RowXor(b, c));
+}
+
+// Runs the 20 ChaCha rounds over the supplied state. The input state is
+// added back to the output when requested, as is done for keystream blocks
+// but not for HChaCha20.
+void ChaCha20Rounds(const uint32_t* input, uint32_t* output, bool add_input) {
+  Row a = RowLoad(&input[0]);
+  Row b = RowLoad(&input[4]);
+  Row c = RowLoad(&input[8]);
+  Row d = RowLoad(&input[12]);
+
+  for (int i = 0; i < 10; i++) {
+    // Column round.
+    QuarterRounds(a, b, c, d);
+
+    // Diagonal round, performed by rotating rows into columns and back.
+    b = RowShuffle<1>(b);
+    c = RowShuffle<2>(c);
+    d = RowShuffle<3>(d);
+    QuarterRounds(a, b, c, d);
+    b = RowShuffle<3>(b);
+    c = RowShuffle<2>(c);
+    d = RowShuffle<1>(d);
+  }
+
+  if (add_input) {
+    a = RowAdd(a, RowLoad(&input[0]));
+    b = RowAdd(b, RowLoad(&input[4]));
+    c = RowAdd(c, RowLoad(&input[8]));
+    d = RowAdd(d, RowLoad(&input[12]));
+  }
+
+  RowStore(&output[0], a);
+  RowStore(&output[4], b);
+  RowStore(&output[8], c);
+  RowStore(&output[12], d);
+}
+
+uint32_t LoadLe32(const uint8_t* bytes) {
+  return static_cast<uint32_t>(bytes[0])
+      | (static_cast<uint32_t>(bytes[1]) << 8)
+      | (static_cast<uint32_t>(bytes[2]) << 16)
+      | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+void StoreLe32(uint8_t* bytes, uint32_t value) {
+  bytes[0] = static_cast<uint8_t>(value);
+  bytes[1] = static_cast<uint8_t>(value >> 8);
+  bytes[2] = static_cast<uint8_t>(value >> 16);
+  bytes[3] = static_cast<uint8_t>(value >> 24);
+}
+
+// Populates the constant and key words of a ChaCha20 state.
+void InitState(const uint8_t* key, uint32_t* state) {
+  state[0] = 0x61707865;
+  state[1] = 0x3320646e;
+  state[2] = 0x79622d32;
+  state[3] = 0x6b206574;
+  for (size_t i = 0; i < 8; i++) {
+    state[4 + i] = LoadLe32(&key[i * 4]);
+  }
+}
+
+}  // anonymous namespace
+
+void ChaCha20Block(const uint8_t* key, uint32_t counter,
+                   const uint8_t* nonce, uint8_t* block) {
+  uint32_t state[16];
+  InitState(key, state);
+  state[12] = counter;
+  state[13] = LoadLe32(&nonce[0]);
+  state[14] = LoadLe32(&nonce[4]);
+  state[15] = LoadLe32(&nonce[8]);
+
+  uint32_t output[16];
+  ChaCha20Rounds(state, output, /*add_input=*/true);
+  for (size_t i = 0; i < 16; i++) {
+    StoreLe32(&block[i * 4], output[i]);
+  }
+}
+
+void ChaCha20Xor(const uint8_t* key, uint32_t counter, const uint8_t* nonce,
+                 uint8_t* data, size_t size) {
+  uint8_t block[kChaCha20BlockSize];
+  while (size > 0) {
+    ChaCha20Block(key, counter++, nonce, block);
+    size_t block_size = std::min(size, kChaCha20BlockSize);
+    for (size_t i = 0; i < block_size; i++) {
+      data[i] ^= block[i];
+    }
+
+    data += block_size;
+    size -= block_size;
+  }
+}
+
+void HChaCha20(const uint8_t* key, const uint8_t* input, uint8_t* subkey) {
+  uint32_t state[16];
+  InitState(key, state);
+  for (size_t i = 0; i < 4; i++) {
+    state[12 + i] = LoadLe32(&input[i * 4]);
+  }
+
+  uint32_t output[16];
+  ChaCha20Rounds(state, output, /*add_input=*/false);
+  for (size_t i = 0; i < 4; i++) {
+    StoreLe32(&subkey[i * 4], output[i]);
+    StoreLe32(&subkey[16 + i * 4], output[12 + i]);
+  }
+}
+
+}  // namespace nerfnet
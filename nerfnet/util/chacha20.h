@@ -0,0 +1,50 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_UTIL_CHACHA20_H_
+#define NERFNET_UTIL_CHACHA20_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nerfnet {
+
+// The sizes of ChaCha20 keys, nonces and keystream blocks (RFC 8439).
+constexpr size_t kChaCha20KeySize = 32;
+constexpr size_t kChaCha20NonceSize = 12;
+constexpr size_t kChaCha20BlockSize = 64;
+
+// The size of the input to HChaCha20.
+constexpr size_t kHChaCha20InputSize = 16;
+
+// Generates one block of ChaCha20 keystream for the supplied key, block
+// counter and nonce. The rounds are vectorized with NEON or SSE2 when
+// available and fall back to portable code otherwise.
+void ChaCha20Block(const uint8_t* key, uint32_t counter,
+                   const uint8_t* nonce, uint8_t* block);
+
+// XORs the ChaCha20 keystream into the supplied buffer, starting at the
+// supplied block counter. Used for both encryption and decryption.
+void ChaCha20Xor(const uint8_t* key, uint32_t counter, const uint8_t* nonce,
+                 uint8_t* data, size_t size);
+
+// Derives a 32 byte subkey from a key and 16 byte input. This is the
+// HChaCha20 function from the XChaCha20 construction.
+void HChaCha20(const uint8_t* key, const uint8_t* input, uint8_t* subkey);
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_UTIL_CHACHA20_H_
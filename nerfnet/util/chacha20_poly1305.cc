@@ -0,0 +1,90 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/util/chacha20_poly1305.h"
+
+#include "nerfnet/util/chacha20.h"
+#include "nerfnet/util/log.h"
+#include "nerfnet/util/poly1305.h"
+
+namespace nerfnet {
+namespace {
+
+// Computes the full Poly1305 tag over the associated data and ciphertext.
+void ComputeTag(const uint8_t* key, const uint8_t* nonce,
+                const uint8_t* ad, size_t ad_size,
+                const uint8_t* data, size_t size,
+                uint8_t* tag) {
+  uint8_t block[kChaCha20BlockSize];
+  ChaCha20Block(key, 0, nonce, block);
+
+  Poly1305 poly1305(block);
+  poly1305.Update(ad, ad_size);
+  poly1305.PadToBlock();
+  poly1305.Update(data, size);
+  poly1305.PadToBlock();
+
+  uint8_t lengths[16];
+  for (size_t i = 0; i < 8; i++) {
+    lengths[i] = static_cast<uint8_t>(
+        static_cast<uint64_t>(ad_size) >> (i * 8));
+    lengths[8 + i] = static_cast<uint8_t>(
+        static_cast<uint64_t>(size) >> (i * 8));
+  }
+
+  poly1305.Update(lengths, sizeof(lengths));
+  poly1305.Finish(tag);
+}
+
+}  // anonymous namespace
+
+void ChaCha20Poly1305Seal(const uint8_t* key, const uint8_t* nonce,
+                          const uint8_t* ad, size_t ad_size,
+                          uint8_t* data, size_t size,
+                          uint8_t* tag, size_t tag_size) {
+  CHECK(tag_size <= kPoly1305TagSize, "Tag size is too large");
+  ChaCha20Xor(key, 1, nonce, data, size);
+
+  uint8_t full_tag[kPoly1305TagSize];
+  ComputeTag(key, nonce, ad, ad_size, data, size, full_tag);
+  for (size_t i = 0; i < tag_size; i++) {
+    tag[i] = full_tag[i];
+  }
+}
+
+bool ChaCha20Poly1305Open(const uint8_t* key, const uint8_t* nonce,
+                          const uint8_t* ad, size_t ad_size,
+                          uint8_t* data, size_t size,
+                          const uint8_t* tag, size_t tag_size) {
+  CHECK(tag_size <= kPoly1305TagSize, "Tag size is too large");
+  uint8_t full_tag[kPoly1305TagSize];
+  ComputeTag(key, nonce, ad, ad_size, data, size, full_tag);
+
+  // Compare in constant time to avoid leaking the position of a mismatch.
+  uint8_t difference = 0;
+  for (size_t i = 0; i < tag_size; i++) {
+    difference |= full_tag[i] ^ tag[i];
+  }
+
+  if (difference != 0) {
+    return false;
+  }
+
+  ChaCha20Xor(key, 1, nonce, data, size);
+  return true;
+}
+
+}  // namespace nerfnet
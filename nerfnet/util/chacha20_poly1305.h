@@ -0,0 +1,42 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_UTIL_CHACHA20_POLY1305_H_
+#define NERFNET_UTIL_CHACHA20_POLY1305_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nerfnet {
+
+// Encrypts the supplied data in place and computes an authentication tag over
+// the associated data and ciphertext using the ChaCha20-Poly1305 AEAD
+// construction (RFC 8439). The tag may be truncated to fewer than 16 bytes.
+void ChaCha20Poly1305Seal(const uint8_t* key, const uint8_t* nonce,
+                          const uint8_t* ad, size_t ad_size,
+                          uint8_t* data, size_t size,
+                          uint8_t* tag, size_t tag_size);
+
+// Verifies the tag and decrypts the supplied data in place. Returns false and
+// leaves the data untouched if the tag does not match.
+bool ChaCha20Poly1305Open(const uint8_t* key, const uint8_t* nonce,
+                          const uint8_t* ad, size_t ad_size,
+                          uint8_t* data, size_t size,
+                          const uint8_t* tag, size_t tag_size);
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_UTIL_CHACHA20_POLY1305_H_
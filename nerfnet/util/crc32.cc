@@ -0,0 +1,54 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/util/crc32.h"
+
+#include <array>
+
+namespace nerfnet {
+namespace {
+
+// The reversed CRC-32 polynomial.
+constexpr uint32_t kPolynomial = 0xedb88320;
+
+// Returns the CRC of each byte value.
+std::array<uint32_t, 256> BuildTable() {
+  std::array<uint32_t, 256> table;
+  for (uint32_t i = 0; i < table.size(); i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ kPolynomial : crc >> 1;
+    }
+
+    table[i] = crc;
+  }
+
+  return table;
+}
+
+}  // anonymous namespace
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc) {
+  static const std::array<uint32_t, 256> table = BuildTable();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+
+  return ~crc;
+}
+
+}  // namespace nerfnet
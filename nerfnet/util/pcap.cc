@@ -0,0 +1,205 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/util/pcap.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+namespace {
+
+// The magic numbers for microsecond and nanosecond resolution captures.
+constexpr uint32_t kPcapMagic = 0xa1b2c3d4;
+constexpr uint32_t kPcapNanosecondMagic = 0xa1b23c4d;
+
+// The supported link types.
+constexpr uint32_t kLinkTypeEthernet = 1;
+constexpr uint32_t kLinkTypeRaw = 101;
+constexpr uint32_t kLinkTypeLinuxSll = 113;
+constexpr uint32_t kLinkTypeIPv4 = 228;
+constexpr uint32_t kLinkTypeIPv6 = 229;
+
+// The ethertypes of IP packets and VLAN tags.
+constexpr uint16_t kEtherTypeIPv4 = 0x0800;
+constexpr uint16_t kEtherTypeIPv6 = 0x86dd;
+constexpr uint16_t kEtherTypeVlan = 0x8100;
+
+// The largest packet that will be read from a capture.
+constexpr uint32_t kMaxCaptureSize = 262144;
+
+uint32_t ByteSwap(uint32_t value) {
+  return ((value & 0x000000ff) << 24) | ((value & 0x0000ff00) << 8)
+      | ((value & 0x00ff0000) >> 8) | ((value & 0xff000000) >> 24);
+}
+
+uint16_t LoadBe16(const uint8_t* bytes) {
+  return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+}
+
+void WriteU32(FILE* file, uint32_t value) {
+  fwrite(&value, sizeof(value), 1, file);
+}
+
+void WriteU16(FILE* file, uint16_t value) {
+  fwrite(&value, sizeof(value), 1, file);
+}
+
+}  // anonymous namespace
+
+PcapReader::PcapReader(const std::string& path)
+    : file_(fopen(path.c_str(), "rb")),
+      swapped_(false),
+      nanosecond_(false),
+      link_type_(0) {
+  CHECK(file_ != nullptr, "Failed to open pcap '%s': %s (%d)",
+      path.c_str(), strerror(errno), errno);
+
+  uint32_t magic;
+  CHECK(fread(&magic, sizeof(magic), 1, file_) == 1,
+      "Failed to read pcap header");
+  if (magic == ByteSwap(kPcapMagic)
+      || magic == ByteSwap(kPcapNanosecondMagic)) {
+    swapped_ = true;
+    magic = ByteSwap(magic);
+  }
+
+  CHECK(magic == kPcapMagic || magic == kPcapNanosecondMagic,
+      "Unsupported pcap format in '%s'", path.c_str());
+  nanosecond_ = (magic == kPcapNanosecondMagic);
+
+  // Skip the version, timezone, sigfigs and snaplen fields.
+  uint8_t unused[16];
+  CHECK(fread(unused, sizeof(unused), 1, file_) == 1
+      && ReadU32(link_type_), "Failed to read pcap header");
+  CHECK(link_type_ == kLinkTypeEthernet || link_type_ == kLinkTypeRaw
+      || link_type_ == kLinkTypeLinuxSll || link_type_ == kLinkTypeIPv4
+      || link_type_ == kLinkTypeIPv6,
+      "Unsupported pcap link type %u", link_type_);
+}
+
+PcapReader::~PcapReader() {
+  fclose(file_);
+}
+
+bool PcapReader::ReadPacket(PcapPacket& packet) {
+  while (true) {
+    uint32_t ts_sec, ts_frac, captured_size, original_size;
+    if (!ReadU32(ts_sec)) {
+      return false;
+    } else if (!ReadU32(ts_frac) || !ReadU32(captured_size)
+        || !ReadU32(original_size)) {
+      LOGE("Truncated pcap record header");
+      return false;
+    } else if (captured_size > kMaxCaptureSize) {
+      LOGE("Invalid pcap record size %u", captured_size);
+      return false;
+    }
+
+    packet.data.resize(captured_size);
+    if (captured_size > 0
+        && fread(packet.data.data(), captured_size, 1, file_) != 1) {
+      LOGE("Truncated pcap record");
+      return false;
+    }
+
+    if (captured_size != original_size) {
+      LOGW("Skipping packet truncated by capture (%u vs %u)",
+          captured_size, original_size);
+    } else if (StripLinkHeader(packet.data)) {
+      packet.timestamp_us = static_cast<uint64_t>(ts_sec) * 1000000
+          + (nanosecond_ ? ts_frac / 1000 : ts_frac);
+      return true;
+    }
+  }
+}
+
+bool PcapReader::ReadU32(uint32_t& value) {
+  if (fread(&value, sizeof(value), 1, file_) != 1) {
+    return false;
+  }
+
+  if (swapped_) {
+    value = ByteSwap(value);
+  }
+
+  return true;
+}
+
+bool PcapReader::StripLinkHeader(std::vector<uint8_t>& data) {
+  size_t header_size = 0;
+  if (link_type_ == kLinkTypeEthernet || link_type_ == kLinkTypeLinuxSll) {
+    size_t ethertype_offset = (link_type_ == kLinkTypeEthernet) ? 12 : 14;
+    if (data.size() < ethertype_offset + 2) {
+      return false;
+    }
+
+    uint16_t ethertype = LoadBe16(&data[ethertype_offset]);
+    if (ethertype == kEtherTypeVlan && data.size() >= ethertype_offset + 6) {
+      ethertype_offset += 4;
+      ethertype = LoadBe16(&data[ethertype_offset]);
+    }
+
+    if (ethertype != kEtherTypeIPv4 && ethertype != kEtherTypeIPv6) {
+      return false;
+    }
+
+    header_size = ethertype_offset + 2;
+  }
+
+  data.erase(data.begin(), data.begin() + header_size);
+  if (data.empty()) {
+    return false;
+  }
+
+  // Only IPv4 and IPv6 packets can be forwarded through the tunnel.
+  uint8_t version = data[0] >> 4;
+  return version == 4 || version == 6;
+}
+
+PcapWriter::PcapWriter(const std::string& path)
+    : file_(fopen(path.c_str(), "wb")) {
+  CHECK(file_ != nullptr, "Failed to create pcap '%s': %s (%d)",
+      path.c_str(), strerror(errno), errno);
+  WriteU32(file_, kPcapMagic);
+  WriteU16(file_, 2);
+  WriteU16(file_, 4);
+  WriteU32(file_, 0);
+  WriteU32(file_, 0);
+  WriteU32(file_, kMaxCaptureSize);
+  WriteU32(file_, kLinkTypeRaw);
+  fflush(file_);
+}
+
+PcapWriter::~PcapWriter() {
+  fclose(file_);
+}
+
+void PcapWriter::WritePacket(uint64_t timestamp_us,
+                             const uint8_t* data, size_t size) {
+  WriteU32(file_, static_cast<uint32_t>(timestamp_us / 1000000));
+  WriteU32(file_, static_cast<uint32_t>(timestamp_us % 1000000));
+  WriteU32(file_, static_cast<uint32_t>(size));
+  WriteU32(file_, static_cast<uint32_t>(size));
+  fwrite(data, size, 1, file_);
+  if (fflush(file_) != 0) {
+    LOGE("Failed to write pcap: %s (%d)", strerror(errno), errno);
+  }
+}
+
+}  // namespace nerfnet
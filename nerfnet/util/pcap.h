@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_UTIL_PCAP_H_
+#define NERFNET_UTIL_PCAP_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// A packet read from a pcap file.
+struct PcapPacket {
+  // The capture timestamp of the packet in microseconds.
+  uint64_t timestamp_us = 0;
+
+  // The IP packet with any link layer header removed.
+  std::vector<uint8_t> data;
+};
+
+// Reads IP packets from a pcap file. Raw IP, ethernet and Linux cooked
+// captures are supported.
+class PcapReader : public NonCopyable {
+ public:
+  // Opens the pcap file. Quits and logs the error on failure.
+  explicit PcapReader(const std::string& path);
+  ~PcapReader();
+
+  // Reads the next IP packet, skipping any non-IP packets. Returns false at
+  // the end of the file or if the file is truncated.
+  bool ReadPacket(PcapPacket& packet);
+
+ private:
+  // The underlying file.
+  FILE* file_;
+
+  // Whether the file was written with the opposite byte order.
+  bool swapped_;
+
+  // Whether the timestamps have nanosecond resolution.
+  bool nanosecond_;
+
+  // The link type of the capture.
+  uint32_t link_type_;
+
+  // Reads a 32 bit value from the file in the byte order of the capture.
+  bool ReadU32(uint32_t& value);
+
+  // Strips the link layer header from a captured packet. Returns false if
+  // the packet does not contain an IP packet.
+  bool StripLinkHeader(std::vector<uint8_t>& data);
+};
+
+// Writes raw IP packets to a pcap file.
+class PcapWriter : public NonCopyable {
+ public:
+  // Creates the pcap file. Quits and logs the error on failure.
+  explicit PcapWriter(const std::string& path);
+  ~PcapWriter();
+
+  // Appends a packet to the file. The file is flushed after each packet so
+  // that the capture is usable if the process is interrupted.
+  void WritePacket(uint64_t timestamp_us, const uint8_t* data, size_t size);
+
+ private:
+  // The underlying file.
+  FILE* file_;
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_UTIL_PCAP_H_
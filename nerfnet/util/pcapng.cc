@@ -0,0 +1,154 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/util/pcapng.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+namespace {
+
+// The block types.
+constexpr uint32_t kSectionHeaderBlock = 0x0a0d0d0a;
+constexpr uint32_t kInterfaceDescriptionBlock = 0x00000001;
+constexpr uint32_t kEnhancedPacketBlock = 0x00000006;
+
+// The magic number that identifies the byte order of a section.
+constexpr uint32_t kByteOrderMagic = 0x1a2b3c4d;
+
+// The option codes.
+constexpr uint16_t kOptionEnd = 0;
+constexpr uint16_t kOptionComment = 1;
+constexpr uint16_t kOptionInterfaceName = 2;
+constexpr uint16_t kOptionPacketFlags = 2;
+
+// The largest packet recorded in a capture.
+constexpr uint32_t kSnapLength = 262144;
+
+}  // anonymous namespace
+
+PcapngWriter::PcapngWriter(const std::string& path)
+    : file_(fopen(path.c_str(), "wb")),
+      interface_count_(0) {
+  CHECK(file_ != nullptr, "Failed to create pcapng '%s': %s (%d)",
+      path.c_str(), strerror(errno), errno);
+
+  // The section length is unknown, which is written as -1.
+  StartBlock(kSectionHeaderBlock);
+  AppendU32(kByteOrderMagic);
+  AppendU16(1);
+  AppendU16(0);
+  AppendU32(0xffffffff);
+  AppendU32(0xffffffff);
+  FinishBlock();
+  Flush();
+}
+
+PcapngWriter::~PcapngWriter() {
+  fclose(file_);
+}
+
+uint32_t PcapngWriter::AddInterface(uint16_t link_type,
+                                    const std::string& name) {
+  StartBlock(kInterfaceDescriptionBlock);
+  AppendU16(link_type);
+  AppendU16(0);
+  AppendU32(kSnapLength);
+  AppendOption(kOptionInterfaceName,
+      reinterpret_cast<const uint8_t*>(name.data()), name.size());
+  AppendOption(kOptionEnd, nullptr, 0);
+  FinishBlock();
+  return interface_count_++;
+}
+
+void PcapngWriter::WritePacket(uint32_t interface_id, uint64_t timestamp_us,
+                               const uint8_t* data, size_t size,
+                               Direction direction,
+                               const std::string& comment) {
+  StartBlock(kEnhancedPacketBlock);
+  AppendU32(interface_id);
+  AppendU32(static_cast<uint32_t>(timestamp_us >> 32));
+  AppendU32(static_cast<uint32_t>(timestamp_us));
+  AppendU32(static_cast<uint32_t>(size));
+  AppendU32(static_cast<uint32_t>(size));
+  AppendPadded(data, size);
+
+  uint32_t flags = static_cast<uint32_t>(direction);
+  AppendOption(kOptionPacketFlags,
+      reinterpret_cast<const uint8_t*>(&flags), sizeof(flags));
+  if (!comment.empty()) {
+    AppendOption(kOptionComment,
+        reinterpret_cast<const uint8_t*>(comment.data()), comment.size());
+  }
+
+  AppendOption(kOptionEnd, nullptr, 0);
+  FinishBlock();
+}
+
+void PcapngWriter::Flush() {
+  if (fflush(file_) != 0) {
+    LOGE("Failed to flush pcapng: %s (%d)", strerror(errno), errno);
+  }
+}
+
+void PcapngWriter::StartBlock(uint32_t type) {
+  block_.clear();
+  AppendU32(type);
+
+  // The length is filled in once the block is complete.
+  AppendU32(0);
+}
+
+void PcapngWriter::AppendU16(uint16_t value) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  block_.insert(block_.end(), bytes, bytes + sizeof(value));
+}
+
+void PcapngWriter::AppendU32(uint32_t value) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  block_.insert(block_.end(), bytes, bytes + sizeof(value));
+}
+
+void PcapngWriter::AppendPadded(const uint8_t* data, size_t size) {
+  if (size > 0) {
+    block_.insert(block_.end(), data, data + size);
+  }
+
+  block_.resize(block_.size() + (4 - size % 4) % 4, 0x00);
+}
+
+void PcapngWriter::AppendOption(uint16_t code, const uint8_t* data,
+                                size_t size) {
+  AppendU16(code);
+  AppendU16(static_cast<uint16_t>(size));
+  AppendPadded(data, size);
+}
+
+void PcapngWriter::FinishBlock() {
+  // The length is repeated at the end so that the file can be read
+  // backwards.
+  uint32_t length = static_cast<uint32_t>(block_.size() + sizeof(uint32_t));
+  AppendU32(length);
+  memcpy(&block_[4], &length, sizeof(length));
+  if (fwrite(block_.data(), block_.size(), 1, file_) != 1) {
+    LOGE("Failed to write pcapng block: %s (%d)", strerror(errno), errno);
+  }
+}
+
+}  // namespace nerfnet
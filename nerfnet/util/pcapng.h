@@ -0,0 +1,87 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_UTIL_PCAPNG_H_
+#define NERFNET_UTIL_PCAPNG_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// Writes packets to a pcapng file. Unlike pcap, this allows packets from
+// several interfaces with different link types in one capture, each packet
+// carrying a direction and a comment.
+class PcapngWriter : public NonCopyable {
+ public:
+  // The direction of a packet relative to the capturing interface.
+  enum class Direction : uint32_t {
+    Unknown = 0,
+    Inbound = 1,
+    Outbound = 2,
+  };
+
+  // The link types used by nerfnet captures.
+  static constexpr uint16_t kLinkTypeRaw = 101;
+  static constexpr uint16_t kLinkTypeUser0 = 147;
+
+  // Creates the pcapng file. Quits and logs the error on failure.
+  explicit PcapngWriter(const std::string& path);
+  ~PcapngWriter();
+
+  // Adds an interface to the capture and returns its index. Timestamps are
+  // in microseconds since the epoch.
+  uint32_t AddInterface(uint16_t link_type, const std::string& name);
+
+  // Appends a packet captured on an interface. The comment is omitted if
+  // empty.
+  void WritePacket(uint32_t interface_id, uint64_t timestamp_us,
+                   const uint8_t* data, size_t size, Direction direction,
+                   const std::string& comment);
+
+  // Flushes written packets to the file.
+  void Flush();
+
+ private:
+  // The underlying file.
+  FILE* file_;
+
+  // The number of interfaces added.
+  uint32_t interface_count_;
+
+  // The block being assembled, which is reused between packets.
+  std::vector<uint8_t> block_;
+
+  // Starts a block of the supplied type.
+  void StartBlock(uint32_t type);
+
+  // Appends a value, bytes padded to 32 bits or an option to the block.
+  void AppendU16(uint16_t value);
+  void AppendU32(uint32_t value);
+  void AppendPadded(const uint8_t* data, size_t size);
+  void AppendOption(uint16_t code, const uint8_t* data, size_t size);
+
+  // Fills in the length of the block and writes it to the file.
+  void FinishBlock();
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_UTIL_PCAPNG_H_
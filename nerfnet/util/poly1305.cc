@@ -0,0 +1,181 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/util/poly1305.h"
+
+#include <algorithm>
+
+namespace nerfnet {
+namespace {
+
+// The mask for a 26 bit limb.
+constexpr uint32_t kLimbMask = 0x3ffffff;
+
+uint32_t LoadLe32(const uint8_t* bytes) {
+  return static_cast<uint32_t>(bytes[0])
+      | (static_cast<uint32_t>(bytes[1]) << 8)
+      | (static_cast<uint32_t>(bytes[2]) << 16)
+      | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+void StoreLe32(uint8_t* bytes, uint32_t value) {
+  bytes[0] = static_cast<uint8_t>(value);
+  bytes[1] = static_cast<uint8_t>(value >> 8);
+  bytes[2] = static_cast<uint8_t>(value >> 16);
+  bytes[3] = static_cast<uint8_t>(value >> 24);
+}
+
+}  // anonymous namespace
+
+Poly1305::Poly1305(const uint8_t* key)
+    : h_{0, 0, 0, 0, 0},
+      buffer_size_(0) {
+  r_[0] = (LoadLe32(&key[0])) & 0x3ffffff;
+  r_[1] = (LoadLe32(&key[3]) >> 2) & 0x3ffff03;
+  r_[2] = (LoadLe32(&key[6]) >> 4) & 0x3ffc0ff;
+  r_[3] = (LoadLe32(&key[9]) >> 6) & 0x3f03fff;
+  r_[4] = (LoadLe32(&key[12]) >> 8) & 0x00fffff;
+  for (size_t i = 0; i < 4; i++) {
+    pad_[i] = LoadLe32(&key[16 + i * 4]);
+  }
+}
+
+void Poly1305::Update(const uint8_t* data, size_t size) {
+  if (buffer_size_ > 0) {
+    size_t copy_size = std::min(size, kBlockSize - buffer_size_);
+    std::copy(data, data + copy_size, &buffer_[buffer_size_]);
+    buffer_size_ += copy_size;
+    data += copy_size;
+    size -= copy_size;
+    if (buffer_size_ < kBlockSize) {
+      return;
+    }
+
+    ProcessBlocks(buffer_, kBlockSize, /*final_block=*/false);
+    buffer_size_ = 0;
+  }
+
+  size_t block_bytes = size - (size % kBlockSize);
+  ProcessBlocks(data, block_bytes, /*final_block=*/false);
+  std::copy(data + block_bytes, data + size, buffer_);
+  buffer_size_ = size - block_bytes;
+}
+
+void Poly1305::PadToBlock() {
+  if (buffer_size_ > 0) {
+    std::fill(&buffer_[buffer_size_], &buffer_[kBlockSize], 0x00);
+    ProcessBlocks(buffer_, kBlockSize, /*final_block=*/false);
+    buffer_size_ = 0;
+  }
+}
+
+void Poly1305::Finish(uint8_t* tag) {
+  if (buffer_size_ > 0) {
+    buffer_[buffer_size_] = 1;
+    std::fill(&buffer_[buffer_size_ + 1], &buffer_[kBlockSize], 0x00);
+    ProcessBlocks(buffer_, kBlockSize, /*final_block=*/true);
+    buffer_size_ = 0;
+  }
+
+  // Fully carry the accumulator.
+  uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+  uint32_t c = h1 >> 26; h1 &= kLimbMask;
+  h2 += c; c = h2 >> 26; h2 &= kLimbMask;
+  h3 += c; c = h3 >> 26; h3 &= kLimbMask;
+  h4 += c; c = h4 >> 26; h4 &= kLimbMask;
+  h0 += c * 5; c = h0 >> 26; h0 &= kLimbMask;
+  h1 += c;
+
+  // Compute h - p and select it in constant time if it did not underflow.
+  uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= kLimbMask;
+  uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= kLimbMask;
+  uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= kLimbMask;
+  uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= kLimbMask;
+  uint32_t g4 = h4 + c - (1 << 26);
+
+  uint32_t mask = (g4 >> 31) - 1;
+  h0 = (h0 & ~mask) | (g0 & mask);
+  h1 = (h1 & ~mask) | (g1 & mask);
+  h2 = (h2 & ~mask) | (g2 & mask);
+  h3 = (h3 & ~mask) | (g3 & mask);
+  h4 = (h4 & ~mask) | (g4 & mask);
+
+  // Convert to 32 bit words and add the pad.
+  uint32_t words[4] = {
+    h0 | (h1 << 26),
+    (h1 >> 6) | (h2 << 20),
+    (h2 >> 12) | (h3 << 14),
+    (h3 >> 18) | (h4 << 8),
+  };
+
+  uint64_t f = 0;
+  for (size_t i = 0; i < 4; i++) {
+    f = static_cast<uint64_t>(words[i]) + pad_[i] + (f >> 32);
+    StoreLe32(&tag[i * 4], static_cast<uint32_t>(f));
+  }
+}
+
+void Poly1305::ProcessBlocks(const uint8_t* data, size_t size,
+                             bool final_block) {
+  const uint32_t hibit = final_block ? 0 : (1 << 24);
+  const uint32_t r0 = r_[0], r1 = r_[1], r2 = r_[2], r3 = r_[3], r4 = r_[4];
+  const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+  uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+
+  while (size >= kBlockSize) {
+    h0 += (LoadLe32(&data[0])) & kLimbMask;
+    h1 += (LoadLe32(&data[3]) >> 2) & kLimbMask;
+    h2 += (LoadLe32(&data[6]) >> 4) & kLimbMask;
+    h3 += (LoadLe32(&data[9]) >> 6) & kLimbMask;
+    h4 += (LoadLe32(&data[12]) >> 8) | hibit;
+
+    uint64_t d0 = static_cast<uint64_t>(h0) * r0
+        + static_cast<uint64_t>(h1) * s4 + static_cast<uint64_t>(h2) * s3
+        + static_cast<uint64_t>(h3) * s2 + static_cast<uint64_t>(h4) * s1;
+    uint64_t d1 = static_cast<uint64_t>(h0) * r1
+        + static_cast<uint64_t>(h1) * r0 + static_cast<uint64_t>(h2) * s4
+        + static_cast<uint64_t>(h3) * s3 + static_cast<uint64_t>(h4) * s2;
+    uint64_t d2 = static_cast<uint64_t>(h0) * r2
+        + static_cast<uint64_t>(h1) * r1 + static_cast<uint64_t>(h2) * r0
+        + static_cast<uint64_t>(h3) * s4 + static_cast<uint64_t>(h4) * s3;
+    uint64_t d3 = static_cast<uint64_t>(h0) * r3
+        + static_cast<uint64_t>(h1) * r2 + static_cast<uint64_t>(h2) * r1
+        + static_cast<uint64_t>(h3) * r0 + static_cast<uint64_t>(h4) * s4;
+    uint64_t d4 = static_cast<uint64_t>(h0) * r4
+        + static_cast<uint64_t>(h1) * r3 + static_cast<uint64_t>(h2) * r2
+        + static_cast<uint64_t>(h3) * r1 + static_cast<uint64_t>(h4) * r0;
+
+    uint32_t c = static_cast<uint32_t>(d0 >> 26);
+    h0 = static_cast<uint32_t>(d0) & kLimbMask;
+    d1 += c; c = static_cast<uint32_t>(d1 >> 26);
+    h1 = static_cast<uint32_t>(d1) & kLimbMask;
+    d2 += c; c = static_cast<uint32_t>(d2 >> 26);
+    h2 = static_cast<uint32_t>(d2) & kLimbMask;
+    d3 += c; c = static_cast<uint32_t>(d3 >> 26);
+    h3 = static_cast<uint32_t>(d3) & kLimbMask;
+    d4 += c; c = static_cast<uint32_t>(d4 >> 26);
+    h4 = static_cast<uint32_t>(d4) & kLimbMask;
+    h0 += c * 5; c = h0 >> 26; h0 &= kLimbMask;
+    h1 += c;
+
+    data += kBlockSize;
+    size -= kBlockSize;
+  }
+
+  h_[0] = h0; h_[1] = h1; h_[2] = h2; h_[3] = h3; h_[4] = h4;
+}
+
+}  // namespace nerfnet
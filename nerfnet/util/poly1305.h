@@ -0,0 +1,69 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_UTIL_POLY1305_H_
+#define NERFNET_UTIL_POLY1305_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "nerfnet/util/non_copyable.h"
+
+namespace nerfnet {
+
+// The sizes of Poly1305 one-time keys and tags.
+constexpr size_t kPoly1305KeySize = 32;
+constexpr size_t kPoly1305TagSize = 16;
+
+// An incremental Poly1305 one-time authenticator (RFC 8439). A key must never
+// be used to authenticate more than one message.
+class Poly1305 : public NonCopyable {
+ public:
+  // Setup the authenticator with a 32 byte one-time key.
+  explicit Poly1305(const uint8_t* key);
+
+  // Appends data to the message being authenticated.
+  void Update(const uint8_t* data, size_t size);
+
+  // Appends zeros to pad the message to a multiple of 16 bytes.
+  void PadToBlock();
+
+  // Produces the 16 byte tag for the message.
+  void Finish(uint8_t* tag);
+
+ private:
+  // The size of a Poly1305 block.
+  static constexpr size_t kBlockSize = 16;
+
+  // The clamped r value and s pad of the key, in 26 bit limbs for r.
+  uint32_t r_[5];
+  uint32_t pad_[4];
+
+  // The accumulator, in 26 bit limbs.
+  uint32_t h_[5];
+
+  // Buffered bytes that do not yet form a complete block.
+  uint8_t buffer_[kBlockSize];
+  size_t buffer_size_;
+
+  // Folds blocks of the message into the accumulator. Full blocks have the
+  // high bit set, the final partial block is padded by the caller instead.
+  void ProcessBlocks(const uint8_t* data, size_t size, bool final_block);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_UTIL_POLY1305_H_
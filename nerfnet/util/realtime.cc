@@ -0,0 +1,64 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/util/realtime.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+namespace {
+
+// The amount of stack to fault in ahead of time.
+constexpr size_t kPrefaultStackSize = 256 * 1024;
+
+// Touches the stack so that it is faulted in and locked.
+void PrefaultStack() {
+  volatile uint8_t stack[kPrefaultStackSize];
+  memset(const_cast<uint8_t*>(stack), 0, sizeof(stack));
+}
+
+}  // anonymous namespace
+
+void SetThreadAffinity(pthread_t thread, int cpu) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  int status = pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set);
+  CHECK(status == 0, "Failed to pin thread to cpu %d: %s (%d)", cpu,
+      strerror(status), status);
+}
+
+void SetThreadRealtimePriority(pthread_t thread, int priority) {
+  struct sched_param param = {};
+  param.sched_priority = priority;
+  int status = pthread_setschedparam(thread, SCHED_FIFO, &param);
+  CHECK(status == 0, "Failed to set realtime priority %d: %s (%d)", priority,
+      strerror(status), status);
+}
+
+void LockMemory() {
+  CHECK(mlockall(MCL_CURRENT | MCL_FUTURE) == 0,
+      "Failed to lock memory: %s (%d)", strerror(errno), errno);
+  PrefaultStack();
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_UTIL_REALTIME_H_
+#define NERFNET_UTIL_REALTIME_H_
+
+#include <pthread.h>
+
+namespace nerfnet {
+
+// Pins a thread to a single CPU. Quits and logs the error on failure.
+void SetThreadAffinity(pthread_t thread, int cpu);
+
+// Runs a thread with the SCHED_FIFO policy at the supplied priority. Quits
+// and logs the error on failure.
+void SetThreadRealtimePriority(pthread_t thread, int priority);
+
+// Locks all current and future memory of the process so that it is never
+// paged out, then prefaults the stack of the calling thread so that growing
+// it does not fault either. Quits and logs the error on failure.
+void LockMemory();
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_UTIL_REALTIME_H_
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_UTIL_STATS_H_
+#define NERFNET_UTIL_STATS_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace nerfnet {
+
+// Returns the supplied percentile, from 0.0 to 1.0, of a sorted list of
+// values, or zero if the list is empty.
+template<typename T>
+T Percentile(const std::vector<T>& sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0;
+  }
+
+  size_t index = static_cast<size_t>(percentile * (sorted.size() - 1));
+  return sorted[index];
+}
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_UTIL_STATS_H_
@@ -33,6 +33,7 @@ std::string StringFormat(const char* format, ...) {
   std::string output = std::string(size + 1, '\0');
   size = vsnprintf(output.data(), output.size(), format, vl_copy);
   CHECK(size >= 0, "Failed to format outout");
+  output.resize(size);
 
   va_end(vl_copy);
   va_end(vl);
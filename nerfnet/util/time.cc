@@ -16,18 +16,91 @@
 
 #include "nerfnet/util/time.h"
 
+#include <atomic>
 #include <chrono>
 #include <unistd.h>
 
 namespace nerfnet {
+namespace {
+
+// The clock of the system.
+class SystemClock : public Clock {
+ public:
+  uint64_t NowUs() final {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void SleepUs(uint64_t delay) final {
+    usleep(delay);
+  }
+};
+
+// The system clock and the clock currently installed.
+SystemClock system_clock;
+std::atomic<Clock*> current_clock(&system_clock);
+
+}  // anonymous namespace
+
+ClockThread Clock::StartThread(std::function<void()> function) {
+  ClockThread thread;
+  thread.thread = std::thread(std::move(function));
+  return thread;
+}
+
+void Clock::JoinThread(ClockThread& thread) {
+  thread.thread.join();
+}
+
+void Clock::LockMutex(std::mutex& mutex) {
+  mutex.lock();
+}
+
+void Clock::WaitUs(std::condition_variable& cv,
+                   std::unique_lock<std::mutex>& lock, uint64_t timeout_us) {
+  cv.wait_for(lock, std::chrono::microseconds(timeout_us));
+}
+
+void Clock::NotifyOne(std::condition_variable& cv) {
+  cv.notify_one();
+}
+
+void SetClock(Clock* clock) {
+  current_clock = (clock != nullptr) ? clock : &system_clock;
+}
 
 void SleepUs(uint64_t delay) {
-  usleep(delay);
+  current_clock.load()->SleepUs(delay);
 }
 
 uint64_t TimeNowUs() {
+  return current_clock.load()->NowUs();
+}
+
+uint64_t RealTimeNowUs() {
   return std::chrono::duration_cast<std::chrono::microseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()).count();
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+ClockThread StartThread(std::function<void()> function) {
+  return current_clock.load()->StartThread(std::move(function));
+}
+
+void JoinThread(ClockThread& thread) {
+  current_clock.load()->JoinThread(thread);
+}
+
+void LockMutex(std::mutex& mutex) {
+  current_clock.load()->LockMutex(mutex);
+}
+
+void WaitUs(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+            uint64_t timeout_us) {
+  current_clock.load()->WaitUs(cv, lock, timeout_us);
+}
+
+void NotifyOne(std::condition_variable& cv) {
+  current_clock.load()->NotifyOne(cv);
 }
 
 }  // namespace nerfnet
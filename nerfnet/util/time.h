@@ -17,16 +17,91 @@
 #ifndef NERFNET_UTIL_TIME_H_
 #define NERFNET_UTIL_TIME_H_
 
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "nerfnet/util/non_copyable.h"
 
 namespace nerfnet {
 
+// A thread started through a clock. A clock may run its threads cooperatively
+// on a single system thread, in which case it identifies them by ID instead.
+struct ClockThread {
+  // The system thread, if one was started.
+  std::thread thread;
+
+  // The ID assigned by a cooperative clock, or zero.
+  uint64_t id = 0;
+
+  // Returns true if the thread has been started and not yet joined.
+  bool Joinable() const {
+    return thread.joinable() || id != 0;
+  }
+};
+
+// A source of time for the link logic. The system clock is used unless
+// another clock is installed, which allows the link to run in simulated time.
+class Clock : public NonCopyable {
+ public:
+  virtual ~Clock() = default;
+
+  // Returns the current time in microseconds.
+  virtual uint64_t NowUs() = 0;
+
+  // Sleeps for the supplied number of microseconds.
+  virtual void SleepUs(uint64_t delay) = 0;
+
+  // Starts and joins threads that use the clock.
+  virtual ClockThread StartThread(std::function<void()> function);
+  virtual void JoinThread(ClockThread& thread);
+
+  // Locks a mutex that may be held by another thread while it sleeps.
+  virtual void LockMutex(std::mutex& mutex);
+
+  // Waits for a condition variable to be notified, or for the timeout to
+  // elapse. This may return early, so the condition must be checked again.
+  virtual void WaitUs(std::condition_variable& cv,
+                      std::unique_lock<std::mutex>& lock, uint64_t timeout_us);
+
+  // Wakes one thread waiting on a condition variable.
+  virtual void NotifyOne(std::condition_variable& cv);
+};
+
+// Installs the clock used by the functions below, or restores the system
+// clock if null. The clock must outlive its use and must not be changed while
+// threads are using it.
+void SetClock(Clock* clock);
+
 // Sleeps for the privided number of microseconds.
 void SleepUs(uint64_t delay);
 
 // Returns the current time in microseconds.
 uint64_t TimeNowUs();
 
+// Returns the current wall clock time in microseconds since the epoch. Unlike
+// TimeNowUs this is comparable between systems with synchronized clocks. This
+// always reads the system clock.
+uint64_t RealTimeNowUs();
+
+// Starts and joins a thread that sleeps or reads the time through the
+// installed clock.
+ClockThread StartThread(std::function<void()> function);
+void JoinThread(ClockThread& thread);
+
+// Locks a mutex that may be held by another thread while it sleeps.
+void LockMutex(std::mutex& mutex);
+
+// Waits for a condition variable to be notified, or for the timeout to
+// elapse. This may return early, so the condition must be checked again.
+void WaitUs(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+            uint64_t timeout_us);
+
+// Wakes one thread waiting on a condition variable.
+void NotifyOne(std::condition_variable& cv);
+
 }  // namespace nerfnet
 
 #endif  // NERFNET_UTIL_TIME_H_
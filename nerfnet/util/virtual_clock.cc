@@ -0,0 +1,156 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nerfnet/util/virtual_clock.h"
+
+#include <algorithm>
+
+#include "nerfnet/util/log.h"
+
+namespace nerfnet {
+
+VirtualClock::VirtualClock()
+    : now_us_(0),
+      running_id_(kMainThreadId),
+      next_id_(kMainThreadId + 1),
+      next_sequence_(0) {
+  fibers_[kMainThreadId];
+}
+
+VirtualClock::~VirtualClock() {
+  CHECK(fibers_.size() == 1, "Virtual clock destroyed with running threads");
+}
+
+uint64_t VirtualClock::NowUs() {
+  return now_us_;
+}
+
+void VirtualClock::SleepUs(uint64_t delay) {
+  QueueWakeUp(running_id_, delay);
+  RunNext();
+}
+
+ClockThread VirtualClock::StartThread(std::function<void()> function) {
+  ClockThread thread;
+  thread.id = next_id_++;
+  Fiber& fiber = fibers_[thread.id];
+  fiber.stack.reset(new uint8_t[kStackSize]);
+  fiber.function = std::move(function);
+  CHECK(getcontext(&fiber.context) == 0, "Failed to get thread context");
+  fiber.context.uc_stack.ss_sp = fiber.stack.get();
+  fiber.context.uc_stack.ss_size = kStackSize;
+  fiber.context.uc_link = nullptr;
+  uintptr_t clock = reinterpret_cast<uintptr_t>(this);
+  makecontext(&fiber.context, reinterpret_cast<void (*)()>(&RunFiber), 2,
+      static_cast<uint32_t>(static_cast<uint64_t>(clock) >> 32),
+      static_cast<uint32_t>(clock));
+
+  // The new thread first runs once the caller sleeps.
+  QueueWakeUp(thread.id, 0);
+  return thread;
+}
+
+void VirtualClock::JoinThread(ClockThread& thread) {
+  auto fiber = fibers_.find(thread.id);
+  CHECK(fiber != fibers_.end() && thread.id != running_id_,
+      "Invalid thread to join");
+  if (!fiber->second.finished) {
+    fiber->second.joiner = running_id_;
+    RunNext();
+  }
+
+  fibers_.erase(fiber);
+  thread.id = 0;
+}
+
+void VirtualClock::LockMutex(std::mutex& mutex) {
+  uint64_t retry_interval_us = kMinRetryIntervalUs;
+  while (!mutex.try_lock()) {
+    SleepUs(retry_interval_us);
+    retry_interval_us = std::min(retry_interval_us * 2, kMaxRetryIntervalUs);
+  }
+}
+
+void VirtualClock::WaitUs(std::condition_variable& cv,
+                          std::unique_lock<std::mutex>& lock,
+                          uint64_t timeout_us) {
+  lock.unlock();
+  WakeUp wake_up = QueueWakeUp(running_id_, timeout_us);
+  waiters_.emplace(&cv, wake_up);
+  RunNext();
+
+  // The entry remains if the wait timed out.
+  auto range = waiters_.equal_range(&cv);
+  for (auto waiter = range.first; waiter != range.second; waiter++) {
+    if (waiter->second == wake_up) {
+      waiters_.erase(waiter);
+      break;
+    }
+  }
+
+  lock.lock();
+}
+
+void VirtualClock::NotifyOne(std::condition_variable& cv) {
+  auto waiter = waiters_.find(&cv);
+  if (waiter == waiters_.end()) {
+    return;
+  }
+
+  // The waiting thread is moved to wake up now, which is once the notifying
+  // thread sleeps.
+  auto sleeper = sleepers_.find(waiter->second);
+  uint64_t id = sleeper->second;
+  sleepers_.erase(sleeper);
+  waiters_.erase(waiter);
+  QueueWakeUp(id, 0);
+}
+
+VirtualClock::WakeUp VirtualClock::QueueWakeUp(uint64_t id, uint64_t delay) {
+  WakeUp wake_up(now_us_ + delay, next_sequence_++);
+  sleepers_[wake_up] = id;
+  return wake_up;
+}
+
+void VirtualClock::RunNext() {
+  CHECK(!sleepers_.empty(), "All virtual clock threads are blocked");
+  auto next = sleepers_.begin();
+  now_us_ = next->first.first;
+  uint64_t previous_id = running_id_;
+  running_id_ = next->second;
+  sleepers_.erase(next);
+  if (running_id_ != previous_id) {
+    CHECK(swapcontext(&fibers_[previous_id].context,
+        &fibers_[running_id_].context) == 0, "Failed to switch threads");
+  }
+}
+
+void VirtualClock::RunFiber(uint32_t clock_high, uint32_t clock_low) {
+  auto* clock = reinterpret_cast<VirtualClock*>(static_cast<uintptr_t>(
+      (static_cast<uint64_t>(clock_high) << 32) | clock_low));
+  Fiber& fiber = clock->fibers_[clock->running_id_];
+  fiber.function();
+  fiber.function = nullptr;
+  fiber.finished = true;
+  if (fiber.joiner.has_value()) {
+    clock->QueueWakeUp(fiber.joiner.value(), 0);
+  }
+
+  // The stack is freed once the thread is joined, so this never returns.
+  clock->RunNext();
+}
+
+}  // namespace nerfnet
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2020 Andrew Rossignol andrew.rossignol@gmail.com
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NERFNET_UTIL_VIRTUAL_CLOCK_H_
+#define NERFNET_UTIL_VIRTUAL_CLOCK_H_
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ucontext.h>
+#include <utility>
+
+#include "nerfnet/util/time.h"
+
+namespace nerfnet {
+
+// A clock that runs in simulated time, starting from zero. Its threads run
+// cooperatively on the system thread that creates the clock, each on its own
+// stack, and only switch when they sleep. When the running thread sleeps,
+// time jumps forward to the earliest wake-up and that thread runs next, with
+// ties broken in the order the threads went to sleep. Runs are deterministic
+// as long as each thread only blocks by sleeping on the clock.
+//
+// Only the thread that creates the clock and threads started through it may
+// use it. A thread must never block on a mutex that may be held by a sleeping
+// thread except through LockMutex, nor wait on a condition variable except
+// through WaitUs and NotifyOne.
+class VirtualClock : public Clock {
+ public:
+  VirtualClock();
+  ~VirtualClock();
+
+  // Clock implementation.
+  uint64_t NowUs() final;
+  void SleepUs(uint64_t delay) final;
+  ClockThread StartThread(std::function<void()> function) final;
+  void JoinThread(ClockThread& thread) final;
+  void LockMutex(std::mutex& mutex) final;
+  void WaitUs(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+              uint64_t timeout_us) final;
+  void NotifyOne(std::condition_variable& cv) final;
+
+ private:
+  // The size of the stack of each thread.
+  static constexpr size_t kStackSize = 1024 * 1024;
+
+  // The bounds of the time to sleep between attempts to lock a mutex. The
+  // interval doubles with each attempt, which limits the number of turns
+  // taken while a mutex is held across a long sleep.
+  static constexpr uint64_t kMinRetryIntervalUs = 1;
+  static constexpr uint64_t kMaxRetryIntervalUs = 100;
+
+  // The ID of the thread that created the clock.
+  static constexpr uint64_t kMainThreadId = 0;
+
+  // A thread run by the clock.
+  struct Fiber {
+    // The saved context of the thread while it is not running.
+    ucontext_t context;
+
+    // The stack and function of a started thread.
+    std::unique_ptr<uint8_t[]> stack;
+    std::function<void()> function;
+
+    // Set once the function has returned.
+    bool finished = false;
+
+    // The thread waiting to join this one, if any.
+    std::optional<uint64_t> joiner;
+  };
+
+  // The current time.
+  uint64_t now_us_;
+
+  // The threads that have not been joined, by ID, and the thread that is
+  // running.
+  std::map<uint64_t, Fiber> fibers_;
+  uint64_t running_id_;
+  uint64_t next_id_;
+
+  // The time of a wake-up and the order that it was queued in.
+  using WakeUp = std::pair<uint64_t, uint64_t>;
+
+  // The sleeping threads ordered by wake-up time and then by the order they
+  // went to sleep.
+  std::map<WakeUp, uint64_t> sleepers_;
+  uint64_t next_sequence_;
+
+  // The wake-ups of threads waiting on each condition variable.
+  std::multimap<std::condition_variable*, WakeUp> waiters_;
+
+  // Queues a thread to wake up after the supplied delay.
+  WakeUp QueueWakeUp(uint64_t id, uint64_t delay);
+
+  // Advances to the earliest wake-up and switches to that thread. Returns
+  // once the calling thread runs again, which is immediately if it is the
+  // earliest to wake up.
+  void RunNext();
+
+  // Runs the function of a started thread and switches away once it
+  // returns. The clock is passed in two halves to fit the arguments of
+  // makecontext.
+  static void RunFiber(uint32_t clock_high, uint32_t clock_low);
+};
+
+}  // namespace nerfnet
+
+#endif  // NERFNET_UTIL_VIRTUAL_CLOCK_H_